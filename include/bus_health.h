@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+// CAN bus health monitor.
+// Fed with periodic controller status samples, it tracks error counter trends, bus error and
+// arbitration loss rates, and drives bus-off recovery: the first recovery starts after
+// BUS_BACKOFF_MIN_MS, and every bus-off soon after a recovery doubles the wait up to
+// BUS_BACKOFF_MAX_MS. One task samples; any task may read stats() without blocking it.
+
+#define BUS_BACKOFF_MIN_MS      (100)
+#define BUS_BACKOFF_MAX_MS      (10000)
+#define BUS_STABLE_MS           (10000) // running this long resets the backoff
+#define BUS_TREND_SHIFT         (2)     // error counter trend smoothing, 1/4 new sample
+
+enum BusState : uint8_t {
+    BUS_STATE_STOPPED,
+    BUS_STATE_RUNNING,
+    BUS_STATE_BUS_OFF,
+    BUS_STATE_RECOVERING
+};
+
+// Controller status, counters cumulative since the driver was (re)started.
+struct CanStatus {
+    BusState state;
+    uint16_t tx_error_counter;
+    uint16_t rx_error_counter;
+    uint32_t bus_error_count;
+    uint32_t arb_lost_count;
+    uint32_t rx_missed_count;
+    uint32_t tx_failed_count;
+};
+
+enum BusAction : uint8_t {
+    BUS_ACTION_NONE,
+    BUS_ACTION_RECOVER,     // bus-off: start the recovery sequence
+    BUS_ACTION_START        // recovered and stopped: start the controller
+};
+
+struct BusHealthStats {
+    BusState state;
+    uint16_t tec;
+    uint16_t rec;
+    uint16_t tec_peak;
+    int16_t tec_trend;          // smoothed change per second
+    int16_t rec_trend;
+    uint16_t bus_error_rate;    // per second, last sample period
+    uint16_t arb_lost_rate;
+    uint32_t bus_errors;        // totals since boot
+    uint32_t arb_lost;
+    uint32_t rx_missed;
+    uint32_t tx_failed;
+    uint16_t bus_off_count;
+    uint16_t recoveries;        // recovery sequences started
+    uint32_t backoff_ms;        // wait before the next recovery
+    uint32_t bus_off_ms;        // total time not running since boot
+};
+
+class BusHealth {
+public:
+    BusHealth();
+
+    // Feed one status sample taken at `now` (millis). Returns what the caller should do.
+    BusAction sample(const CanStatus& status, uint32_t now);
+
+    // Consistent copy of the latest statistics.
+    BusHealthStats stats() const;
+
+private:
+    void publish();
+    static uint32_t delta(uint32_t current, uint32_t previous);
+
+    BusHealthStats current;
+    CanStatus last;
+    bool have_last;
+    uint32_t last_millis;
+    uint32_t off_since;
+    uint32_t running_since;
+    uint32_t next_attempt;
+    int32_t tec_trend_acc;      // trend << BUS_TREND_SHIFT
+    int32_t rec_trend_acc;
+
+    // seqlock: odd while the writer updates `published`
+    std::atomic<uint32_t> seq;
+    BusHealthStats published;
+};
+
+const char* bus_state_name(BusState state);
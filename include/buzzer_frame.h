@@ -0,0 +1,54 @@
+#pragma once
+#include <stdint.h>
+
+// Buzzer frame formats.
+//
+// v0, one event per frame, big-endian:
+//   id 0x000 | buzzer: [0] press_id, [4..7] ms since lit (status and heartbeat)
+//   TIME_SYNC_REPLY_ID | buzzer: [0] sync seq, [4..7] buzzer us at sync reception
+//   TIME_SYNC_PRESS_ID | buzzer: [0] press_id, [4..7] buzzer us at press
+//   LATENCY_ECHO_ID | buzzer: [0] ping seq
+//
+// v1, up to four events per frame, id BUZZER_EVENT_ID | buzzer:
+//   [0] version (2 bits) | event count (3 bits) | reserved (3 bits, must be 0)
+//   [1..3] time of the first event, ms since lit (24 bits)
+//   [4..7] events. Each starts with type (3 bits) | ms since the previous event (5 bits),
+//          followed by BUZZER_EVENT_SIZE[type] - 1 payload bytes. Events further apart
+//          than 31 ms go into separate frames.
+//
+// The display announces the highest version it decodes in byte 1 of the discovery request.
+// Firmware that never sees it, or only knows v0, keeps sending v0 frames.
+
+#define BUZZER_EVENT_ID             (0x400) // | buzzer id, v1 event frames
+#define BUZZER_PAYLOAD_VERSION      (1)     // highest version this display decodes
+#define BUZZER_FRAME_MAX_EVENTS     (4)
+
+enum BuzzerFrameKind : uint8_t {
+    BUZZER_FRAME_STATUS,        // press_id, press_millis since lit (v0 status, v1 press and heartbeat)
+    BUZZER_FRAME_SYNC_REPLY,    // sync seq, buzzer us at sync
+    BUZZER_FRAME_TIMED_PRESS,   // press_id, buzzer us at press
+    BUZZER_FRAME_RELEASE,       // press_id, press_millis since lit
+    BUZZER_FRAME_BATTERY,       // press_millis: battery voltage in mV
+    BUZZER_FRAME_ECHO           // press_id: latency ping seq
+};
+
+enum BuzzerEventType : uint8_t {
+    BUZZER_EVENT_HEARTBEAT,     // [1] last press_id
+    BUZZER_EVENT_PRESS,         // [1] press_id
+    BUZZER_EVENT_RELEASE,       // [1] press_id
+    BUZZER_EVENT_BATTERY,       // [1] voltage in 20 mV steps
+    BUZZER_EVENT_TYPES
+};
+
+// Decoded buzzer event, timestamped by the RX task.
+struct BuzzerFrame {
+    uint16_t buzzer_id;
+    BuzzerFrameKind kind;
+    uint8_t press_id;       // press_id, or sync/ping seq for BUZZER_FRAME_SYNC_REPLY/ECHO
+    uint32_t press_millis;  // ms since lit, buzzer us for timed frames, mV for battery
+    int64_t rx_time_us;     // esp_timer_get_time() when the frame was received
+};
+
+// Decode one CAN frame into up to BUZZER_FRAME_MAX_EVENTS events, reading the payload in place.
+// Returns the number of events, 0 for frames that are not buzzer frames or are malformed.
+uint8_t buzzer_frame_decode(uint32_t id, const uint8_t* data, uint8_t len, int64_t rx_time_us, BuzzerFrame* frames);
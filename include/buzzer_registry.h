@@ -0,0 +1,71 @@
+#pragma once
+#include <stdint.h>
+#include "press_window.h"
+
+#define BUZZER_REGISTRY_CAPACITY    (128)   // buzzers on one bus
+#define BUZZER_ID_SPACE             (2048)  // 11-bit standard CAN identifiers
+#define BUZZER_NO_SLOT              (0xff)
+#define BUZZER_NO_PLAYER            (0xff)
+
+class BuzzerButton {
+public:
+    uint16_t buzzer_id;
+    PressWindow presses; // press_id sequence, restarts at 0 with every "all off"
+    int64_t last_press_online; // time_us() of the last frame this round, 0 before the first
+    int64_t last_seen; // time_us() of the last frame, kept across rounds
+    bool used_in_game;
+    bool pressed;
+    bool waiting_for_press;
+    bool bus_offline;
+    int64_t press_time_us; // Reaction time in microseconds on the display timebase
+    uint8_t player; // race mode owner, BUZZER_NO_PLAYER if none
+    uint16_t battery_mv; // 0 if never reported
+    BuzzerButton(uint16_t id = 0, bool used = false) : buzzer_id(id), last_press_online(0), last_seen(0), used_in_game(used), pressed(false), waiting_for_press(false), bus_offline(true), press_time_us(0), player(BUZZER_NO_PLAYER), battery_mv(0) {
+        //
+    }
+
+    void clear() {
+        pressed = false;
+        waiting_for_press = false;
+        press_time_us = 0;
+        presses.reset();
+        last_press_online = 0;
+    }
+};
+
+// Fixed-capacity buzzer table with a direct-indexed 11-bit CAN identifier lookup.
+// slot_of() is a single table load, so frame dispatch does not depend on the number of buzzers.
+class BuzzerRegistry {
+public:
+    BuzzerRegistry();
+
+    // Register a buzzer. Returns its slot, or BUZZER_NO_SLOT if the id is invalid,
+    // already registered or the registry is full.
+    uint8_t add(uint16_t id, bool used);
+
+    // Remove a slot; the slots above it move down by one.
+    void remove(uint8_t slot);
+
+    uint8_t slot_of(uint16_t id) const {
+        return id < BUZZER_ID_SPACE ? index[id] : BUZZER_NO_SLOT;
+    }
+
+    BuzzerButton* find(uint16_t id) {
+        uint8_t slot = slot_of(id);
+        return slot == BUZZER_NO_SLOT ? nullptr : &slots[slot];
+    }
+
+    uint16_t size() const { return count; }
+    BuzzerButton& operator[](uint16_t slot) { return slots[slot]; }
+    const BuzzerButton& operator[](uint16_t slot) const { return slots[slot]; }
+
+    BuzzerButton* begin() { return slots; }
+    BuzzerButton* end() { return slots + count; }
+    const BuzzerButton* begin() const { return slots; }
+    const BuzzerButton* end() const { return slots + count; }
+
+private:
+    BuzzerButton slots[BUZZER_REGISTRY_CAPACITY];
+    uint8_t index[BUZZER_ID_SPACE];
+    uint16_t count;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "can_filter.h"
+#include "bus_health.h"
+
+// CAN controller abstraction between the RX/TX tasks and the bus.
+// The firmware uses the TWAI driver; a SimBus stands in for a wall of virtual buzzers.
+// receive() is called from one task and transmit() from another. The acceptance filter is set
+// up with the bus and does not change while it runs; extended frames are never accepted.
+
+#define CAN_WAIT_FOREVER        (0xffffffff)
+
+struct CanFrame {
+    uint32_t id;        // bit 31 set for an extended identifier
+    uint8_t len;
+    uint8_t data[8];
+    int64_t rx_time_us; // reception time of this frame, set by receive()
+};
+
+class CanBus {
+public:
+    virtual ~CanBus() {}
+
+    // Returns false if the frame was not sent within timeout_ms.
+    virtual bool transmit(const CanFrame& frame, uint32_t timeout_ms) = 0;
+
+    // Wait up to timeout_ms for received frames, return up to `max` of them, each stamped with
+    // its own reception time (time_us()).
+    virtual size_t receive(CanFrame* frames, size_t max, uint32_t timeout_ms) = 0;
+
+    // Controller state and error counters, for the bus health monitor. Must not block on RX.
+    virtual bool status(CanStatus& status) = 0;
+    // Start bus-off recovery; the controller ends up stopped.
+    virtual void recover() = 0;
+    // Start a stopped controller.
+    virtual void start() = 0;
+};
@@ -0,0 +1,49 @@
+#pragma once
+#include <stdint.h>
+#include "buzzer_registry.h"
+
+// Acceptance filter for 11-bit identifiers.
+// CanAcceptance is the exact set of identifiers the display wants. can_filter_compute() covers
+// it with one or two code/mask pairs, as the TWAI controller matches them in single or dual
+// filter mode. The cover is usually wider than the set, so received frames are checked again
+// in software with accepts().
+
+struct CanFilterRange {
+    uint16_t code;
+    uint16_t mask;      // bit set: don't care
+};
+
+struct CanFilter {
+    bool dual;
+    CanFilterRange ranges[2];   // ranges[1] only in dual mode
+    uint16_t accepted;          // identifiers passing the filter
+    uint16_t wanted;            // identifiers in the acceptance set
+};
+
+class CanAcceptance {
+public:
+    CanAcceptance() { clear(); }
+
+    void clear();
+    void add(uint16_t id);
+    // Status, sync reply, timed press, event and latency echo identifiers of one buzzer.
+    void add_buzzer(uint16_t buzzer_id);
+    // Everything a display receives: the identifiers of every buzzer of its wall, registered or
+    // not, and the tournament frames. Fixed for the wall, so the filter never has to change. A wall
+    // below id 128 in an aligned power-of-two block gets the tightest hardware filter.
+    void add_display(uint8_t wall_first, uint8_t wall_last);
+
+    bool accepts(uint16_t id) const {
+        return id < BUZZER_ID_SPACE && (bits[id >> 5] >> (id & 31)) & 1;
+    }
+    uint16_t size() const { return count; }
+
+private:
+    uint32_t bits[BUZZER_ID_SPACE / 32];
+    uint16_t count;
+};
+
+// An empty set accepts every identifier, so nothing is hidden before the buzzers are known.
+CanFilter can_filter_compute(const CanAcceptance& acceptance);
+
+bool can_filter_matches(const CanFilter& filter, uint16_t id);
@@ -0,0 +1,46 @@
+#pragma once
+#include <stdint.h>
+
+// Buzzer-to-display clock mapping.
+// The display broadcasts TIME_SYNC_ID frames; a sync-capable buzzer answers each one with its
+// own 32-bit microsecond clock at reception. ClockSync fits display = offset + rate * buzzer
+// by least squares over the most recent pairs, so per-buzzer offset and drift cancel out and
+// presses from different buzzers can be ranked on the display timebase.
+
+#define TIME_SYNC_ID            (0x7fe) // display -> wall: [0] seq, [1..2] wall range, [4..7] display us (low 32 bits)
+#define TIME_SYNC_REPLY_ID      (0x200) // | buzzer id: [0] seq, [4..7] buzzer us at sync reception
+#define TIME_SYNC_PRESS_ID      (0x300) // | buzzer id: [0] press_id, [4..7] buzzer us at press
+#define TIME_SYNC_PERIOD_MS     (500)
+#define CLOCK_SYNC_PAIRS        (8)
+#define CLOCK_SYNC_MIN_PAIRS    (3)
+
+class ClockSync {
+public:
+    ClockSync() { reset(); }
+
+    void reset();
+
+    // Add one (buzzer clock, display clock) observation.
+    void add_pair(uint32_t buzzer_us, int64_t display_us);
+
+    bool valid() const { return count >= CLOCK_SYNC_MIN_PAIRS; }
+
+    // Map a buzzer timestamp to the display timebase. Only meaningful when valid().
+    int64_t to_display_us(uint32_t buzzer_us) const;
+
+    // Estimated buzzer clock error in parts per million (positive: buzzer runs slow).
+    int32_t drift_ppm() const { return (int32_t)((rate - 1.0) * 1e6); }
+
+private:
+    int64_t unwrap(uint32_t buzzer_us) const;
+    void fit();
+
+    int64_t xs[CLOCK_SYNC_PAIRS];   // unwrapped buzzer clock
+    int64_t ys[CLOCK_SYNC_PAIRS];   // display clock
+    uint8_t count;
+    uint8_t next;
+    int64_t last_x;
+    int64_t x0;                     // fit origin
+    int64_t y0;
+    double rate;
+};
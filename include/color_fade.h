@@ -0,0 +1,49 @@
+#pragma once
+#include <lvgl.h>
+
+// Colour fades of LVGL objects, run by lv_anim in the LVGL task.
+// A fade goes from one colour to another and back, once per period, through a gradient of
+// COLOR_FADE_STEPS colours in display format (RGB565) computed when it is added, so a step is a
+// table load. lv_anim steps at most once per display refresh period, and a step that lands on
+// the colour already set leaves the object alone. The game only starts and stops fades by name.
+// Every call needs the LVGL lock.
+
+#define COLOR_FADE_MAX      (4)
+#define COLOR_FADE_STEPS    (256)   // there and back, one lv_anim value each
+
+enum ColorFadeTarget {
+    COLOR_FADE_BG,      // background colour of the main part
+    COLOR_FADE_7SEG,    // segment colour of an lv_7seg_display
+};
+
+class ColorFades {
+public:
+    ColorFades() : count(0) {}
+
+    // Register fade `name`, from `from` to `to` (0xRRGGBB) and back in `period_ms`.
+    bool add(const char *name, lv_obj_t *obj, ColorFadeTarget target, uint32_t from, uint32_t to,
+             uint32_t period_ms);
+    // Restart at `from`. False if there is no such fade.
+    bool start(const char *name);
+    // The object keeps the colour of the last step.
+    void stop(const char *name);
+    bool running(const char *name) const;
+
+private:
+    struct Fade {
+        const char *name;
+        lv_obj_t *obj;
+        ColorFadeTarget target;
+        uint32_t period_ms;
+        lv_color_t applied;
+        bool running;
+        lv_color_t lut[COLOR_FADE_STEPS];
+    };
+
+    Fade *find(const char *name);
+    const Fade *find(const char *name) const;
+    static void step(void *var, int32_t value);
+
+    Fade fades[COLOR_FADE_MAX];
+    uint8_t count;
+};
@@ -0,0 +1,272 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "buzzer_registry.h"
+#include "tx_scheduler.h"
+#include "clock_sync.h"
+#include "race_board.h"
+#include "buzzer_frame.h"
+#include "game_mode.h"
+#include "time_service.h"
+#include "start_delay.h"
+#include "reaction_stats.h"
+#include "game_snapshot.h"
+#include "latency_table.h"
+
+// Event-driven buzzer game engine.
+// Plain C++ without Arduino, FreeRTOS or LVGL dependencies, so the same state machine
+// builds on the host. The firmware feeds it buzzer frames and events (RX wake-up, touch
+// commands, timer expiry) and blocks until the next event or next_deadline(); all side
+// effects go through GameHooks. Time is the 64-bit microsecond clock of time_service.h,
+// and reaction times stay in microseconds from the frame to the display.
+
+enum GameState {
+    GAME_IDLE,
+    GAME_READYSETGO,
+    GAME_PREPARING,
+    GAME_STARTING,
+    GAME_WAIT_FOR_BUZZER1,
+    GAME_WAIT_FOR_BUZZER2,
+    GAME_ROUND_COMPLETE,
+    GAME_FINISHED,
+    GAME_END
+};
+
+enum GameEventType : uint8_t {
+    GAME_EVENT_RX,          // buzzer frames are waiting in the RX ring
+    GAME_EVENT_COMMAND,
+    GAME_EVENT_TIMER
+};
+
+enum GameCommand : uint8_t {
+    GAME_CMD_START,     // arg = game variant (1..3), a row of GAME_MODES
+    GAME_CMD_CANCEL,
+    GAME_CMD_OK,
+    GAME_CMD_TEST,      // simulate a press of the lit buzzer
+    GAME_CMD_START_RACE,        // arg = players, each gets its own random lit buzzer
+    GAME_CMD_START_RACE_SHARED, // arg = players, the same wall position lights up for everyone
+    GAME_CMD_RESUME,    // continue the game of load_snapshot()
+    GAME_CMD_CALIBRATE  // measure the latency of every online buzzer, while idle
+};
+
+struct GameEvent {
+    GameEventType type;
+    uint8_t command;    // GameCommand, for GAME_EVENT_COMMAND
+    uint8_t arg;
+};
+
+// Side effects of the engine. The firmware implements these with LVGL and TWAI,
+// a host build can record them.
+class GameHooks {
+public:
+    virtual ~GameHooks() {}
+    virtual void send_can(uint32_t id, const uint8_t* data, uint8_t len, TxPriority priority) = 0;
+    virtual uint32_t random_range(uint32_t lo, uint32_t hi) = 0;
+    virtual int64_t now_us() = 0;
+    virtual void show_start_screen(const char* message) = 0;
+    virtual void show_game_screen() = 0;
+    virtual void show_message(const char* message) = 0;
+    virtual void show_countdown(char digit) = 0;
+    virtual void show_time(int64_t time_us, uint32_t color) = 0;
+    virtual void show_running(int64_t time_us, int64_t now_us) = 0;
+    virtual void show_round(uint8_t round) = 0;
+    virtual void show_finished(int64_t total_us) = 0;
+    virtual void buzzer_changed(uint16_t index) = 0;
+    virtual void buzzer_set_changed(uint16_t count) = 0;   // buzzers were discovered or retired
+    virtual void show_race(const RaceBoard& board, bool finished) = 0;
+    virtual void state_changed(GameState state, int64_t total_us) = 0;
+    virtual void save_snapshot(const GameSnapshot& snapshot) = 0;  // after every state transition
+    virtual void latency_calibrated(const LatencyTable& table) = 0;
+};
+
+#define GAME_KEEPALIVE_PERIOD_MS    (1000)  // "light on"/"all off" repeat period
+#define GAME_OFFLINE_TIMEOUT_MS     (1000)  // buzzer is offline after this silence
+#define GAME_DISPLAY_PERIOD_MS      (33)    // running timer repaint period
+#define GAME_COUNTDOWN_STEP_MS      (1000)
+#define GAME_RACE_TIMEOUT_MS        (10000) // race round ends for players who did not press
+#define GAME_RETIRE_MS              (30000) // offline buzzers are removed while idle
+#define GAME_HELD                   (INT64_MAX) // state_deadline of a held round
+
+// Discovery: buzzer n answers a DISCOVERY_ID broadcast with its status frame n reply slots
+// later, so even 255 buzzers answer within one bounded, collision-free window. A buzzer that
+// is plugged in later is registered from its first status frame.
+#define DISCOVERY_ID                (0x7fd) // display -> wall: [0] reply slot in 100 us units, [1] payload version,
+                                            // [2..3] wall range
+#define DISCOVERY_SLOT_100US        (6)     // one 8-byte frame at 250 kbit/s, with margin
+#define DISCOVERY_REPEAT            (3)     // enumerations at boot, to cover lost replies
+#define DISCOVERY_REPEAT_MS         (250)   // longer than the 255 slot window
+#define DISCOVERY_PERIOD_MS         (5000)  // re-enumeration while idle
+
+// Walls: displays that share one bus each play with their own range of buzzer ids. The
+// broadcasts (all off, time sync, discovery) carry the range as its first and last id, so they
+// reach only that wall's buzzers; a buzzer outside the range ignores the frame. A last id of 0,
+// or a frame too short for the range, addresses every buzzer.
+#define WALL_FIRST_ID               (1)
+#define WALL_LAST_ID                (0xff)  // status frames carry an 8-bit buzzer id
+
+// Whether buzzer `id` is addressed by a broadcast with the wall range at data[at], data[at + 1].
+static inline bool wall_addressed(const uint8_t* data, uint8_t len, uint8_t at, uint16_t id)
+{
+    if (len < at + 2 || data[at + 1] == 0) {
+        return true;
+    }
+    return id >= data[at] && id <= data[at + 1];
+}
+
+class GameEngine {
+public:
+    explicit GameEngine(GameHooks& hooks);
+
+    // Returns the registry slot, or BUZZER_NO_SLOT.
+    uint8_t add_buzzer(uint16_t id, bool used);
+
+    // Whether buzzer `id` takes part in games. A discovered buzzer registers with this setting,
+    // so positions that must never light stay out across discovery and hot-plug. All are used
+    // by default. Changes an already registered buzzer too, effective from the next round.
+    void set_used(uint16_t id, bool used);
+    bool used(uint16_t id) const { return id >= BUZZER_ID_SPACE || !(unused_ids[id / 32] & (1u << (id % 32))); }
+
+    // The buzzer ids of this display's wall, WALL_FIRST_ID..WALL_LAST_ID by default. Frames of
+    // other buzzers are ignored. Set before the first frame.
+    void set_wall(uint8_t first, uint8_t last) { wall_first = first; wall_last = last; }
+    bool owns(uint16_t id) const { return id >= wall_first && id <= wall_last; }
+    uint8_t wall_first_id() const { return wall_first; }
+    uint8_t wall_last_id() const { return wall_last; }
+
+    // Apply one received buzzer frame. The state machine advances on the next handle().
+    // A status frame from an unknown buzzer registers it. Returns false if the frame was ignored.
+    bool handle_frame(const BuzzerFrame& frame);
+
+    // Process one event and every deadline that is due at `now` (time_us()).
+    void handle(const GameEvent& event, int64_t now);
+
+    // Absolute time (time_us()) of the next deadline. The caller may sleep until then
+    // unless an event arrives first.
+    int64_t next_deadline() const { return next_deadline_us; }
+
+    GameState state() const { return game_state; }
+    uint8_t variant() const { return game_variant; }
+    const GameMode& mode() const { return game_mode(game_variant); }
+    uint8_t round() const { return current_round; }
+    int64_t total() const { return total_us; }
+    // At GAME_END: every round was played. False when the game stopped early for lack of buzzers,
+    // its total is no result then.
+    bool complete() const { return current_round > mode().rounds; }
+    uint8_t penalties() const { return game_penalties; }     // wrong presses this game, outside race mode
+    const BuzzerRegistry& buttons() const { return buzzers; }
+    const ClockSync& clock(uint8_t slot) const { return clocks[slot]; }
+    bool racing() const { return race_mode; }
+    const RaceBoard& race() const { return race_board; }
+    // Reaction statistics of the current game; player 0 outside race mode.
+    const ReactionStats& stats(uint8_t player) const { return reaction_stats[player]; }
+
+    // Offer the game of a snapshot from before a reset; GAME_CMD_RESUME continues it with the
+    // round that was running. Returns false if the snapshot holds no game to continue.
+    bool load_snapshot(const GameSnapshot& snapshot);
+    bool resumable() const;
+
+    // Press compensation per buzzer id, see latency_table.h. GAME_CMD_CALIBRATE measures it.
+    const LatencyTable& latency() const { return latency_table; }
+    void set_latency(const LatencyTable& table) { latency_table = table; }
+    void set_compensation(uint16_t buzzer_id, uint16_t compensation_us) { latency_table.set_compensation(buzzer_id, compensation_us); }
+    bool calibrating() const { return calibration; }
+
+    // Tournament play: every round waits before the light until release() gives its lit time,
+    // instead of drawing a start delay. Takes effect with the next round.
+    void hold_rounds(bool hold) { round_hold = hold; }
+    bool holding() const { return round_hold; }
+    bool held() const { return game_state == GAME_WAIT_FOR_BUZZER1 && state_deadline == GAME_HELD; }
+    // Light the held round at `lit_us` (time_us(), may be in the past). Returns false if not held.
+    bool release(int64_t lit_us);
+
+private:
+    void on_command(const GameEvent& event, int64_t now);
+    void on_timers(int64_t now);
+    void advance(int64_t now);
+    void enter(GameState state, int64_t now);
+    void update_deadline();
+    void send_all_off(TxPriority priority);
+    void send_light_on(TxPriority priority);
+    void send_time_sync();
+    void send_discovery();
+    void retire_buzzers(int64_t now);
+    void register_press(uint8_t slot, uint8_t press_id, int64_t press_us);
+    uint16_t select_buzzer(const uint8_t* available, uint16_t count);
+    void race_setup(uint8_t players);
+    bool race_start_round();
+    void race_press(uint8_t slot, int64_t reaction_us);
+    void race_light_on(TxPriority priority);
+    void set_offline(uint16_t index, bool offline);
+    void add_reaction(uint8_t player, uint16_t buzzer_id, int64_t reaction_us);
+    void print_stats();
+    void save_checkpoint();
+    bool resume(int64_t now);
+    void calibrate_step(int64_t now);
+    void calibrate_next(int64_t now);
+
+    GameHooks& hooks;
+    BuzzerRegistry buzzers;
+    uint32_t unused_ids[BUZZER_ID_SPACE / 32];      // set_used(id, false)
+    uint8_t wall_first;
+    uint8_t wall_last;
+    ClockSync clocks[BUZZER_REGISTRY_CAPACITY];   // by registry slot
+
+    GameState game_state;
+    uint8_t game_variant;
+    uint8_t current_round;
+    uint8_t countdown_step;
+    uint16_t waitforbuzzer_index;
+    uint16_t waitforbuzzer_id;
+    uint16_t previous_index;    // last round's buzzer, for GAME_SELECT_NO_REPEAT
+    uint32_t deck[BUZZER_REGISTRY_CAPACITY / 32];  // slots already lit, for GAME_SELECT_DECK
+    uint8_t round_penalties;
+    uint8_t game_penalties;
+    bool round_hold;
+    StartDelay start_delay;
+    ReactionStats reaction_stats[RACE_MAX_PLAYERS];
+    int64_t total_us;
+    int64_t buzzer_time_us;     // reaction reported in the lit buzzer's status frame, -1 if none
+    int64_t local_time;         // `now` when the light went on
+    int64_t state_deadline;
+    int64_t next_can_packet;
+    int64_t next_display;
+    int64_t next_deadline_us;
+    int64_t next_sync;
+    int64_t next_discovery;
+    uint8_t discovery_count;
+    int64_t lit_us;             // hooks.now_us() when the light-on was queued
+    uint8_t sync_seq;
+    int64_t sync_sent_us[4];    // by seq % 4
+
+    // latency calibration, runs while idle
+    LatencyTable latency_table;
+    LatencyProbe probe;
+    bool calibration;
+    uint16_t calibrate_id;      // buzzer being pinged
+    uint8_t ping_seq;
+    uint8_t pings_sent;
+    int64_t ping_sent_us;       // -1 once its echo was counted
+    int64_t next_ping;
+
+    // race mode: players own consecutive groups of the used buzzers
+    bool race_mode;
+    bool race_shared;
+    RaceBoard race_board;
+    uint8_t race_group;                             // buzzers per player
+    uint8_t race_slots[BUZZER_REGISTRY_CAPACITY];   // used buzzers, grouped by player
+    uint8_t race_targets[RACE_MAX_PLAYERS];         // lit slot per player
+
+    GameSnapshot checkpoint;    // as of the start of the current round
+};
+
+// Wrap-safe "a is at or after b" for 32-bit millisecond timestamps.
+static inline bool game_time_reached(uint32_t now, uint32_t deadline)
+{
+    return (int32_t)(now - deadline) >= 0;
+}
+
+// Same for time_us(), which does not wrap.
+static inline bool game_time_reached(int64_t now, int64_t deadline)
+{
+    return now >= deadline;
+}
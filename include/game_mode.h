@@ -0,0 +1,83 @@
+#pragma once
+#include <stdint.h>
+#include "race_board.h"
+
+// Game modes: one row per difficulty with its rounds, start delay, penalty and buzzer selection.
+// The table is constexpr and the engine reads the row picked at game start, so the rules are
+// plain data and switches; there is no per-mode class and no virtual call while a game runs.
+// GAME_CMD_START picks a row by its variant (1..3); the race commands use GAME_MODE_RACE.
+
+enum GameDelay : uint8_t {
+    GAME_DELAY_UNIFORM,         // every delay in [min, max] is equally likely
+    GAME_DELAY_EXPONENTIAL,     // min plus an exponential tail, truncated at max: hard to anticipate
+    GAME_DELAY_BALANCED         // each quarter of the window once per four rounds, shuffled
+};
+
+enum GamePenalty : uint8_t {
+    GAME_PENALTY_NONE,          // wrong presses are ignored
+    GAME_PENALTY_FIXED,         // penalty_ms per wrong press
+    GAME_PENALTY_ESCALATING     // penalty_ms times the number of wrong presses in this round
+};
+
+enum GameSelection : uint8_t {
+    GAME_SELECT_RANDOM,         // any used buzzer, repeats allowed
+    GAME_SELECT_NO_REPEAT,      // any used buzzer except the previous round's
+    GAME_SELECT_DECK            // every used buzzer once before any repeats
+};
+
+struct GameMode {
+    const char* name;
+    uint8_t rounds;
+    uint16_t delay_min_ms;
+    uint16_t delay_max_ms;
+    GameDelay delay;
+    GamePenalty penalty;
+    uint16_t penalty_ms;
+    GameSelection selection;    // race mode: only GAME_SELECT_RANDOM, the groups pick their own
+};
+
+#define GAME_MODE_RACE      (0)
+
+static constexpr GameMode GAME_MODES[] = {
+    //  name        rounds  delay ms      delay distribution      penalty                   ms    selection
+    { "Rennen",     5,      1500, 3000,   GAME_DELAY_UNIFORM,     GAME_PENALTY_FIXED,       1000, GAME_SELECT_RANDOM },
+    { "Leicht",     5,      1500, 3000,   GAME_DELAY_UNIFORM,     GAME_PENALTY_FIXED,       1000, GAME_SELECT_RANDOM },
+    { "Mittel",     10,     1000, 4000,   GAME_DELAY_BALANCED,    GAME_PENALTY_FIXED,       1000, GAME_SELECT_NO_REPEAT },
+    { "Schwer",     15,     800,  5000,   GAME_DELAY_EXPONENTIAL, GAME_PENALTY_ESCALATING,  1000, GAME_SELECT_DECK },
+};
+
+#define GAME_MODE_COUNT     (sizeof(GAME_MODES) / sizeof(GAME_MODES[0]))
+
+static constexpr bool game_mode_valid(const GameMode& mode)
+{
+    return mode.rounds > 0 && mode.rounds <= RACE_MAX_ROUNDS && mode.rounds < 0xff &&
+           mode.delay_min_ms <= mode.delay_max_ms;
+}
+
+static constexpr bool game_modes_valid(uint8_t i = 0)
+{
+    return i >= GAME_MODE_COUNT || (game_mode_valid(GAME_MODES[i]) && game_modes_valid(i + 1));
+}
+
+static_assert(game_modes_valid(), "invalid row in GAME_MODES");
+static_assert(GAME_MODES[GAME_MODE_RACE].selection == GAME_SELECT_RANDOM, "race mode selects per player group");
+
+// Unknown variants fall back to the first difficulty.
+static constexpr const GameMode& game_mode(uint8_t variant)
+{
+    return GAME_MODES[variant < GAME_MODE_COUNT ? variant : 1];
+}
+
+// Penalty for the `nth` (1-based) wrong press of a round.
+static inline uint32_t game_mode_penalty(const GameMode& mode, uint8_t nth)
+{
+    switch (mode.penalty) {
+        case GAME_PENALTY_NONE:
+            return 0;
+        case GAME_PENALTY_ESCALATING:
+            return (uint32_t)mode.penalty_ms * nth;
+        case GAME_PENALTY_FIXED:
+        default:
+            return mode.penalty_ms;
+    }
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "buzzer_registry.h"
+#include "race_board.h"
+#include "reaction_stats.h"
+#include "start_delay.h"
+
+// Crash-resume checkpoint of a running game.
+// The engine captures everything a game needs to continue at the start of each round and hands
+// the snapshot to GameHooks::save_snapshot() on every state transition; the firmware keeps it in
+// RTC memory, which survives a watchdog reset or panic. A round that was running when the display
+// reset is replayed from its start, so the checkpoint never holds half a round.
+
+#define GAME_SNAPSHOT_MAGIC     (0x50534e47)    // "GNSP"
+#define GAME_SNAPSHOT_VERSION   (1)
+#define GAME_SNAPSHOT_RTC_MAX   (4096)  // half of the ESP32-S3's 8 KB RTC slow memory; the rest
+                                        // is the IDF's RTC data and the ULP's
+
+struct GameSnapshotBuzzer {
+    uint16_t buzzer_id;
+    uint8_t used_in_game;
+    uint8_t player;         // race mode owner, BUZZER_NO_PLAYER if none
+};
+
+struct GameSnapshot {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;          // sizeof(GameSnapshot), catches a layout change without a version bump
+    uint8_t state;          // GameState of the last transition
+    uint8_t variant;
+    uint8_t round;          // rounds completed at the checkpoint
+    uint8_t penalties;
+    uint8_t race_players;   // 0 outside race mode
+    uint8_t race_shared;
+    uint8_t race_group;
+    uint8_t buzzer_count;
+    uint16_t previous_index;    // index into buzzers[], 0xffff if none
+    int64_t total_us;
+    uint32_t deck[BUZZER_REGISTRY_CAPACITY / 32];   // by index into buzzers[]
+    StartDelayState delay;
+    RaceBoard race;
+    ReactionStats stats[RACE_MAX_PLAYERS];
+    GameSnapshotBuzzer buzzers[BUZZER_REGISTRY_CAPACITY];  // registry order at the checkpoint
+    uint32_t crc;           // game_snapshot_crc(), last
+};
+
+static_assert(sizeof(GameSnapshot) <= GAME_SNAPSHOT_RTC_MAX, "GameSnapshot must fit its RTC memory");
+
+// CRC-32 (IEEE) over the snapshot up to its crc field.
+uint32_t game_snapshot_crc(const GameSnapshot& snapshot);
+
+// Set magic, version, size and crc.
+void game_snapshot_seal(GameSnapshot& snapshot);
+
+// Intact and written by this firmware layout. Says nothing about whether a game can resume.
+bool game_snapshot_valid(const GameSnapshot& snapshot);
@@ -0,0 +1,79 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+// Per-buzzer latency compensation.
+// A calibration pings one buzzer at a time and times its echo on the display clock. Buzzers at
+// the far end of a long wall, and older firmware with a slow main loop, answer later; half of a
+// buzzer's round trip above the fastest buzzer's is its compensation, which the engine subtracts
+// from every press of that buzzer before it is scored or ranked. Relative to the fastest buzzer,
+// so the display's own transmit queueing cancels out. The table is indexed by buzzer id: one
+// load in the press path. The firmware keeps it in a file, rewritten whole after a calibration.
+
+#define LATENCY_PING_ID         (0x7fc) // display -> all: [0] buzzer id, [1] seq
+#define LATENCY_ECHO_ID         (0x600) // | buzzer id: [0] seq, sent as soon as the ping is seen
+#define LATENCY_IDS             (256)   // buzzer ids are 8 bits
+#define LATENCY_PINGS           (16)    // per buzzer and calibration
+#define LATENCY_MIN_ECHOES      (8)     // with fewer, the buzzer is not compensated
+#define LATENCY_PING_GAP_MS     (10)    // also how long the last echo is waited for
+#define LATENCY_MAX_RTT_US      (20000) // slower echoes were queued behind something else
+#define LATENCY_TABLE_MAGIC     (0x4c544e43)    // "CNTL"
+#define LATENCY_TABLE_VERSION   (1)
+
+struct LatencyEntry {
+    uint16_t rtt_us;            // median round trip, 0 if never calibrated
+    uint16_t jitter_us;         // standard deviation of the round trips
+    uint16_t compensation_us;   // subtracted from the buzzer's presses
+};
+
+// Round trips of one buzzer during a calibration.
+class LatencyProbe {
+public:
+    LatencyProbe() { reset(); }
+
+    void reset() { count = 0; }
+    void add(uint32_t rtt_us);
+
+    uint8_t size() const { return count; }
+    uint32_t median_us() const;
+    uint32_t jitter_us() const;
+
+private:
+    uint32_t samples[LATENCY_PINGS];
+    uint8_t count;
+};
+
+class LatencyTable {
+public:
+    LatencyTable() { clear(); }
+
+    void clear();
+
+    int64_t compensation_us(uint16_t buzzer_id) const {
+        return buzzer_id < LATENCY_IDS ? entries[buzzer_id].compensation_us : 0;
+    }
+    const LatencyEntry& operator[](uint16_t buzzer_id) const { return entries[buzzer_id & (LATENCY_IDS - 1)]; }
+
+    // Forget the round trips before a calibration, so buzzers that are gone or do not answer take
+    // no part in it. The compensations stay in use until normalize().
+    void clear_measured();
+    void set_measured(uint16_t buzzer_id, uint32_t rtt_us, uint32_t jitter_us);
+    // Without a measurement, e.g. replaying a session that recorded the compensation in use.
+    void set_compensation(uint16_t buzzer_id, uint16_t compensation_us);
+    // Derive every compensation from the round trips measured since clear_measured(), after a
+    // calibration; a buzzer without one gets none.
+    void normalize();
+
+    uint16_t calibrated() const;    // buzzers with a measurement
+
+    // Set magic, version and size before the table is written out.
+    void seal();
+    // Written by this firmware layout, checked after reading the file.
+    bool valid() const;
+
+private:
+    uint32_t magic;
+    uint16_t version;
+    uint16_t size;
+    LatencyEntry entries[LATENCY_IDS];
+};
@@ -1,13 +1,76 @@
 #pragma once
 #include <lvgl.h>
 
-// Simple 7-segment display widget for LVGL v8.
-// Creates a container with 7 segment rectangles + a dot. No custom LVGL class used — composed with children.
+// Simple 7-segment display widgets for LVGL v8.
+// lv_7seg is one digit, lv_7seg_display a row of digits in one object that formats a number
+// itself. The draw callbacks paint the lit segments from packed segment masks, and a change
+// invalidates only the segments that turned on or off. Setting the digit, dot or colour a widget
+// already shows does nothing.
 
-// Create a 7-segment widget. The returned object is the parent container.
-// `w` and `h` are the container width/height in pixels (recommended: w ~ 0.5*h).
+#define LV_7SEG_DOT                     (0x80)  // segment mask bit of the dot, bits 0..6 are segments a..g
+#define LV_7SEG_BCD_DIGITS              (10)    // decimal digits of a uint32_t
+#define LV_7SEG_DISPLAY_MAX_DIGITS      (8)
+
+// lv_7seg_display_set_value() format flags
+#define LV_7SEG_BLANK_ZEROS             (0x01)  // leading zeros left of the units digit are dark
+#define LV_7SEG_AUTO_RANGE              (0x02)  // drop fraction digits, truncating, when the value does not fit
+
+// lv_7seg_display_set_style() flags. Any of them switches to hexagonal segments drawn from A8
+// masks, rasterized once per digit size and kept in a cache of LV_7SEG_MASK_CACHE_SIZE sizes.
+#define LV_7SEG_STYLE_SLANTED           (0x01)  // segments lean right
+#define LV_7SEG_STYLE_GHOST             (0x02)  // unlit segments faintly visible
+#define LV_7SEG_STYLE_GLOW              (0x04)  // soft halo around lit segments
+#ifndef LV_7SEG_MASK_CACHE_SIZE
+#define LV_7SEG_MASK_CACHE_SIZE         (2)
+#endif
+
+typedef struct {
+    lv_obj_t obj;
+    uint8_t segments;   // lit segments, bit 0 = a ... bit 6 = g, LV_7SEG_DOT
+    lv_color_t color;
+} lv_7seg_t;
+
+typedef struct {
+    lv_obj_t obj;
+    uint8_t digits;
+    lv_coord_t digit_w;
+    lv_coord_t pitch;   // from the left edge of one digit to the next
+    uint8_t style;      // LV_7SEG_STYLE_*, 0: rounded rectangles
+    uint8_t segments[LV_7SEG_DISPLAY_MAX_DIGITS];   // left to right
+    lv_color_t color;
+} lv_7seg_display_t;
+
+extern const lv_obj_class_t lv_7seg_class;
+extern const lv_obj_class_t lv_7seg_display_class;
+
+// Create a 7-segment widget.
+// `w` and `h` are the widget width/height in pixels (recommended: w ~ 0.5*h).
 lv_obj_t * lv_7seg_create(lv_obj_t * parent, lv_coord_t w, lv_coord_t h);
 
-// Set the displayed digit (0-9). If out of range, the display is cleared.
+// Set the displayed digit (0-9 or '0'-'9', ' ' and '-'). Anything else clears the display.
 void lv_7seg_set_digit(lv_obj_t * obj, const char digit, const bool dot);
+// Light exactly the segments of `mask`.
+void lv_7seg_set_segments(lv_obj_t * obj, uint8_t mask);
 void lv_7seg_set_color(lv_obj_t * obj, lv_color_t color);
+
+// Pixels invalidated by all 7-segment widgets so far, wrapping. Call with the LVGL lock held.
+uint32_t lv_7seg_invalidated_px(void);
+
+// Decimal digits of `value` into `digits[LV_7SEG_BCD_DIGITS]`, least significant first, without a
+// division. Returns the number of significant digits, at least 1.
+uint8_t lv_7seg_bcd(uint32_t value, uint8_t * digits);
+
+// Create a row of `digits` digits of `digit_w` x `h` pixels, `pitch` pixels apart.
+lv_obj_t * lv_7seg_display_create(lv_obj_t * parent, uint8_t digits, lv_coord_t digit_w, lv_coord_t h,
+                                  lv_coord_t pitch);
+// Show the fixed-point number `value` / 10^`decimals`, right aligned, with the dot after the units
+// digit. Shows dashes when it does not fit, after auto-ranging if enabled.
+void lv_7seg_display_set_value(lv_obj_t * obj, uint32_t value, uint8_t decimals, uint8_t format);
+// Set digit `index`, counted from the left, like lv_7seg_set_digit().
+void lv_7seg_display_set_digit(lv_obj_t * obj, uint8_t index, const char digit, const bool dot);
+// Set every digit to the same.
+void lv_7seg_display_fill(lv_obj_t * obj, const char digit, const bool dot);
+void lv_7seg_display_set_color(lv_obj_t * obj, lv_color_t color);
+// Combination of LV_7SEG_STYLE_* flags. Falls back to rounded rectangles when the masks do not
+// fit into memory.
+void lv_7seg_display_set_style(lv_obj_t * obj, uint8_t style);
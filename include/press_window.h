@@ -0,0 +1,55 @@
+#pragma once
+#include <stdint.h>
+
+// Sliding window over the 8-bit press_id sequence of one buzzer.
+// Remembers which of the last PRESS_WINDOW_SIZE ids were seen, relative to the newest one, so
+// retransmitted and reordered frames are recognised after newer presses and across the 255 -> 0
+// wrap. O(1) per frame: one signed 8-bit difference and a shift of a 32-bit bitmap.
+
+#define PRESS_WINDOW_SIZE   (32)
+
+enum PressOrder : uint8_t {
+    PRESS_NEW,          // newer than every id so far
+    PRESS_LATE,         // older than the newest, not seen before: arrived out of order
+    PRESS_DUPLICATE,    // seen before
+    PRESS_STALE         // too old for the window
+};
+
+class PressWindow {
+public:
+    PressWindow() : duplicates(0), late(0), lost(0) { reset(); }
+
+    // Restart the sequence with `id` as the newest id already seen; the counters keep running.
+    // Buzzers restart at 0, which means "no press yet", whenever they are switched off.
+    void reset(uint8_t id = 0) {
+        head = id;
+        seen = 1;
+    }
+
+    PressOrder classify(uint8_t id) const {
+        int8_t diff = (int8_t)(id - head);
+        if (diff > 0) {
+            return PRESS_NEW;
+        }
+        if (-diff >= PRESS_WINDOW_SIZE) {
+            return PRESS_STALE;
+        }
+        return (seen >> -diff) & 1 ? PRESS_DUPLICATE : PRESS_LATE;
+    }
+
+    // Record `id`. Returns its classification; only PRESS_NEW and PRESS_LATE are presses.
+    PressOrder accept(uint8_t id);
+
+    uint8_t newest() const { return head; }
+    // Ids skipped by PRESS_NEW ids and not (yet) filled in by PRESS_LATE ones.
+    uint16_t gaps() const { return lost; }
+    uint16_t duplicate_count() const { return duplicates; }
+    uint16_t late_count() const { return late; }
+
+private:
+    uint8_t head;       // newest id
+    uint32_t seen;      // bit n: id head - n was seen
+    uint16_t duplicates;
+    uint16_t late;
+    uint16_t lost;
+};
@@ -0,0 +1,56 @@
+#pragma once
+#include <stdint.h>
+
+// Per-player results for the multi-player race mode.
+// Fixed size, no allocation. The leaderboard (best total first) and the round placements are
+// kept sorted by moving single entries as results arrive, never by re-sorting everything.
+
+#define RACE_MAX_PLAYERS    (8)
+#define RACE_MAX_ROUNDS     (16)
+
+struct RacePlayer {
+    int64_t total_us;                       // reaction times plus penalties
+    int64_t round_us;                       // this round's reaction time, -1 while racing
+    uint32_t penalty_us;
+    uint8_t penalties;
+    uint8_t placements[RACE_MAX_ROUNDS];    // 1-based place per round, 0 = did not finish
+};
+
+class RaceBoard {
+public:
+    RaceBoard() { start(0); }
+
+    void start(uint8_t players);
+    void start_round();
+
+    // Record a player's reaction time for the current round. Presses may arrive out of time
+    // order; later finishers are moved down. Returns the placement, or 0 if ignored.
+    uint8_t finish(uint8_t player, int64_t reaction_us);
+
+    void penalty(uint8_t player, uint32_t penalty_us);
+
+    // Give every player still racing `timeout_us` and no placement.
+    void close_round(int64_t timeout_us);
+
+    bool round_complete() const { return finished >= players; }
+    bool racing(uint8_t player) const { return player < players && entries[player].round_us < 0; }
+    // The player finished every round so far; a round closed on the timeout does not count.
+    bool finished_all(uint8_t player) const;
+    uint8_t player_count() const { return players; }
+    uint8_t round() const { return current_round; }
+
+    // Player at leaderboard position `pos` (0 = leader).
+    uint8_t leader(uint8_t pos) const { return order[pos]; }
+    const RacePlayer& player(uint8_t p) const { return entries[p]; }
+
+private:
+    void add_total(uint8_t player, int64_t us);
+
+    RacePlayer entries[RACE_MAX_PLAYERS];
+    uint8_t order[RACE_MAX_PLAYERS];        // leaderboard, best first
+    uint8_t position[RACE_MAX_PLAYERS];     // inverse of order
+    uint8_t round_order[RACE_MAX_PLAYERS];  // this round's finishers, fastest first
+    uint8_t players;
+    uint8_t finished;
+    uint8_t current_round;                  // 1-based, 0 before the first round
+};
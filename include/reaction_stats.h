@@ -0,0 +1,39 @@
+#pragma once
+#include <stdint.h>
+
+// Running reaction-time statistics for one player.
+// add() is O(1) per press: Welford's update for mean and variance, min/max and a fixed
+// histogram. Presses faster than REACTION_ANTICIPATION_US cannot be a response to the light,
+// so they are flagged and counted, but kept out of the mean and variance.
+
+#define REACTION_ANTICIPATION_US    (100000)    // below the visual reaction floor
+#define REACTION_HIST_BINS          (16)
+#define REACTION_HIST_BIN_US        (50000)     // the last bin takes everything slower
+
+class ReactionStats {
+public:
+    ReactionStats() { reset(); }
+
+    void reset();
+
+    // Returns true if the press was anticipated.
+    bool add(int64_t reaction_us);
+
+    uint16_t count() const { return n; }                // valid reactions
+    uint16_t anticipations() const { return anticipated; }
+    double mean_us() const { return mean; }
+    double variance_us2() const { return n > 1 ? m2 / (n - 1) : 0; }
+    double stddev_us() const;
+    int64_t min_us() const { return fastest; }
+    int64_t max_us() const { return slowest; }
+    uint16_t histogram(uint8_t bin) const { return bins[bin]; }
+
+private:
+    uint16_t n;
+    uint16_t anticipated;
+    double mean;
+    double m2;
+    int64_t fastest;
+    int64_t slowest;
+    uint16_t bins[REACTION_HIST_BINS];
+};
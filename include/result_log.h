@@ -0,0 +1,76 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "result_store.h"
+
+// Results log with checkpoints.
+// Finished games are appended to a log file as before, but every RESULT_CHECKPOINT_RECORDS the
+// whole ResultStore index is written as a checkpoint and a new log is started, so a boot reads one
+// checkpoint and at most RESULT_CHECKPOINT_RECORDS records however many games were ever played,
+// and the files on flash stay bounded. Only the index is kept: the top RESULT_TOP_N per mode,
+// all-time and for each of RESULT_DAYS days, which is all the display shows. That is about 5 KB,
+// some 330 records' worth.
+//
+// Logs alternate between two names by generation; the checkpoint names the generation that
+// continues it. A checkpoint is committed by replacing its file atomically, and only then is the
+// previous log removed and the new one started, so a power loss at any point leaves either the
+// old checkpoint with its complete log or the new one with an empty log, never a record counted
+// twice. The log of earlier firmware (RESULT_LOG_FILE, without a checkpoint: generation 0) is
+// read whole once, then checkpointed.
+
+#define RESULT_CHECKPOINT_FILE      "/results.idx"
+#define RESULT_LOG_FILE             "/results.bin"      // even generations
+#define RESULT_LOG_FILE_ODD         "/results1.bin"     // odd generations
+#define RESULT_CHECKPOINT_RECORDS   (256)               // 4 KB of log
+#define RESULT_CHECKPOINT_MAGIC     (0x58444952)        // "RIDX"
+#define RESULT_LOAD_CHUNK           (32)                // records per read, on the caller's stack
+
+// File access, LittleFS on the target and a RAM emulator in the host tests. Every call either
+// completes or, after a power loss, never happened.
+class ResultFiles {
+public:
+    virtual ~ResultFiles() {}
+    // Up to `len` bytes from `offset`; 0 past the end or if the file does not exist.
+    virtual size_t read(const char* name, size_t offset, void* data, size_t len) = 0;
+    virtual bool append(const char* name, const void* data, size_t len) = 0;
+    // Replace the whole file, atomically.
+    virtual bool replace(const char* name, const void* data, size_t len) = 0;
+    virtual void remove(const char* name) = 0;
+};
+
+struct ResultCheckpoint {
+    uint32_t magic;             // RESULT_CHECKPOINT_MAGIC
+    uint32_t size;              // sizeof(ResultCheckpoint), another layout is not loaded
+    uint32_t generation;        // of the log that continues the checkpoint
+    uint8_t crc;                // result_crc_bytes() of the fields above and the store
+    ResultStore store;
+};
+
+class ResultLog {
+public:
+    explicit ResultLog(ResultFiles& files);
+
+    // Read the checkpoint and the log that continues it, at boot. Removes a log left over from an
+    // interrupted checkpoint and checkpoints a log that is already full. Returns the log records
+    // read, including corrupt ones.
+    uint32_t load();
+
+    // Append a sealed record and index it; checkpoints when the log is full. False if the record
+    // could not be written; it is not indexed then.
+    bool append(const ResultRecord& record);
+
+    // Index of every record written, the same as a ResultStore fed the whole history.
+    const ResultStore& index() const { return saved.store; }
+    uint32_t generation() const { return saved.generation; }
+    uint32_t log_records() const { return tail; }
+    uint32_t checkpoints() const { return written; }
+
+private:
+    bool checkpoint();
+    static const char* log_name(uint32_t generation);
+
+    ResultFiles& files;
+    ResultCheckpoint saved;     // the checkpoint being built: index of the log so far
+    uint32_t tail;              // records in the current log
+    uint32_t written;
+};
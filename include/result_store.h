@@ -0,0 +1,94 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "game_mode.h"
+
+// High scores.
+// Every finished game appends one fixed 16-byte ResultRecord to a log file. ResultStore keeps only
+// an index in RAM: the best RESULT_TOP_N totals per game mode, all-time and for each of the last
+// RESULT_DAYS days. Loading a log is a CRC and one comparison against the current N-th place for
+// almost every record; ResultLog (result_log.h) checkpoints the index so a boot loads a bounded
+// log. The index is plain data and is saved byte for byte.
+
+#define RESULT_TOP_N        (10)
+#define RESULT_DAYS         (7)
+#define RESULT_MARKER       (0xa5)
+#define RESULT_NO_DAY       (0)     // the wall clock was not set
+
+struct ResultRecord {
+    uint8_t marker;         // RESULT_MARKER
+    uint8_t mode;           // row of GAME_MODES
+    uint8_t player;         // race mode player (0-based), 0 otherwise
+    uint8_t crc;            // result_crc() of the record
+    uint32_t total_us;
+    uint32_t best_us;       // fastest valid reaction, 0 if none
+    uint16_t day;           // days since 1970-01-01, or RESULT_NO_DAY
+    uint8_t penalties;
+    uint8_t anticipations;
+};
+
+static_assert(sizeof(ResultRecord) == 16, "ResultRecord is a 16-byte log entry");
+
+// CRC-8 (polynomial 0x07) over the record with its crc field as zero.
+uint8_t result_crc(const ResultRecord& record);
+// The same CRC over any bytes, continuing from `crc`.
+uint8_t result_crc_bytes(const void* data, size_t len, uint8_t crc);
+
+// Set marker and crc.
+void result_seal(ResultRecord& record);
+
+// Best totals, fastest first, ties in log order.
+class ResultTop {
+public:
+    ResultTop() : count(0) {}
+
+    // Returns the 1-based rank, or 0 if the record did not make it.
+    uint8_t insert(const ResultRecord& record);
+
+    uint8_t size() const { return count; }
+    const ResultRecord& operator[](uint8_t rank) const { return entries[rank]; }
+
+private:
+    uint8_t count;
+    ResultRecord entries[RESULT_TOP_N];
+};
+
+struct ResultRank {
+    uint8_t all_time;       // 1-based, 0 if not in the top N
+    uint8_t day;
+};
+
+class ResultStore {
+public:
+    ResultStore() { clear(); }
+
+    void clear();
+
+    // Index a chunk of the log, in file order. Records with a bad marker or CRC are skipped
+    // and counted. Returns the number of valid records.
+    size_t load(const ResultRecord* records, size_t count);
+
+    // Index one new result. The caller appends it to the log.
+    ResultRank add(const ResultRecord& record);
+
+    const ResultTop& all_time(uint8_t mode) const { return best[mode < GAME_MODE_COUNT ? mode : 0]; }
+
+    // nullptr if the day is not among the last RESULT_DAYS with results.
+    const ResultTop* of_day(uint8_t mode, uint16_t day) const;
+
+    uint32_t records() const { return valid; }
+    uint32_t corrupt() const { return invalid; }
+
+private:
+    struct Day {
+        uint16_t day;
+        ResultTop best[GAME_MODE_COUNT];
+    };
+
+    Day* day_slot(uint16_t day);
+
+    ResultTop best[GAME_MODE_COUNT];
+    Day days[RESULT_DAYS];
+    uint32_t valid;
+    uint32_t invalid;
+};
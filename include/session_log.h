@@ -0,0 +1,82 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include "game_engine.h"
+
+// Session recorder and replayer.
+// Every engine input (buzzer frames, events with their `now`, a snapshot to resume, tournament
+// hold and release) and every value the engine pulled from its hooks (random numbers,
+// microsecond clock) is appended as a fixed 16-byte record, in call order. Feeding the records
+// back through a GameEngine reproduces the session exactly. The ring is single-producer (game
+// loop) / single-consumer (flush task).
+
+enum SessionRecordType : uint8_t {
+    SESSION_REC_BEGIN,      // value: format version
+    SESSION_REC_FRAME,      // a: kind, b: press_id, c: buzzer id, value: press_millis, stamp: rx_time_us
+    SESSION_REC_EVENT,      // a: event type, b: command, c: arg, stamp: now
+    SESSION_REC_RANDOM,     // value: result of GameHooks::random_range
+    SESSION_REC_NOW_US,     // stamp: result of GameHooks::now_us
+    SESSION_REC_STATE,      // a: new GameState, stamp: total_us
+    SESSION_REC_BUZZER,     // a: used in games, c: buzzer id (GameEngine::set_used)
+    SESSION_REC_LATENCY,    // c: buzzer id, value: press compensation in us (loaded from flash)
+    SESSION_REC_SNAPSHOT,   // a | b << 8: chunk index, value and stamp: 12 bytes of the snapshot
+                            // given to GameEngine::load_snapshot(), the last chunk loads it
+    SESSION_REC_HOLD,       // a: GameEngine::hold_rounds() argument, when it changes
+    SESSION_REC_RELEASE,    // stamp: GameEngine::release() lit time
+    SESSION_REC_WALL        // a: first, b: last buzzer id (GameEngine::set_wall)
+};
+
+struct SessionRecord {
+    uint8_t type;
+    uint8_t a;
+    uint8_t b;
+    uint8_t c;
+    uint32_t value;
+    int64_t stamp;
+};
+
+#define SESSION_LOG_VERSION         (5)     // 2: microsecond event times and totals, 3: latency compensation,
+                                            // 4: resume snapshot, tournament hold and release, 5: wall range
+#define SESSION_SNAPSHOT_CHUNK      (12)    // snapshot bytes per record
+#define SESSION_SNAPSHOT_CHUNKS     ((sizeof(GameSnapshot) + SESSION_SNAPSHOT_CHUNK - 1) / SESSION_SNAPSHOT_CHUNK)
+
+class SessionRecorder {
+public:
+    SessionRecorder();
+
+    // `storage` holds `capacity` records (a power of two), typically in PSRAM. Starts the log
+    // with a SESSION_REC_BEGIN record; until then every record is discarded.
+    void begin(SessionRecord* storage, uint32_t capacity);
+
+    void frame(const BuzzerFrame& frame);
+    void event(const GameEvent& event, int64_t now);
+    void random(uint32_t value);
+    void now_us(int64_t value);
+    void state(GameState state, int64_t total_us);
+    void buzzer(uint16_t id, bool used);
+    void wall(uint8_t first, uint8_t last);
+    void latency(uint16_t id, uint16_t compensation_us);
+    void snapshot(const GameSnapshot& snapshot);
+    void hold(bool hold);
+    void release(int64_t lit_us);
+
+    // Consumer side: copy up to `max` pending records, returns the count.
+    size_t read(SessionRecord* out, size_t max);
+
+    uint32_t drops() const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    void append(const SessionRecord& record);
+
+    SessionRecord* records;
+    uint32_t mask;
+    std::atomic<uint32_t> head;
+    std::atomic<uint32_t> tail;
+    std::atomic<uint32_t> dropped;
+};
+
+// Replay a recorded session through a fresh engine. Returns true if every recorded state
+// transition, including the final total_us, is reproduced. `hooks` receives the UI side
+// effects and may be a no-op implementation; random and clock values come from the log.
+bool session_replay(const SessionRecord* records, size_t count, GameHooks& hooks, int64_t* final_total);
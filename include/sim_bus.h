@@ -0,0 +1,131 @@
+#pragma once
+#include <stdint.h>
+#include <mutex>
+#include "can_bus.h"
+
+// Simulated CAN bus with a fleet of virtual buzzers, for load tests without hardware.
+// Each virtual buzzer speaks the real protocol: periodic status frames with press_id and
+// ms since lit, light on/all off commands and time sync replies, and honors the wall range of
+// the broadcasts, so several displays can share one simulated bus. Frame loss, duplicates,
+// wrong presses and bus-off periods are injected at configurable rates. SimBus keeps the
+// expected game total from the reactions it generated, so the engine's result can be checked.
+// Plain C++; time and sleep come from the caller.
+
+#define SIM_MAX_BUZZERS         (255)   // status frames carry an 8-bit buzzer id
+#define SIM_PENDING_CAPACITY    (512)   // queued sync replies
+#define SIM_FRAME_US            (500)   // bus time of one 8-byte frame at 250 kbit/s
+#define SIM_NO_ECHO             (0xffff)    // echo_delay_us: the buzzer ignores latency pings
+
+enum SimPressDistribution : uint8_t {
+    SIM_PRESS_UNIFORM,      // reaction uniform in [reaction_min_ms, reaction_max_ms]
+    SIM_PRESS_NORMAL        // mean in the middle, sigma a sixth of the range, clamped
+};
+
+struct SimConfig {
+    uint16_t buzzers;               // virtual buzzers with ids 1..buzzers
+    uint16_t scored_buzzers;        // ids 1..scored_buzzers are registered in the game
+    uint16_t wall_buzzers;          // walls of this many consecutive ids share the bus, 0 for one wall
+    uint16_t initial_buzzers;       // powered at start, 0 for all
+    uint32_t hotplug_ms;            // the others are plugged in one by one at this interval
+    uint32_t heartbeat_ms;
+    SimPressDistribution press_distribution;
+    uint32_t reaction_min_ms;
+    uint32_t reaction_max_ms;
+    uint16_t loss_permille;         // frames lost in either direction
+    uint16_t duplicate_permille;    // status frames sent twice
+    uint16_t wrong_press_permille;  // rounds where another buzzer is pressed first
+    uint32_t busoff_period_ms;      // 0 disables bus-off events
+    uint32_t busoff_ms;             // bus is silent this long every period
+    uint16_t drift_ppm;             // buzzer clocks run off by up to +/- this
+    uint8_t payload_version;        // 1: v1 event frames once the display announces them
+    uint32_t seed;
+    uint16_t echo_delay_us[SIM_MAX_BUZZERS + 1];    // by id: latency ping to echo beyond one frame
+};
+
+struct SimStats {
+    uint32_t generated;         // frames put on the simulated bus
+    uint32_t lost;
+    uint32_t filtered;          // rejected by the acceptance filter
+    uint32_t duplicated;
+    uint32_t transmitted;       // frames accepted from the display
+    uint32_t tx_failed;         // rejected during bus-off
+    uint32_t presses;
+    uint32_t wrong_presses;
+    uint32_t busoff_events;
+    uint32_t recoveries;        // recover() calls
+    uint32_t rounds;            // light-on commands that lit a buzzer
+    uint32_t expected_total_ms; // reactions since reset_outcome()
+    uint32_t penalties;         // wrong presses since reset_outcome(), at most one per round
+};
+
+typedef int64_t (*SimClockFn)();
+typedef void (*SimSleepFn)(uint32_t ms);
+
+class SimBus : public CanBus {
+public:
+    SimBus(const SimConfig& config, SimClockFn clock, SimSleepFn sleep);
+
+    bool transmit(const CanFrame& frame, uint32_t timeout_ms) override;
+    size_t receive(CanFrame* frames, size_t max, uint32_t timeout_ms) override;
+    bool status(CanStatus& status) override;
+    void recover() override;
+    void start() override {}
+
+    // The hardware acceptance filter of the simulated controller, before the first receive().
+    void set_filter(const CanFilter& filter);
+
+    // Start counting the expected total for a new game.
+    void reset_outcome();
+    SimStats counters();
+
+private:
+    struct Buzzer {
+        bool present;
+        bool lit;
+        bool pressed;
+        uint8_t press_id;
+        uint32_t press_ms;
+        int64_t lit_us;
+        int64_t press_due_us;       // 0 if no press is scheduled
+        int64_t next_heartbeat_us;
+        int32_t clock_offset_us;
+        int16_t drift_ppm;
+        uint8_t heartbeats;         // v1 sends a battery event every 16th heartbeat
+        bool press_pending;         // v1 sends a press event with the next frame
+    };
+
+    struct Pending {
+        CanFrame frame;
+        int64_t due_us;
+    };
+
+    bool bus_off(int64_t now);
+    bool roll(uint16_t permille);
+    uint32_t random();
+    uint32_t reaction_ms();
+    void light(uint8_t id, int64_t now);
+    void sync(const CanFrame& frame, int64_t now);
+    void discovery(const CanFrame& frame, int64_t now);
+    void echo(const CanFrame& frame, int64_t now);
+    void hotplug(int64_t now);
+    size_t collect(int64_t now, CanFrame* frames, size_t max);
+    bool emit(const CanFrame& frame, CanFrame* frames, size_t max, size_t& n);
+    int64_t next_due(int64_t now) const;
+    void status_frame(uint8_t id, Buzzer& buzzer, uint32_t ms, CanFrame& frame);
+
+    SimConfig config;
+    SimClockFn clock;
+    SimSleepFn sleep;
+    std::mutex lock;
+    Buzzer buzzers[SIM_MAX_BUZZERS + 1];    // by id, 0 unused
+    Pending pending[SIM_PENDING_CAPACITY];
+    uint32_t pending_head;
+    uint32_t pending_tail;
+    uint32_t rng;
+    bool was_bus_off;
+    CanFilter filter;
+    uint16_t plugged;       // ids 1..plugged are present
+    uint8_t version;        // payload version in use, after negotiation
+    int64_t next_hotplug_us;
+    SimStats stats;
+};
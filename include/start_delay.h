@@ -0,0 +1,70 @@
+#pragma once
+#include <stdint.h>
+#include "game_mode.h"
+
+// Start delays ("foreperiods") between the round announcement and the light.
+// Each game seeds its own xoshiro128** generator from one GameHooks::random_range() value, so
+// a recorded session replays the same delays from a single log record. The distributions are
+// chosen per game mode, see GameDelay.
+
+// xoshiro128** (Blackman/Vigna): 32-bit state words, a handful of shifts per number.
+class Xoshiro128 {
+public:
+    Xoshiro128() { seed(1); }
+
+    void seed(uint32_t value);
+
+    uint32_t next() {
+        uint32_t result = rotl(s[1] * 5, 7) * 9;
+        uint32_t t = s[1] << 9;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 11);
+        return result;
+    }
+
+    // Uniform in [0, n), n > 0. Lemire's multiply-shift; the bias is below 2^-32 * n.
+    uint32_t below(uint32_t n) { return (uint32_t)(((uint64_t)next() * n) >> 32); }
+
+    // Uniform in (0, 1).
+    float unit() { return ((next() >> 8) + 0.5f) * (1.0f / 16777216.0f); }
+
+    void save(uint32_t state[4]) const;
+    void restore(const uint32_t state[4]);
+
+private:
+    static uint32_t rotl(uint32_t x, int k) { return (x << k) | (x >> (32 - k)); }
+
+    uint32_t s[4];
+};
+
+#define START_DELAY_BINS    (4)     // GAME_DELAY_BALANCED: sub-windows per shuffled block
+
+// Generator position, kept in a GameSnapshot to resume a game with the same delays.
+struct StartDelayState {
+    uint32_t rng[4];
+    uint8_t block[START_DELAY_BINS];
+    uint8_t block_pos;
+};
+
+class StartDelay {
+public:
+    StartDelay() : mode(nullptr), block_pos(START_DELAY_BINS) {}
+
+    void begin(const GameMode& mode, uint32_t seed);
+
+    // Delay for the next round, in [delay_min_ms, delay_max_ms] of the mode.
+    uint32_t next_ms();
+
+    StartDelayState save() const;
+    void restore(const GameMode& mode, const StartDelayState& state);
+
+private:
+    const GameMode* mode;
+    Xoshiro128 rng;
+    uint8_t block[START_DELAY_BINS];
+    uint8_t block_pos;
+};
@@ -0,0 +1,27 @@
+#pragma once
+#include <stdint.h>
+
+// Monotonic 64-bit microsecond clock for all game timing.
+// On the target this is esp_timer, which counts from boot and does not wrap for 292 000 years,
+// so deadlines and reaction times compare as plain integers. Host builds (no ARDUINO) get a
+// mock that only moves when the test moves it.
+
+#ifdef ARDUINO
+#include <esp_timer.h>
+
+static inline int64_t time_us()
+{
+    return esp_timer_get_time();
+}
+#else
+int64_t time_us();
+void time_mock_set(int64_t us);
+void time_mock_advance(int64_t us);
+#endif
+
+#define TIME_US(ms)     ((int64_t)(ms) * 1000)
+
+static inline uint32_t time_ms()
+{
+    return (uint32_t)(time_us() / 1000);
+}
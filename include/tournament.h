@@ -0,0 +1,217 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include "can_bus.h"
+#include "game_mode.h"
+#include "start_delay.h"
+#include "time_service.h"
+
+// Tournaments across several displays on one CAN bus.
+// Every display ("node", one wall and one player per heat) runs a TournamentNode next to its
+// GameEngine. The lowest node id that is alive coordinates: it starts the heats, holds every
+// round at a barrier until all walls are ready and then broadcasts one lit time on its own
+// clock. The followers keep a two-way clock offset to the coordinator, so the walls light up
+// within the offset error of each other, typically well below a millisecond. Results go out as
+// broadcasts, so every node merges the same TournamentBracket; the coordinator decides who
+// advances. Coordinator state is only the heat, variant and survivors, which every node keeps
+// from the broadcasts, so a node that takes over after a coordinator drops out continues the
+// tournament. Plain C++, driven like GameEngine: frames, tick() and next_deadline().
+//
+// Frames, id TOURNAMENT_ID | type << 4 | node (sender, or addressee for PONG), 32-bit times
+// are the low bits of the coordinator's time_us(). The ids sit below the display broadcasts, and
+// with the buzzer frames they split on id bit 8 into two tight ranges for the acceptance filter:
+//   GO      coordinator: [0] heat, [1] round, [4..7] lit time
+//   PONG    coordinator -> node: [0] seq, [1] sender, [2..3] turnaround us, [4..7] PING received
+//   PING    node: [0] seq
+//   READY   node: [0] heat, [1] round, held at the barrier
+//   RESULT  node: [0] heat, [1] penalties, [4..7] total us, 0xffffffff: did not finish
+//   START   coordinator: [0] heat, [1] variant, [4..7] entrants
+//   STANDING coordinator: [0] heat, [1] winner or TOURNAMENT_NO_NODE, [4..7] survivors
+//   HELLO   node: [0] heat, [1] TournamentPhase
+// The lower types win arbitration, so GO is never delayed by the bookkeeping frames.
+
+#define TOURNAMENT_ID                   (0x700)
+#define TOURNAMENT_ID_MASK              (0x780)
+#define TOURNAMENT_IDS                  (0x80)  // 8 types of 16 nodes
+#define TOURNAMENT_MAX_NODES            (16)    // 4-bit node ids
+#define TOURNAMENT_MAX_HEATS            (4)     // halving 16 entrants down to the winner
+#define TOURNAMENT_NO_NODE              (0xff)
+#define TOURNAMENT_DNF                  (-1)    // total of a game that stopped before its last round
+#define TOURNAMENT_HELLO_MS             (250)   // also the repeat period of unanswered frames
+#define TOURNAMENT_PEER_TIMEOUT_MS      (1000)  // a silent node has left
+#define TOURNAMENT_PING_MS              (100)
+#define TOURNAMENT_PING_SAMPLES         (8)     // the lowest round trip of these sets the offset
+#define TOURNAMENT_GO_LEAD_MS           (30)    // GO goes out at least this long before the light
+#define TOURNAMENT_BARRIER_TIMEOUT_MS   (5000)  // a round starts without walls that are not ready
+#define TOURNAMENT_RESULT_TIMEOUT_MS    (10000) // after the first result, missing ones count as DNF
+#define TOURNAMENT_HEAT_PAUSE_MS        (8000)  // standings are shown this long before the next heat
+
+enum TournamentMessage : uint8_t {
+    TOURNAMENT_MSG_GO,
+    TOURNAMENT_MSG_PONG,
+    TOURNAMENT_MSG_PING,
+    TOURNAMENT_MSG_READY,
+    TOURNAMENT_MSG_RESULT,
+    TOURNAMENT_MSG_START,
+    TOURNAMENT_MSG_STANDING,
+    TOURNAMENT_MSG_HELLO
+};
+
+enum TournamentPhase : uint8_t {
+    TOURNAMENT_IDLE,
+    TOURNAMENT_PLAYING,     // in a heat, the local game is running
+    TOURNAMENT_WAITING,     // heat played, waiting for the standings
+    TOURNAMENT_OUT          // eliminated or not entered, watching
+};
+
+// Elimination bracket: every heat is played by all survivors at once, the faster half
+// (rounded up) advances. Nodes without a time, missing or DNF, are placed last and do not advance.
+class TournamentBracket {
+public:
+    TournamentBracket() { clear(); }
+
+    void clear();
+    void start_heat(uint8_t heat, uint32_t entrants);
+    // `total_us` TOURNAMENT_DNF: the node reported, but did not finish.
+    void record(uint8_t node, int64_t total_us, uint8_t penalties);
+
+    // The faster half (rounded up) of the entrants with a time.
+    uint32_t fastest_half() const;
+    // Who advances from the current heat, as decided by the coordinator.
+    uint32_t survivors() const { return heats[current].survivors; }
+    void set_survivors(uint32_t survivors) { heats[current].survivors = survivors; }
+
+    uint8_t heat() const { return current + 1; }
+    uint32_t entrants() const { return heats[current].entrants; }
+    uint32_t reported() const { return heats[current].reported; }
+    bool has_result(uint8_t node) const { return (heats[current].finished >> node) & 1; }
+    bool dnf(uint8_t node) const { return ((heats[current].reported & ~heats[current].finished) >> node) & 1; }
+    int64_t total(uint8_t node) const { return heats[current].total_us[node]; }
+    uint8_t penalties(uint8_t node) const { return heats[current].penalties[node]; }
+
+    // Entrants of the current heat, fastest first, nodes without a time last.
+    uint8_t ranking(uint8_t* nodes) const;
+
+private:
+    struct Heat {
+        uint32_t entrants;
+        uint32_t reported;
+        uint32_t finished;          // reported with a time
+        uint32_t survivors;
+        int64_t total_us[TOURNAMENT_MAX_NODES];
+        uint8_t penalties[TOURNAMENT_MAX_NODES];
+    };
+
+    Heat heats[TOURNAMENT_MAX_HEATS];
+    uint8_t current;
+};
+
+// Side effects of a node. The firmware drives its GameEngine from these.
+class TournamentHooks {
+public:
+    virtual ~TournamentHooks() {}
+    virtual void send_can(uint32_t id, const uint8_t* data, uint8_t len) = 0;
+    // Seeds the start delays of each heat.
+    virtual uint32_t random_range(uint32_t lo, uint32_t hi) = 0;
+    virtual int64_t now_us() = 0;
+    // Start a game whose rounds hold before the light, see GameEngine::hold_rounds().
+    virtual void start_heat(uint8_t heat, uint8_t variant) = 0;
+    // Light the held round at `lit_us` on the local clock.
+    virtual void release_round(uint8_t round, int64_t lit_us) = 0;
+    virtual void show_standing(const TournamentBracket& bracket, uint8_t self, bool final) = 0;
+};
+
+class TournamentNode {
+public:
+    TournamentNode(TournamentHooks& hooks, uint8_t node);
+
+    // Returns false for frames that are not tournament frames.
+    bool handle_frame(const CanFrame& frame, int64_t rx_time_us);
+    void tick(int64_t now);
+    int64_t next_deadline() const { return next_deadline_us; }
+
+    // Coordinator only: start a tournament with every node that is alive. Returns false on a
+    // follower or while a tournament runs.
+    bool start(uint8_t variant, int64_t now);
+
+    // The local game holds before the light of `round`.
+    void round_ready(uint8_t round, int64_t now);
+    // The local game of the current heat ended; `total_us` TOURNAMENT_DNF if it stopped early.
+    void game_finished(int64_t total_us, uint8_t penalties, int64_t now);
+
+    uint8_t node() const { return self; }
+    uint8_t coordinator() const { return leader; }
+    bool coordinating() const { return leader == self; }
+    TournamentPhase phase() const { return node_phase; }
+    const TournamentBracket& bracket() const { return standings; }
+    // Estimated coordinator clock minus local clock, low 32 bits; valid once synced().
+    uint32_t offset() const { return clock_offset; }
+    bool synced() const { return coordinating() || sample_count > 0; }
+    uint32_t round_trip_us() const { return best_rtt; }
+
+private:
+    void send(TournamentMessage type, uint8_t node, const uint8_t* data);
+    void elect(int64_t now);
+    uint32_t alive(int64_t now) const;
+    int64_t to_local(uint32_t coordinator_us, int64_t now) const;
+    uint32_t to_coordinator(int64_t local_us) const { return (uint32_t)local_us + clock_offset; }
+    void on_start(uint8_t heat, uint8_t variant, uint32_t entrants);
+    void on_ready(uint8_t node, uint8_t round, int64_t now);
+    void on_result(uint8_t node, int64_t total_us, uint8_t penalties, int64_t now);
+    void on_go(uint8_t heat, uint8_t round, uint32_t lit, int64_t now);
+    void on_pong(const uint8_t* data, int64_t now);
+    void on_standing(uint8_t heat, uint8_t winner, uint32_t survivors);
+    void coordinate(int64_t now);
+    void send_start();
+    void send_go();
+    void send_result();
+    void send_standing();
+    void update_deadline();
+
+    TournamentHooks& hooks;
+    uint8_t self;
+    uint8_t leader;
+    int64_t started_us;             // elections wait one peer timeout for the other nodes
+    int64_t last_seen[TOURNAMENT_MAX_NODES];
+    int64_t next_hello;
+    int64_t next_deadline_us;
+
+    // clock offset to the coordinator
+    uint8_t ping_seq;
+    int64_t ping_sent[4];           // by seq % 4
+    int64_t next_ping;
+    uint32_t samples[TOURNAMENT_PING_SAMPLES];   // offsets
+    uint32_t rtts[TOURNAMENT_PING_SAMPLES];
+    uint8_t sample_count;
+    uint8_t sample_next;
+    uint32_t clock_offset;
+    uint32_t best_rtt;
+
+    // replicated tournament state
+    TournamentPhase node_phase;
+    uint8_t heat;
+    uint8_t variant;
+    uint32_t entrants;
+    TournamentBracket standings;
+
+    // this node's progress in the heat
+    uint8_t held_round;             // round waiting for GO, 0 if none
+    uint8_t released_round;
+    int64_t next_repeat;            // READY or RESULT until answered
+    bool result_pending;
+    int64_t result_total;
+    uint8_t result_penalties;
+
+    // coordinator
+    bool running;                   // a tournament is in progress
+    uint32_t ready;                 // entrants held at `barrier_round`
+    uint8_t barrier_round;
+    int64_t barrier_deadline;
+    StartDelay go_delay;            // the mode's start delays, seeded per heat like a game's
+    uint8_t go_round;               // last GO, repeated for late READYs
+    uint32_t go_lit;
+    int64_t result_deadline;        // 0 until the first result of the heat
+    int64_t next_start;             // repeat START, or the next heat after the pause, 0 if none
+    bool heat_done;                 // STANDING for `heat` is out (all nodes)
+    bool collision;                 // another node uses our id
+};
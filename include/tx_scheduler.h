@@ -0,0 +1,57 @@
+#pragma once
+#include <stdint.h>
+
+// Transmit scheduler for buzzer commands.
+// Callers enqueue without blocking; a frame for an identifier that is still pending replaces
+// the pending one, and an "all off" drops pending "light on" frames. Higher priority frames
+// are sent first, equal priorities in enqueue order. Not thread safe: the firmware guards it
+// with a lock and drains it from the TX task.
+
+#define TX_SCHEDULER_CAPACITY   (16)
+#define TX_ID_ALL_OFF           (0x7ff)  // [0] 0, [1..2] wall range (see game_engine.h)
+#define TX_ID_LIGHT_ON          (0x100)  // | buzzer id
+
+enum TxPriority : uint8_t {
+    TX_PRIORITY_KEEPALIVE,  // periodic repeats, may be late
+    TX_PRIORITY_GAME        // game-critical state changes
+};
+
+struct TxFrame {
+    uint32_t id;
+    uint8_t len;
+    uint8_t priority;
+    uint8_t data[8];
+    uint32_t seq;
+};
+
+struct TxStats {
+    uint32_t queued;
+    uint32_t coalesced;
+    uint32_t dropped;   // queue full or transmit failed
+    uint32_t sent;
+};
+
+class TxScheduler {
+public:
+    TxScheduler();
+
+    // Returns false if the frame had to be dropped.
+    bool enqueue(uint32_t id, const uint8_t* data, uint8_t len, TxPriority priority);
+
+    // Take the next frame to transmit. Returns false when nothing is pending.
+    bool next(TxFrame& frame);
+
+    void mark_sent() { stats.sent++; }
+    void mark_failed() { stats.dropped++; }
+
+    uint8_t pending() const { return count; }
+    const TxStats& counters() const { return stats; }
+
+private:
+    void remove(uint8_t i);
+
+    TxFrame frames[TX_SCHEDULER_CAPACITY];
+    uint8_t count;
+    uint32_t seq;
+    TxStats stats;
+};
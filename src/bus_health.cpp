@@ -0,0 +1,131 @@
+#include "bus_health.h"
+#include "game_engine.h"
+#include <string.h>
+
+BusHealth::BusHealth() :
+    have_last(false), last_millis(0), off_since(0), running_since(0), next_attempt(0),
+    tec_trend_acc(0), rec_trend_acc(0), seq(0)
+{
+    memset(&current, 0, sizeof(current));
+    memset(&last, 0, sizeof(last));
+    current.state = BUS_STATE_STOPPED;
+    current.backoff_ms = BUS_BACKOFF_MIN_MS;
+    published = current;
+}
+
+// Driver counters restart at zero when the driver is reinstalled.
+uint32_t BusHealth::delta(uint32_t current, uint32_t previous)
+{
+    return current >= previous ? current - previous : current;
+}
+
+BusAction BusHealth::sample(const CanStatus& status, uint32_t now)
+{
+    uint32_t elapsed = have_last ? now - last_millis : 0;
+    if (have_last && elapsed > 0) {
+        uint32_t errors = delta(status.bus_error_count, last.bus_error_count);
+        uint32_t arb = delta(status.arb_lost_count, last.arb_lost_count);
+        current.bus_errors += errors;
+        current.arb_lost += arb;
+        current.rx_missed += delta(status.rx_missed_count, last.rx_missed_count);
+        current.tx_failed += delta(status.tx_failed_count, last.tx_failed_count);
+        current.bus_error_rate = errors * 1000 / elapsed;
+        current.arb_lost_rate = arb * 1000 / elapsed;
+
+        int32_t tec_rate = ((int32_t)status.tx_error_counter - last.tx_error_counter) * 1000 / (int32_t)elapsed;
+        int32_t rec_rate = ((int32_t)status.rx_error_counter - last.rx_error_counter) * 1000 / (int32_t)elapsed;
+        tec_trend_acc += tec_rate - (tec_trend_acc >> BUS_TREND_SHIFT);
+        rec_trend_acc += rec_rate - (rec_trend_acc >> BUS_TREND_SHIFT);
+        current.tec_trend = tec_trend_acc >> BUS_TREND_SHIFT;
+        current.rec_trend = rec_trend_acc >> BUS_TREND_SHIFT;
+    }
+    current.tec = status.tx_error_counter;
+    current.rec = status.rx_error_counter;
+    if (current.tec > current.tec_peak) {
+        current.tec_peak = current.tec;
+    }
+
+    BusState previous = current.state;
+    current.state = status.state;
+    if (previous == BUS_STATE_RUNNING && status.state != BUS_STATE_RUNNING) {
+        off_since = now;
+    }
+    if (previous != BUS_STATE_RUNNING && have_last) {
+        current.bus_off_ms += elapsed;
+    }
+
+    BusAction action = BUS_ACTION_NONE;
+    switch (status.state) {
+        case BUS_STATE_RUNNING:
+            if (previous != BUS_STATE_RUNNING) {
+                running_since = now;
+            } else if (current.backoff_ms != BUS_BACKOFF_MIN_MS && game_time_reached(now, running_since + BUS_STABLE_MS)) {
+                current.backoff_ms = BUS_BACKOFF_MIN_MS;
+            }
+            break;
+
+        case BUS_STATE_BUS_OFF:
+            if (previous != BUS_STATE_BUS_OFF) {
+                current.bus_off_count++;
+                // bus-off again before the bus was stable: wait longer this time
+                if (previous == BUS_STATE_RUNNING && current.recoveries && !game_time_reached(now, running_since + BUS_STABLE_MS)) {
+                    current.backoff_ms = current.backoff_ms * 2 > BUS_BACKOFF_MAX_MS ? BUS_BACKOFF_MAX_MS : current.backoff_ms * 2;
+                }
+                next_attempt = now + current.backoff_ms;
+            }
+            if (game_time_reached(now, next_attempt)) {
+                // retried after another backoff if the controller stays off
+                current.recoveries++;
+                next_attempt = now + current.backoff_ms;
+                action = BUS_ACTION_RECOVER;
+            }
+            break;
+
+        case BUS_STATE_RECOVERING:
+            break;
+
+        case BUS_STATE_STOPPED:
+            action = BUS_ACTION_START;
+            break;
+    }
+
+    last = status;
+    last_millis = now;
+    have_last = true;
+    publish();
+    return action;
+}
+
+void BusHealth::publish()
+{
+    uint32_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    published = current;
+    std::atomic_thread_fence(std::memory_order_release);
+    seq.store(s + 2, std::memory_order_relaxed);
+}
+
+BusHealthStats BusHealth::stats() const
+{
+    BusHealthStats copy;
+    uint32_t before, after;
+    do {
+        before = seq.load(std::memory_order_acquire);
+        copy = published;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        after = seq.load(std::memory_order_relaxed);
+    } while ((before & 1) || before != after);
+    return copy;
+}
+
+const char* bus_state_name(BusState state)
+{
+    switch (state) {
+        case BUS_STATE_STOPPED:     return "stopped";
+        case BUS_STATE_RUNNING:     return "running";
+        case BUS_STATE_BUS_OFF:     return "bus-off";
+        case BUS_STATE_RECOVERING:  return "recovering";
+    }
+    return "?";
+}
@@ -0,0 +1,112 @@
+#include "buzzer_frame.h"
+#include "clock_sync.h"
+#include "latency_table.h"
+
+typedef uint8_t (*BuzzerDecoder)(uint8_t kind, uint16_t buzzer, const uint8_t* data, uint8_t len,
+                                 int64_t rx_time_us, BuzzerFrame* frames);
+
+struct BuzzerIdRange {
+    uint16_t base;
+    uint8_t kind;           // BuzzerFrameKind for v0 ranges
+    BuzzerDecoder decode;
+};
+
+struct BuzzerEventFormat {
+    uint8_t size;           // header byte included
+    uint8_t kind;           // BuzzerFrameKind
+};
+
+static const BuzzerEventFormat BUZZER_EVENT_FORMATS[BUZZER_EVENT_TYPES] = {
+    { 2, BUZZER_FRAME_STATUS },     // BUZZER_EVENT_HEARTBEAT
+    { 2, BUZZER_FRAME_STATUS },     // BUZZER_EVENT_PRESS
+    { 2, BUZZER_FRAME_RELEASE },    // BUZZER_EVENT_RELEASE
+    { 2, BUZZER_FRAME_BATTERY },    // BUZZER_EVENT_BATTERY
+};
+
+static inline uint32_t be32(const uint8_t* p)
+{
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+// v0: byte 0 and bytes 4..7, missing bytes of a short frame read as zero.
+static uint8_t decode_v0(uint8_t kind, uint16_t buzzer, const uint8_t* data, uint8_t len,
+                         int64_t rx_time_us, BuzzerFrame* frames)
+{
+    BuzzerFrame &frame = frames[0];
+    frame.buzzer_id = buzzer;
+    frame.kind = (BuzzerFrameKind)kind;
+    frame.press_id = data[0];
+    if (len == 8) {
+        frame.press_millis = be32(data + 4);
+    } else {
+        frame.press_millis = 0;
+        for (uint8_t i = 4; i < 8; i++) {
+            frame.press_millis = frame.press_millis << 8 | (i < len ? data[i] : 0);
+        }
+    }
+    frame.rx_time_us = rx_time_us;
+    return 1;
+}
+
+// v1: a frame is rejected as a whole unless every announced event fits and is known, and the
+// reserved header bits are clear; a later version may give them a meaning v1 cannot parse.
+// The kind of each event comes from BUZZER_EVENT_FORMATS, not from the id range.
+static uint8_t decode_v1(uint8_t, uint16_t buzzer, const uint8_t* data, uint8_t len,
+                         int64_t rx_time_us, BuzzerFrame* frames)
+{
+    if (len < 4 || (data[0] >> 6) != 1 || (data[0] & 7) != 0) {
+        return 0;
+    }
+    uint8_t count = (data[0] >> 3) & 7;
+    if (count == 0 || count > BUZZER_FRAME_MAX_EVENTS) {
+        return 0;
+    }
+
+    uint32_t time = (uint32_t)data[1] << 16 | data[2] << 8 | data[3];
+    uint8_t pos = 4;
+    for (uint8_t i = 0; i < count; i++) {
+        if (pos >= len) {
+            return 0;
+        }
+        uint8_t type = data[pos] >> 5;
+        if (type >= BUZZER_EVENT_TYPES || pos + BUZZER_EVENT_FORMATS[type].size > len) {
+            return 0;
+        }
+        time += data[pos] & 0x1f;
+
+        BuzzerFrame &frame = frames[i];
+        frame.buzzer_id = buzzer;
+        frame.kind = (BuzzerFrameKind)BUZZER_EVENT_FORMATS[type].kind;
+        frame.rx_time_us = rx_time_us;
+        if (type == BUZZER_EVENT_BATTERY) {
+            frame.press_id = 0;
+            frame.press_millis = data[pos + 1] * 20;
+        } else {
+            frame.press_id = data[pos + 1];
+            frame.press_millis = time;
+        }
+        pos += BUZZER_EVENT_FORMATS[type].size;
+    }
+    return count;
+}
+
+static const BuzzerIdRange BUZZER_ID_RANGES[] = {
+    { 0,                  BUZZER_FRAME_STATUS,      decode_v0 },
+    { TIME_SYNC_REPLY_ID, BUZZER_FRAME_SYNC_REPLY,  decode_v0 },
+    { TIME_SYNC_PRESS_ID, BUZZER_FRAME_TIMED_PRESS, decode_v0 },
+    { BUZZER_EVENT_ID,    0,                        decode_v1 },
+    { LATENCY_ECHO_ID,    BUZZER_FRAME_ECHO,        decode_v0 },
+};
+
+uint8_t buzzer_frame_decode(uint32_t id, const uint8_t* data, uint8_t len, int64_t rx_time_us, BuzzerFrame* frames)
+{
+    if (len == 0 || len > 8) {
+        return 0;
+    }
+    for (const BuzzerIdRange &range : BUZZER_ID_RANGES) {
+        if ((id & ~0xffu) == range.base) {
+            return range.decode(range.kind, id & 0xff, data, len, rx_time_us, frames);
+        }
+    }
+    return 0;
+}
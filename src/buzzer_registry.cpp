@@ -0,0 +1,31 @@
+#include "buzzer_registry.h"
+#include <string.h>
+
+BuzzerRegistry::BuzzerRegistry() : count(0)
+{
+    memset(index, BUZZER_NO_SLOT, sizeof(index));
+}
+
+uint8_t BuzzerRegistry::add(uint16_t id, bool used)
+{
+    if (id >= BUZZER_ID_SPACE || index[id] != BUZZER_NO_SLOT || count >= BUZZER_REGISTRY_CAPACITY) {
+        return BUZZER_NO_SLOT;
+    }
+    uint8_t slot = count++;
+    slots[slot] = BuzzerButton(id, used);
+    index[id] = slot;
+    return slot;
+}
+
+void BuzzerRegistry::remove(uint8_t slot)
+{
+    if (slot >= count) {
+        return;
+    }
+    index[slots[slot].buzzer_id] = BUZZER_NO_SLOT;
+    count--;
+    for (uint8_t i = slot; i < count; i++) {
+        slots[i] = slots[i + 1];
+        index[slots[i].buzzer_id] = i;
+    }
+}
@@ -0,0 +1,119 @@
+#include "can_filter.h"
+#include "clock_sync.h"
+#include "buzzer_frame.h"
+#include "latency_table.h"
+#include "tournament.h"
+#include <string.h>
+
+#define CAN_ID_MASK (0x7ff)
+
+void CanAcceptance::clear()
+{
+    memset(bits, 0, sizeof(bits));
+    count = 0;
+}
+
+void CanAcceptance::add(uint16_t id)
+{
+    if (id >= BUZZER_ID_SPACE || accepts(id)) {
+        return;
+    }
+    bits[id >> 5] |= 1u << (id & 31);
+    count++;
+}
+
+void CanAcceptance::add_buzzer(uint16_t buzzer_id)
+{
+    if (buzzer_id > 0xff) {
+        return;
+    }
+    add(buzzer_id);
+    add(TIME_SYNC_REPLY_ID | buzzer_id);
+    add(TIME_SYNC_PRESS_ID | buzzer_id);
+    add(BUZZER_EVENT_ID | buzzer_id);
+    add(LATENCY_ECHO_ID | buzzer_id);
+}
+
+void CanAcceptance::add_display(uint8_t wall_first, uint8_t wall_last)
+{
+    for (uint16_t id = wall_first; id <= wall_last; id++) {
+        add_buzzer(id);
+    }
+    for (uint16_t id = TOURNAMENT_ID; id < TOURNAMENT_ID + TOURNAMENT_IDS; id++) {
+        add(id);
+    }
+}
+
+static uint16_t range_size(const CanFilterRange& range)
+{
+    return 1u << __builtin_popcount(range.mask);
+}
+
+// Identifiers matched by both ranges: they must agree wherever both care.
+static uint16_t overlap_size(const CanFilterRange& a, const CanFilterRange& b)
+{
+    uint16_t care = ~(a.mask | b.mask) & CAN_ID_MASK;
+    if ((a.code ^ b.code) & care) {
+        return 0;
+    }
+    return 1u << __builtin_popcount(a.mask & b.mask);
+}
+
+// Smallest range covering the identifiers where (id >> bit & 1) == value, or every one for bit < 0.
+static bool cover(const CanAcceptance& acceptance, int bit, int value, CanFilterRange& range)
+{
+    uint16_t all_ones = CAN_ID_MASK;
+    uint16_t any_ones = 0;
+    bool found = false;
+    for (uint16_t id = 0; id < BUZZER_ID_SPACE; id++) {
+        if (!acceptance.accepts(id) || (bit >= 0 && ((id >> bit) & 1) != value)) {
+            continue;
+        }
+        all_ones &= id;
+        any_ones |= id;
+        found = true;
+    }
+    range.code = all_ones;
+    range.mask = all_ones ^ any_ones;
+    return found;
+}
+
+CanFilter can_filter_compute(const CanAcceptance& acceptance)
+{
+    CanFilter filter = {};
+    filter.wanted = acceptance.size();
+    if (acceptance.size() == 0) {
+        filter.ranges[0].mask = CAN_ID_MASK;
+        filter.accepted = BUZZER_ID_SPACE;
+        return filter;
+    }
+
+    cover(acceptance, -1, 0, filter.ranges[0]);
+    filter.accepted = range_size(filter.ranges[0]);
+
+    // Dual mode: split the set on the identifier bit that gives the tightest pair of ranges.
+    for (int bit = 0; bit < 11 && filter.accepted > filter.wanted; bit++) {
+        CanFilterRange low, high;
+        if (!cover(acceptance, bit, 0, low) || !cover(acceptance, bit, 1, high)) {
+            continue;
+        }
+        uint16_t accepted = range_size(low) + range_size(high) - overlap_size(low, high);
+        if (accepted < filter.accepted) {
+            filter.dual = true;
+            filter.ranges[0] = low;
+            filter.ranges[1] = high;
+            filter.accepted = accepted;
+        }
+    }
+    return filter;
+}
+
+bool can_filter_matches(const CanFilter& filter, uint16_t id)
+{
+    for (uint8_t i = 0; i < (filter.dual ? 2 : 1); i++) {
+        if (((id ^ filter.ranges[i].code) & ~filter.ranges[i].mask & CAN_ID_MASK) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,69 @@
+#include "clock_sync.h"
+
+void ClockSync::reset()
+{
+    count = 0;
+    next = 0;
+    last_x = 0;
+    x0 = 0;
+    y0 = 0;
+    rate = 1.0;
+}
+
+// Extend the 32-bit buzzer clock (wraps every ~71 minutes) using the newest observation.
+int64_t ClockSync::unwrap(uint32_t buzzer_us) const
+{
+    return last_x + (int32_t)(buzzer_us - (uint32_t)last_x);
+}
+
+void ClockSync::add_pair(uint32_t buzzer_us, int64_t display_us)
+{
+    int64_t x = count ? unwrap(buzzer_us) : (int64_t)buzzer_us;
+    if (count && x <= last_x) {
+        // buzzer rebooted or sent a stale reply: start over
+        reset();
+        x = buzzer_us;
+    }
+    last_x = x;
+    xs[next] = x;
+    ys[next] = display_us;
+    next = (next + 1) % CLOCK_SYNC_PAIRS;
+    if (count < CLOCK_SYNC_PAIRS) {
+        count++;
+    }
+    fit();
+}
+
+void ClockSync::fit()
+{
+    // Center on the newest pair to keep the sums small.
+    uint8_t newest = (next + CLOCK_SYNC_PAIRS - 1) % CLOCK_SYNC_PAIRS;
+    int64_t cx = xs[newest];
+    int64_t cy = ys[newest];
+
+    double sx = 0, sy = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        sx += (double)(xs[i] - cx);
+        sy += (double)(ys[i] - cy);
+    }
+    double mx = sx / count;
+    double my = sy / count;
+
+    double sxx = 0, sxy = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        double dx = (double)(xs[i] - cx) - mx;
+        double dy = (double)(ys[i] - cy) - my;
+        sxx += dx * dx;
+        sxy += dx * dy;
+    }
+    rate = (count >= 2 && sxx > 0) ? sxy / sxx : 1.0;
+
+    // Store the line through the mean point.
+    x0 = cx + (int64_t)mx;
+    y0 = cy + (int64_t)(my - (mx - (double)(int64_t)mx) * rate);
+}
+
+int64_t ClockSync::to_display_us(uint32_t buzzer_us) const
+{
+    return y0 + (int64_t)((double)(unwrap(buzzer_us) - x0) * rate);
+}
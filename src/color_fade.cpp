@@ -0,0 +1,95 @@
+#include "color_fade.h"
+#include "lv_7seg.h"
+#include <string.h>
+
+// First half from -> to, second half back, in 8 bits per channel like lv_color_hex().
+bool ColorFades::add(const char *name, lv_obj_t *obj, ColorFadeTarget target, uint32_t from, uint32_t to,
+                     uint32_t period_ms)
+{
+    if (count >= COLOR_FADE_MAX || find(name)) {
+        return false;
+    }
+    Fade &fade = fades[count++];
+    fade.name = name;
+    fade.obj = obj;
+    fade.target = target;
+    fade.period_ms = period_ms;
+    fade.running = false;
+    const uint32_t half = COLOR_FADE_STEPS / 2 - 1;
+    for (uint32_t i = 0; i < COLOR_FADE_STEPS; i++) {
+        uint32_t k = i <= half ? i : COLOR_FADE_STEPS - 1 - i;
+        uint8_t r = (((from >> 16) & 0xff) * (half - k) + ((to >> 16) & 0xff) * k) / half;
+        uint8_t g = (((from >> 8) & 0xff) * (half - k) + ((to >> 8) & 0xff) * k) / half;
+        uint8_t b = ((from & 0xff) * (half - k) + (to & 0xff) * k) / half;
+        fade.lut[i] = lv_color_make(r, g, b);
+    }
+    fade.applied = fade.lut[COLOR_FADE_STEPS - 1];
+    return true;
+}
+
+bool ColorFades::start(const char *name)
+{
+    Fade *fade = find(name);
+    if (!fade) {
+        return false;
+    }
+    lv_anim_del(fade, step);
+    fade->running = true;
+    fade->applied.full = ~fade->lut[0].full;    // set the first step whatever the object shows
+
+    lv_anim_t anim;
+    lv_anim_init(&anim);
+    lv_anim_set_var(&anim, fade);
+    lv_anim_set_exec_cb(&anim, step);
+    lv_anim_set_values(&anim, 0, COLOR_FADE_STEPS - 1);
+    lv_anim_set_time(&anim, fade->period_ms);
+    lv_anim_set_repeat_count(&anim, LV_ANIM_REPEAT_INFINITE);
+    lv_anim_start(&anim);
+    return true;
+}
+
+void ColorFades::stop(const char *name)
+{
+    Fade *fade = find(name);
+    if (fade && fade->running) {
+        lv_anim_del(fade, step);
+        fade->running = false;
+    }
+}
+
+bool ColorFades::running(const char *name) const
+{
+    const Fade *fade = find(name);
+    return fade && fade->running;
+}
+
+ColorFades::Fade *ColorFades::find(const char *name)
+{
+    for (uint8_t i = 0; i < count; i++) {
+        if (strcmp(fades[i].name, name) == 0) {
+            return &fades[i];
+        }
+    }
+    return nullptr;
+}
+
+const ColorFades::Fade *ColorFades::find(const char *name) const
+{
+    return const_cast<ColorFades *>(this)->find(name);
+}
+
+// lv_anim exec callback, from the LVGL timer handler.
+void ColorFades::step(void *var, int32_t value)
+{
+    Fade *fade = (Fade *)var;
+    lv_color_t color = fade->lut[value & (COLOR_FADE_STEPS - 1)];
+    if (color.full == fade->applied.full) {
+        return;
+    }
+    fade->applied = color;
+    if (fade->target == COLOR_FADE_BG) {
+        lv_obj_set_style_bg_color(fade->obj, color, LV_PART_MAIN);
+    } else {
+        lv_7seg_display_set_color(fade->obj, color);
+    }
+}
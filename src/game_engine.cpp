@@ -0,0 +1,965 @@
+#include "game_engine.h"
+#include <stdio.h>
+#include <string.h>
+
+GameEngine::GameEngine(GameHooks& hooks) :
+    hooks(hooks),
+    wall_first(WALL_FIRST_ID),
+    wall_last(WALL_LAST_ID),
+    game_state(GAME_IDLE),
+    game_variant(0),
+    current_round(0),
+    countdown_step(0),
+    waitforbuzzer_index(0xffff),
+    waitforbuzzer_id(0),
+    previous_index(0xffff),
+    round_penalties(0),
+    game_penalties(0),
+    round_hold(false),
+    total_us(0),
+    buzzer_time_us(-1),
+    local_time(0),
+    state_deadline(0),
+    next_can_packet(0),
+    next_display(0),
+    next_deadline_us(0),
+    next_sync(0),
+    next_discovery(0),
+    discovery_count(0),
+    lit_us(0),
+    sync_seq(0),
+    calibration(false),
+    calibrate_id(0),
+    ping_seq(0),
+    pings_sent(0),
+    ping_sent_us(-1),
+    next_ping(0),
+    race_mode(false),
+    race_shared(false),
+    race_group(0)
+{
+    memset(deck, 0, sizeof(deck));
+    memset(unused_ids, 0, sizeof(unused_ids));
+    checkpoint.state = GAME_IDLE;
+    for (uint8_t i = 0; i < sizeof(sync_sent_us) / sizeof(sync_sent_us[0]); i++) {
+        sync_sent_us[i] = -1;
+    }
+}
+
+uint8_t GameEngine::add_buzzer(uint16_t id, bool used)
+{
+    uint8_t slot = buzzers.add(id, used);
+    if (slot != BUZZER_NO_SLOT) {
+        clocks[slot].reset();
+        hooks.buzzer_set_changed(buzzers.size());
+        hooks.buzzer_changed(slot);
+    }
+    return slot;
+}
+
+void GameEngine::set_used(uint16_t id, bool used)
+{
+    if (id >= BUZZER_ID_SPACE) {
+        return;
+    }
+    if (used) {
+        unused_ids[id / 32] &= ~(1u << (id % 32));
+    } else {
+        unused_ids[id / 32] |= 1u << (id % 32);
+    }
+    uint8_t slot = buzzers.slot_of(id);
+    if (slot != BUZZER_NO_SLOT && buzzers[slot].used_in_game != used) {
+        buzzers[slot].used_in_game = used;
+        hooks.buzzer_changed(slot);
+    }
+}
+
+// Only while idle: slots shift down, which must not happen under a running round.
+void GameEngine::retire_buzzers(int64_t now)
+{
+    bool retired = false;
+    uint16_t lowest = 0;
+    for (int i = buzzers.size() - 1; i >= 0; i--) {
+        const BuzzerButton &buzzer = buzzers[i];
+        if (!buzzer.bus_offline || !game_time_reached(now, buzzer.last_seen + TIME_US(GAME_RETIRE_MS))) {
+            continue;
+        }
+        printf("!!!! Buzzer %d retired\n", buzzer.buzzer_id);
+        buzzers.remove(i);
+        for (uint16_t j = i; j < buzzers.size(); j++) {
+            clocks[j] = clocks[j + 1];
+        }
+        lowest = i;
+        retired = true;
+    }
+    if (!retired) {
+        return;
+    }
+    hooks.buzzer_set_changed(buzzers.size());
+    for (uint16_t j = lowest; j < buzzers.size(); j++) {
+        hooks.buzzer_changed(j);
+    }
+}
+
+void GameEngine::handle(const GameEvent& event, int64_t now)
+{
+    switch (event.type) {
+        case GAME_EVENT_COMMAND:
+            on_command(event, now);
+            break;
+        case GAME_EVENT_RX:
+        case GAME_EVENT_TIMER:
+            break;
+    }
+    on_timers(now);
+    advance(now);
+    update_deadline();
+}
+
+bool GameEngine::handle_frame(const BuzzerFrame& frame)
+{
+    if (!owns(frame.buzzer_id)) {
+        return false;   // another display's wall
+    }
+    uint8_t i = buzzers.slot_of(frame.buzzer_id);
+    if (i == BUZZER_NO_SLOT) {
+        if (frame.kind != BUZZER_FRAME_STATUS || frame.buzzer_id == 0) {
+            return false;
+        }
+        i = add_buzzer(frame.buzzer_id, used(frame.buzzer_id));
+        if (i == BUZZER_NO_SLOT) {
+            return false;
+        }
+        printf("!!!! Buzzer %d discovered\n", frame.buzzer_id);
+    }
+    BuzzerButton &buzzer = buzzers[i];
+
+    switch (frame.kind) {
+        case BUZZER_FRAME_STATUS:
+            register_press(i, frame.press_id, TIME_US(frame.press_millis));
+            if (i == waitforbuzzer_index) {
+                buzzer_time_us = TIME_US(frame.press_millis);
+            }
+            break;
+
+        case BUZZER_FRAME_SYNC_REPLY:
+            {
+                int64_t sent_us = sync_sent_us[frame.press_id % 4];
+                if (sent_us >= 0 && (uint8_t)(sync_seq - frame.press_id) < 4) {
+                    clocks[i].add_pair(frame.press_millis, sent_us);
+                }
+            }
+            break;
+
+        case BUZZER_FRAME_TIMED_PRESS:
+            {
+                // Without a clock fit yet, the receive time is the best estimate.
+                int64_t press_us = clocks[i].valid() ? clocks[i].to_display_us(frame.press_millis) : frame.rx_time_us;
+                int64_t reaction_us = press_us - lit_us;
+                if (reaction_us < 0) {
+                    reaction_us = 0;
+                }
+                register_press(i, frame.press_id, reaction_us);
+            }
+            break;
+
+        case BUZZER_FRAME_RELEASE:
+            break;
+
+        case BUZZER_FRAME_BATTERY:
+            buzzer.battery_mv = frame.press_millis;
+            break;
+
+        case BUZZER_FRAME_ECHO:
+            if (calibration && frame.buzzer_id == calibrate_id && frame.press_id == ping_seq && ping_sent_us >= 0) {
+                int64_t rtt_us = frame.rx_time_us - ping_sent_us;
+                if (rtt_us >= 0 && rtt_us <= LATENCY_MAX_RTT_US) {
+                    probe.add(rtt_us);
+                }
+                ping_sent_us = -1;
+            }
+            break;
+    }
+
+    buzzer.last_press_online = frame.rx_time_us;
+    buzzer.last_seen = buzzer.last_press_online;
+    set_offline(i, false);
+    return true;
+}
+
+void GameEngine::register_press(uint8_t i, uint8_t press_id, int64_t press_us)
+{
+    BuzzerButton &buzzer = buzzers[i];
+    PressOrder order = buzzer.presses.classify(press_id);
+    if (order == PRESS_DUPLICATE || order == PRESS_STALE) {
+        return;
+    }
+    if (game_state != GAME_WAIT_FOR_BUZZER2) {
+        // Absorb it, so a press from before the light (or an id the lost "all off" did not
+        // reset) does not count once the round is running.
+        printf("!!! press buzzer_id %d, id %d not in game\n", buzzer.buzzer_id, press_id);
+        buzzer.presses.accept(press_id);
+        return;
+    }
+    if (buzzer.last_press_online == 0) {
+        return;
+    }
+    uint16_t gaps = buzzer.presses.gaps();
+    if (buzzer.presses.accept(press_id) == PRESS_LATE) {
+        printf("!!! press buzzer_id %d, id %d out of order\n", buzzer.buzzer_id, press_id);
+    }
+    if (buzzer.presses.gaps() > gaps) {
+        printf("!!! press buzzer_id %d, %d press ids lost before id %d\n", buzzer.buzzer_id, buzzer.presses.gaps() - gaps, press_id);
+    }
+    press_us -= latency_table.compensation_us(buzzer.buzzer_id);
+    if (press_us < 0) {
+        press_us = 0;
+    }
+    if (race_mode) {
+        race_press(i, press_us);
+        return;
+    }
+    if (!buzzer.pressed) {
+        buzzer.pressed = true;
+        buzzer.press_time_us = press_us;
+        hooks.buzzer_changed(i);
+    }
+}
+
+void GameEngine::on_command(const GameEvent& event, int64_t now)
+{
+    switch (event.command) {
+        case GAME_CMD_START:
+            if (game_state == GAME_IDLE) {
+                game_variant = event.arg != GAME_MODE_RACE && event.arg < GAME_MODE_COUNT ? event.arg : 1;
+                race_setup(0);
+                hooks.show_game_screen();
+                enter(GAME_READYSETGO, now);
+            }
+            break;
+
+        case GAME_CMD_START_RACE:
+        case GAME_CMD_START_RACE_SHARED:
+            if (game_state == GAME_IDLE) {
+                game_variant = GAME_MODE_RACE;
+                race_shared = event.command == GAME_CMD_START_RACE_SHARED;
+                race_setup(event.arg);
+                hooks.show_game_screen();
+                enter(GAME_READYSETGO, now);
+            }
+            break;
+
+        case GAME_CMD_CANCEL:
+            calibration = false;
+            send_all_off(TX_PRIORITY_GAME);
+            waitforbuzzer_index = 0xffff;
+            waitforbuzzer_id = 0;
+            enter(GAME_IDLE, now);
+            hooks.show_start_screen("Spiel abgebrochen");
+            break;
+
+        case GAME_CMD_RESUME:
+            if (game_state == GAME_IDLE && resumable() && !resume(now)) {
+                checkpoint.state = GAME_IDLE;
+                hooks.show_start_screen("Spiel kann nicht fortgesetzt werden");
+            }
+            break;
+
+        case GAME_CMD_CALIBRATE:
+            if (game_state == GAME_IDLE && !calibration) {
+                calibration = true;
+                calibrate_id = 0;
+                latency_table.clear_measured();
+                calibrate_next(now);
+            }
+            break;
+
+        case GAME_CMD_OK:
+            if (game_state == GAME_END) {
+                enter(GAME_IDLE, now);
+                hooks.show_start_screen("");
+            }
+            break;
+
+        case GAME_CMD_TEST:
+            if (game_state == GAME_WAIT_FOR_BUZZER2 && race_mode) {
+                for (uint8_t p = 0; p < race_board.player_count(); p++) {
+                    if (race_board.racing(p)) {
+                        race_press(race_targets[p], now - local_time);
+                        break;
+                    }
+                }
+            } else if (game_state == GAME_WAIT_FOR_BUZZER2 && waitforbuzzer_index < buzzers.size()) {
+                buzzers[waitforbuzzer_index].pressed = true;
+                buzzers[waitforbuzzer_index].press_time_us = now - local_time;
+                hooks.buzzer_changed(waitforbuzzer_index);
+            }
+            break;
+    }
+}
+
+void GameEngine::on_timers(int64_t now)
+{
+    for (uint16_t i = 0; i < buzzers.size(); i++) {
+        BuzzerButton &buzzer = buzzers[i];
+        if (!buzzer.bus_offline && game_time_reached(now, buzzer.last_press_online + TIME_US(GAME_OFFLINE_TIMEOUT_MS) + 1)) {
+            set_offline(i, true);
+        }
+    }
+
+    if (game_time_reached(now, next_can_packet)) {
+        next_can_packet = now + TIME_US(GAME_KEEPALIVE_PERIOD_MS);
+        switch (game_state) {
+            case GAME_IDLE:
+                send_all_off(TX_PRIORITY_KEEPALIVE);
+                break;
+            case GAME_WAIT_FOR_BUZZER2:
+                if (race_mode) {
+                    race_light_on(TX_PRIORITY_KEEPALIVE);
+                } else {
+                    send_light_on(TX_PRIORITY_KEEPALIVE);
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (game_time_reached(now, next_sync)) {
+        next_sync = now + TIME_US(TIME_SYNC_PERIOD_MS);
+        send_time_sync();
+    }
+
+    if (game_state == GAME_IDLE) {
+        if (game_time_reached(now, next_discovery)) {
+            discovery_count += discovery_count < DISCOVERY_REPEAT;
+            next_discovery = now + TIME_US(discovery_count < DISCOVERY_REPEAT ? DISCOVERY_REPEAT_MS : DISCOVERY_PERIOD_MS);
+            send_discovery();
+        }
+        retire_buzzers(now);
+    }
+
+    if (calibration) {
+        if (game_state != GAME_IDLE) {
+            calibration = false;
+            printf("!!! latency calibration stopped by a game\n");
+        } else if (game_time_reached(now, next_ping)) {
+            calibrate_step(now);
+        }
+    }
+
+    if (game_state == GAME_WAIT_FOR_BUZZER2 && game_time_reached(now, next_display)) {
+        next_display = now + TIME_US(GAME_DISPLAY_PERIOD_MS);
+        if (buzzer_time_us >= 0) {
+            hooks.show_running(total_us + buzzer_time_us, now);
+        } else {
+            hooks.show_running(total_us + (now - local_time), now);
+        }
+    }
+}
+
+// Run the state machine until it reaches a state that waits for an event or deadline.
+void GameEngine::advance(int64_t now)
+{
+    for (;;) {
+        switch (game_state) {
+            case GAME_READYSETGO:
+                if (!game_time_reached(now, state_deadline)) {
+                    return;
+                }
+                countdown_step++;
+                state_deadline += TIME_US(GAME_COUNTDOWN_STEP_MS);
+                switch (countdown_step) {
+                    case 1:
+                        hooks.show_countdown('2');
+                        hooks.show_message("Auf die Plätze...");
+                        break;
+                    case 2:
+                        hooks.show_countdown('1');
+                        hooks.show_message("Fertig...");
+                        break;
+                    default:
+                        hooks.show_countdown(' ');
+                        hooks.show_message("Los!");
+                        enter(GAME_PREPARING, now);
+                        break;
+                }
+                break;
+
+            case GAME_PREPARING:
+                current_round = 0;
+                total_us = 0;
+                previous_index = 0xffff;
+                memset(deck, 0, sizeof(deck));
+                game_penalties = 0;
+                start_delay.begin(mode(), hooks.random_range(0, 0x7fffffff));
+                for (uint8_t p = 0; p < RACE_MAX_PLAYERS; p++) {
+                    reaction_stats[p].reset();
+                }
+                hooks.show_time(total_us, 0xe4032e);
+                enter(GAME_STARTING, now);
+                break;
+
+            case GAME_STARTING:
+                for (uint16_t i = 0; i < buzzers.size(); i++) {
+                    buzzers[i].clear();
+                    hooks.buzzer_changed(i);
+                }
+                current_round++;
+                round_penalties = 0;
+                if (race_mode && current_round <= mode().rounds) {
+                    if (!race_start_round()) {
+                        hooks.show_message("Keine Buzzer vorhanden!");
+                        enter(GAME_FINISHED, now);
+                        break;
+                    }
+                    hooks.show_round(current_round);
+                    enter(GAME_WAIT_FOR_BUZZER1, now);
+                    state_deadline = round_hold ? GAME_HELD : now + TIME_US(start_delay.next_ms());
+                } else if (current_round <= mode().rounds) {
+                    uint8_t available_buzzers[BUZZER_REGISTRY_CAPACITY];
+                    uint16_t available_count = 0;
+                    for (uint16_t i = 0; i < buzzers.size(); i++) {
+                        if (buzzers[i].used_in_game) {
+                            available_buzzers[available_count++] = i;
+                        }
+                    }
+                    if (available_count == 0) {
+                        hooks.show_message("Keine Buzzer vorhanden!");
+                        enter(GAME_FINISHED, now); // No available buzzers
+                        break;
+                    }
+                    waitforbuzzer_index = select_buzzer(available_buzzers, available_count);
+                    waitforbuzzer_id = buzzers[waitforbuzzer_index].buzzer_id;
+                    previous_index = waitforbuzzer_index;
+                    hooks.show_round(current_round);
+                    enter(GAME_WAIT_FOR_BUZZER1, now);
+                    state_deadline = round_hold ? GAME_HELD : now + TIME_US(start_delay.next_ms());
+                } else {
+                    hooks.show_message("Spiel beendet!");
+                    enter(GAME_FINISHED, now);
+                }
+                break;
+
+            case GAME_WAIT_FOR_BUZZER1:
+                {
+                    if (!game_time_reached(now, state_deadline)) {
+                        return;
+                    }
+                    local_time = now;
+                    lit_us = hooks.now_us();
+                    buzzer_time_us = -1;
+                    next_can_packet = now + TIME_US(GAME_KEEPALIVE_PERIOD_MS);
+                    if (race_mode) {
+                        for (uint8_t p = 0; p < race_board.player_count(); p++) {
+                            buzzers[race_targets[p]].waiting_for_press = true;
+                        }
+                        race_light_on(TX_PRIORITY_GAME);
+                        hooks.show_message("Los!");
+                    } else {
+                        buzzers[waitforbuzzer_index].waiting_for_press = true;
+                        send_light_on(TX_PRIORITY_GAME);
+
+                        char meldung[32];
+                        snprintf(meldung, sizeof(meldung), "Buzzer %d !!!", waitforbuzzer_id);
+                        hooks.show_message(meldung);
+                    }
+                    next_display = now;
+                    enter(GAME_WAIT_FOR_BUZZER2, now);
+                }
+                break;
+
+            case GAME_WAIT_FOR_BUZZER2:
+                if (race_mode) {
+                    // presses are scored as they arrive in race_press()
+                    if (!race_board.round_complete()) {
+                        if (!game_time_reached(now, local_time + TIME_US(GAME_RACE_TIMEOUT_MS))) {
+                            return;
+                        }
+                        race_board.close_round(TIME_US(GAME_RACE_TIMEOUT_MS));
+                    }
+                    hooks.show_race(race_board, false);
+                    enter(GAME_ROUND_COMPLETE, now);
+                    break;
+                }
+                for (uint16_t i = 0; i < buzzers.size(); i++) {
+                    BuzzerButton &buzzer = buzzers[i];
+                    if (!buzzer.pressed) {
+                        continue;
+                    }
+                    if (buzzer.waiting_for_press) {
+                        total_us += buzzer.press_time_us;
+                        add_reaction(0, buzzer.buzzer_id, buzzer.press_time_us);
+                        enter(GAME_ROUND_COMPLETE, now);
+                        break;
+                    }
+                    if (mode().penalty != GAME_PENALTY_NONE) {
+                        round_penalties += round_penalties < 0xff;
+                        game_penalties += game_penalties < 0xff;
+                        total_us += TIME_US(game_mode_penalty(mode(), round_penalties)); // Add penalty for incorrect buzzer
+                        printf("!!! penalty for buzzer %d\n", buzzer.buzzer_id);
+                    }
+                    buzzer.pressed = false;
+                    hooks.buzzer_changed(i);
+                }
+                if (game_state == GAME_WAIT_FOR_BUZZER2) {
+                    return;
+                }
+                break;
+
+            case GAME_ROUND_COMPLETE:
+                waitforbuzzer_index = 0xffff;
+                waitforbuzzer_id = 0;
+                send_all_off(TX_PRIORITY_GAME);
+                enter(GAME_STARTING, now);
+                break;
+
+            case GAME_FINISHED:
+                print_stats();
+                if (race_mode) {
+                    hooks.show_race(race_board, true);
+                    hooks.show_finished(race_board.player(race_board.leader(0)).total_us);
+                } else {
+                    hooks.show_finished(total_us);
+                }
+                enter(GAME_END, now);
+                break;
+
+            case GAME_IDLE:
+            case GAME_END:
+                // wait for a command
+                return;
+        }
+    }
+}
+
+void GameEngine::enter(GameState state, int64_t now)
+{
+    game_state = state;
+    hooks.state_changed(state, total_us);
+    if (state == GAME_STARTING) {
+        save_checkpoint();
+    }
+    checkpoint.state = state;
+    game_snapshot_seal(checkpoint);
+    hooks.save_snapshot(checkpoint);
+    if (state == GAME_READYSETGO) {
+        countdown_step = 0;
+        state_deadline = now + TIME_US(GAME_COUNTDOWN_STEP_MS);
+        hooks.show_countdown('3');
+        hooks.show_message("Bereit?");
+    }
+}
+
+void GameEngine::update_deadline()
+{
+    int64_t deadline = next_can_packet;
+    auto consider = [&](int64_t candidate) {
+        if (candidate < deadline) {
+            deadline = candidate;
+        }
+    };
+
+    consider(next_sync);
+    if (game_state == GAME_IDLE) {
+        consider(next_discovery);
+    }
+    if (calibration) {
+        consider(next_ping);
+    }
+    if (game_state == GAME_READYSETGO || game_state == GAME_WAIT_FOR_BUZZER1) {
+        consider(state_deadline);
+    }
+    if (game_state == GAME_WAIT_FOR_BUZZER2) {
+        consider(next_display);
+        if (race_mode) {
+            consider(local_time + TIME_US(GAME_RACE_TIMEOUT_MS));
+        }
+    }
+    for (const BuzzerButton &buzzer : buzzers) {
+        if (!buzzer.bus_offline) {
+            consider(buzzer.last_press_online + TIME_US(GAME_OFFLINE_TIMEOUT_MS) + 1);
+        } else if (game_state == GAME_IDLE) {
+            consider(buzzer.last_seen + TIME_US(GAME_RETIRE_MS));
+        }
+    }
+    next_deadline_us = deadline;
+}
+
+void GameEngine::send_all_off(TxPriority priority)
+{
+    uint8_t data[8] = {0};
+    data[0] = 0x00;
+    data[1] = wall_first;
+    data[2] = wall_last;
+    hooks.send_can(TX_ID_ALL_OFF, data, 3, priority);
+}
+
+void GameEngine::send_light_on(TxPriority priority)
+{
+    if (waitforbuzzer_index >= buzzers.size()) {
+        return;
+    }
+    uint8_t data[8] = {0};
+    data[0] = 0x01;
+    hooks.send_can(buzzers[waitforbuzzer_index].buzzer_id | TX_ID_LIGHT_ON, data, 1, priority);
+}
+
+// Pick this round's buzzer from the `count` used slots in `available`, by the mode's rule.
+uint16_t GameEngine::select_buzzer(const uint8_t* available, uint16_t count)
+{
+    switch (mode().selection) {
+        case GAME_SELECT_NO_REPEAT:
+            {
+                uint16_t previous = count;
+                for (uint16_t j = 0; j < count; j++) {
+                    if (available[j] == previous_index) {
+                        previous = j;
+                    }
+                }
+                if (previous < count && count > 1) {
+                    uint16_t k = hooks.random_range(0, count - 1);
+                    return available[k < previous ? k : k + 1];
+                }
+            }
+            break;
+
+        case GAME_SELECT_DECK:
+            {
+                uint8_t fresh[BUZZER_REGISTRY_CAPACITY];
+                uint16_t fresh_count = 0;
+                for (uint16_t j = 0; j < count; j++) {
+                    if (!(deck[available[j] / 32] & (1u << (available[j] % 32)))) {
+                        fresh[fresh_count++] = available[j];
+                    }
+                }
+                if (fresh_count == 0) {
+                    memset(deck, 0, sizeof(deck));
+                    memcpy(fresh, available, count);
+                    fresh_count = count;
+                }
+                uint8_t slot = fresh[hooks.random_range(0, fresh_count)];
+                deck[slot / 32] |= 1u << (slot % 32);
+                return slot;
+            }
+
+        case GAME_SELECT_RANDOM:
+            break;
+    }
+    return available[hooks.random_range(0, count)];
+}
+
+// Split the used buzzers into `players` equal groups of consecutive slots. 0 disables race mode.
+void GameEngine::race_setup(uint8_t players)
+{
+    uint16_t used = 0;
+    for (uint16_t i = 0; i < buzzers.size(); i++) {
+        buzzers[i].player = BUZZER_NO_PLAYER;
+        if (buzzers[i].used_in_game) {
+            race_slots[used++] = i;
+        }
+    }
+    if (players > RACE_MAX_PLAYERS) {
+        players = RACE_MAX_PLAYERS;
+    }
+    if (players > used) {
+        players = used;
+    }
+    race_mode = players > 0;
+    race_group = race_mode ? used / players : 0;
+    race_board.start(players);
+    for (uint16_t n = 0; n < (uint16_t)players * race_group; n++) {
+        buzzers[race_slots[n]].player = n / race_group;
+    }
+}
+
+bool GameEngine::race_start_round()
+{
+    if (race_board.player_count() == 0) {
+        return false;
+    }
+    race_board.start_round();
+    uint8_t shared = hooks.random_range(0, race_group);
+    for (uint8_t p = 0; p < race_board.player_count(); p++) {
+        uint8_t k = race_shared ? shared : hooks.random_range(0, race_group);
+        race_targets[p] = race_slots[p * race_group + k];
+    }
+    return true;
+}
+
+void GameEngine::race_press(uint8_t i, int64_t reaction_us)
+{
+    BuzzerButton &buzzer = buzzers[i];
+    uint8_t player = buzzer.player;
+    if (!race_board.racing(player)) {
+        return;
+    }
+    if (buzzer.waiting_for_press) {
+        buzzer.waiting_for_press = false;
+        buzzer.pressed = true;
+        buzzer.press_time_us = reaction_us;
+        race_board.finish(player, reaction_us);
+        add_reaction(player, buzzer.buzzer_id, reaction_us);
+    } else {
+        race_board.penalty(player, TIME_US(game_mode_penalty(mode(), 1)));
+        printf("!!! penalty for player %d, buzzer %d\n", player + 1, buzzer.buzzer_id);
+    }
+    hooks.buzzer_changed(i);
+    hooks.show_race(race_board, false);
+}
+
+void GameEngine::race_light_on(TxPriority priority)
+{
+    uint8_t data[8] = {0};
+    data[0] = 0x01;
+    for (uint8_t p = 0; p < race_board.player_count(); p++) {
+        if (race_board.racing(p)) {
+            hooks.send_can(buzzers[race_targets[p]].buzzer_id | TX_ID_LIGHT_ON, data, 1, priority);
+        }
+    }
+}
+
+void GameEngine::send_time_sync()
+{
+    int64_t now_us = hooks.now_us();
+    uint32_t stamp = (uint32_t)now_us;
+    uint8_t data[8] = {0};
+    sync_seq++;
+    sync_sent_us[sync_seq % 4] = now_us;
+    data[0] = sync_seq;
+    data[1] = wall_first;
+    data[2] = wall_last;
+    data[4] = stamp >> 24;
+    data[5] = stamp >> 16;
+    data[6] = stamp >> 8;
+    data[7] = stamp;
+    hooks.send_can(TIME_SYNC_ID, data, 8, TX_PRIORITY_GAME);
+}
+
+void GameEngine::send_discovery()
+{
+    uint8_t data[8] = {0};
+    data[0] = DISCOVERY_SLOT_100US;
+    data[1] = BUZZER_PAYLOAD_VERSION;
+    data[2] = wall_first;
+    data[3] = wall_last;
+    hooks.send_can(DISCOVERY_ID, data, 4, TX_PRIORITY_KEEPALIVE);
+}
+
+void GameEngine::set_offline(uint16_t index, bool offline)
+{
+    BuzzerButton &buzzer = buzzers[index];
+    if (buzzer.bus_offline == offline) {
+        return;
+    }
+    buzzer.bus_offline = offline;
+    printf(offline ? "!!!! Buzzer %d went offline\n" : "!!!! Buzzer %d went online\n", buzzer.buzzer_id);
+    hooks.buzzer_changed(index);
+}
+
+void GameEngine::add_reaction(uint8_t player, uint16_t buzzer_id, int64_t reaction_us)
+{
+    if (reaction_stats[player].add(reaction_us)) {
+        printf("!!! anticipated press, buzzer %d after %lld us\n", buzzer_id, (long long)reaction_us);
+    }
+}
+
+void GameEngine::print_stats()
+{
+    uint8_t players = race_mode ? race_board.player_count() : 1;
+    for (uint8_t p = 0; p < players; p++) {
+        const ReactionStats &stats = reaction_stats[p];
+        printf("player %d: %d reactions, mean %.1f ms, sd %.1f ms, best %.1f ms, %d anticipated\n", p + 1,
+               stats.count(), stats.mean_us() / 1000, stats.stddev_us() / 1000, stats.min_us() / 1000.0,
+               stats.anticipations());
+    }
+}
+
+bool GameEngine::release(int64_t lit_us)
+{
+    if (!held()) {
+        return false;
+    }
+    state_deadline = lit_us;
+    if (lit_us < next_deadline_us) {
+        next_deadline_us = lit_us;
+    }
+    return true;
+}
+
+// One ping per step. After the last one the step waits one more gap for its echo, then moves on.
+void GameEngine::calibrate_step(int64_t now)
+{
+    if (pings_sent < LATENCY_PINGS) {
+        uint8_t data[8] = {0};
+        ping_seq++;
+        data[0] = calibrate_id;
+        data[1] = ping_seq;
+        ping_sent_us = hooks.now_us();
+        hooks.send_can(LATENCY_PING_ID, data, 2, TX_PRIORITY_GAME);
+        pings_sent++;
+        next_ping = now + TIME_US(LATENCY_PING_GAP_MS);
+        return;
+    }
+    if (probe.size() >= LATENCY_MIN_ECHOES) {
+        latency_table.set_measured(calibrate_id, probe.median_us(), probe.jitter_us());
+    } else {
+        printf("!!! buzzer %d answered %d of %d latency pings\n", calibrate_id, probe.size(), LATENCY_PINGS);
+    }
+    calibrate_next(now);
+}
+
+// Online buzzers in id order, so a buzzer retired meanwhile does not make the walk skip another.
+void GameEngine::calibrate_next(int64_t now)
+{
+    uint16_t next = 0;
+    for (const BuzzerButton &buzzer : buzzers) {
+        if (!buzzer.bus_offline && buzzer.buzzer_id > calibrate_id && buzzer.buzzer_id < LATENCY_IDS &&
+            (next == 0 || buzzer.buzzer_id < next)) {
+            next = buzzer.buzzer_id;
+        }
+    }
+    if (next != 0) {
+        calibrate_id = next;
+        pings_sent = 0;
+        probe.reset();
+        next_ping = now;
+        char message[32];
+        snprintf(message, sizeof(message), "Kalibriere Buzzer %d", next);
+        hooks.show_message(message);
+        return;
+    }
+
+    calibration = false;
+    latency_table.normalize();
+    for (uint16_t id = 0; id < LATENCY_IDS; id++) {
+        const LatencyEntry &entry = latency_table[id];
+        if (entry.rtt_us) {
+            printf("latency buzzer %d: round trip %u us, jitter %u us, compensation %u us\n", id, entry.rtt_us,
+                   entry.jitter_us, entry.compensation_us);
+        }
+    }
+    hooks.latency_calibrated(latency_table);
+    hooks.show_message("Kalibrierung beendet");
+}
+
+// Entering GAME_STARTING: the previous round is fully scored and the next one not drawn yet.
+void GameEngine::save_checkpoint()
+{
+    GameSnapshot &s = checkpoint;
+    s.variant = game_variant;
+    s.round = current_round;
+    s.penalties = game_penalties;
+    s.race_players = race_mode ? race_board.player_count() : 0;
+    s.race_shared = race_shared;
+    s.race_group = race_group;
+    s.buzzer_count = buzzers.size();
+    s.previous_index = previous_index;
+    s.total_us = total_us;
+    memcpy(s.deck, deck, sizeof(deck));
+    s.delay = start_delay.save();
+    s.race = race_board;
+    for (uint8_t p = 0; p < RACE_MAX_PLAYERS; p++) {
+        s.stats[p] = reaction_stats[p];
+    }
+    for (uint16_t i = 0; i < buzzers.size(); i++) {
+        s.buzzers[i].buzzer_id = buzzers[i].buzzer_id;
+        s.buzzers[i].used_in_game = buzzers[i].used_in_game;
+        s.buzzers[i].player = buzzers[i].player;
+    }
+}
+
+bool GameEngine::load_snapshot(const GameSnapshot& snapshot)
+{
+    if (game_state != GAME_IDLE || !game_snapshot_valid(snapshot)) {
+        return false;
+    }
+    checkpoint = snapshot;
+    if (!resumable()) {
+        checkpoint.state = GAME_IDLE;
+        return false;
+    }
+    return true;
+}
+
+bool GameEngine::resumable() const
+{
+    switch (checkpoint.state) {
+        case GAME_STARTING:
+        case GAME_WAIT_FOR_BUZZER1:
+        case GAME_WAIT_FOR_BUZZER2:
+        case GAME_ROUND_COMPLETE:
+            return checkpoint.variant < GAME_MODE_COUNT && checkpoint.round <= game_mode(checkpoint.variant).rounds &&
+                   checkpoint.race_players <= RACE_MAX_PLAYERS;
+        default:
+            return false;
+    }
+}
+
+// Continue the checkpoint's game with its next round. The buzzers may have been discovered in a
+// different order since the reset, so every slot reference is mapped through the buzzer ids.
+bool GameEngine::resume(int64_t now)
+{
+    const GameSnapshot &s = checkpoint;
+    uint8_t slots[BUZZER_REGISTRY_CAPACITY];
+    uint16_t race_count = 0;
+    for (uint8_t n = 0; n < s.buzzer_count; n++) {
+        const GameSnapshotBuzzer &saved = s.buzzers[n];
+        slots[n] = buzzers.slot_of(saved.buzzer_id);
+        if (slots[n] == BUZZER_NO_SLOT) {
+            slots[n] = add_buzzer(saved.buzzer_id, saved.used_in_game);
+        }
+        if (slots[n] == BUZZER_NO_SLOT) {
+            return false;
+        }
+        race_count += saved.player != BUZZER_NO_PLAYER;
+    }
+    if (s.race_players && (s.race_group == 0 || race_count != (uint16_t)s.race_players * s.race_group)) {
+        return false;
+    }
+
+    for (uint16_t i = 0; i < buzzers.size(); i++) {
+        buzzers[i].player = BUZZER_NO_PLAYER;
+    }
+    memset(deck, 0, sizeof(deck));
+    previous_index = 0xffff;
+    race_count = 0;
+    for (uint8_t n = 0; n < s.buzzer_count; n++) {
+        BuzzerButton &buzzer = buzzers[slots[n]];
+        buzzer.used_in_game = s.buzzers[n].used_in_game;
+        buzzer.player = s.buzzers[n].player;
+        if (buzzer.player != BUZZER_NO_PLAYER) {
+            race_slots[race_count++] = slots[n];   // saved in slot order, so grouped by player
+        }
+        if (s.deck[n / 32] & (1u << (n % 32))) {
+            deck[slots[n] / 32] |= 1u << (slots[n] % 32);
+        }
+        if (n == s.previous_index) {
+            previous_index = slots[n];
+        }
+        hooks.buzzer_changed(slots[n]);
+    }
+
+    game_variant = s.variant;
+    current_round = s.round;
+    game_penalties = s.penalties;
+    total_us = s.total_us;
+    start_delay.restore(mode(), s.delay);
+    for (uint8_t p = 0; p < RACE_MAX_PLAYERS; p++) {
+        reaction_stats[p] = s.stats[p];
+    }
+    race_mode = s.race_players > 0;
+    race_shared = s.race_shared;
+    race_group = s.race_group;
+    race_board = s.race;
+
+    printf("Resuming %s after round %d, total %lld us\n", mode().name, current_round, (long long)total_us);
+    hooks.show_game_screen();
+    hooks.show_time(total_us, 0xe4032e);
+    if (race_mode) {
+        hooks.show_race(race_board, false);
+    }
+    send_all_off(TX_PRIORITY_GAME);
+    enter(GAME_STARTING, now);
+    return true;
+}
@@ -0,0 +1,34 @@
+#include "game_snapshot.h"
+
+// Half-byte table: 64 bytes of flash, two lookups per byte. The snapshot is written a few
+// times per round, so this is fast enough and keeps the table out of the way.
+static const uint32_t crc32_nibble[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+uint32_t game_snapshot_crc(const GameSnapshot& snapshot)
+{
+    const uint8_t *p = (const uint8_t *)&snapshot;
+    uint32_t crc = 0xffffffff;
+    for (size_t i = 0; i < offsetof(GameSnapshot, crc); i++) {
+        crc ^= p[i];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0f];
+        crc = (crc >> 4) ^ crc32_nibble[crc & 0x0f];
+    }
+    return ~crc;
+}
+
+void game_snapshot_seal(GameSnapshot& snapshot)
+{
+    snapshot.magic = GAME_SNAPSHOT_MAGIC;
+    snapshot.version = GAME_SNAPSHOT_VERSION;
+    snapshot.size = sizeof(GameSnapshot);
+    snapshot.crc = game_snapshot_crc(snapshot);
+}
+
+bool game_snapshot_valid(const GameSnapshot& snapshot)
+{
+    return snapshot.magic == GAME_SNAPSHOT_MAGIC && snapshot.version == GAME_SNAPSHOT_VERSION &&
+           snapshot.size == sizeof(GameSnapshot) && snapshot.crc == game_snapshot_crc(snapshot);
+}
@@ -0,0 +1,111 @@
+#include "latency_table.h"
+#include <math.h>
+#include <string.h>
+
+void LatencyProbe::add(uint32_t rtt_us)
+{
+    if (count < LATENCY_PINGS) {
+        samples[count++] = rtt_us;
+    }
+}
+
+// Insertion sort of a copy, at most LATENCY_PINGS samples.
+uint32_t LatencyProbe::median_us() const
+{
+    if (count == 0) {
+        return 0;
+    }
+    uint32_t sorted[LATENCY_PINGS];
+    for (uint8_t i = 0; i < count; i++) {
+        uint8_t pos = i;
+        while (pos > 0 && sorted[pos - 1] > samples[i]) {
+            sorted[pos] = sorted[pos - 1];
+            pos--;
+        }
+        sorted[pos] = samples[i];
+    }
+    return count & 1 ? sorted[count / 2] : (sorted[count / 2 - 1] + sorted[count / 2]) / 2;
+}
+
+uint32_t LatencyProbe::jitter_us() const
+{
+    if (count < 2) {
+        return 0;
+    }
+    double mean = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        mean += samples[i];
+    }
+    mean /= count;
+    double m2 = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        m2 += (samples[i] - mean) * (samples[i] - mean);
+    }
+    return (uint32_t)(sqrt(m2 / (count - 1)) + 0.5);
+}
+
+void LatencyTable::clear()
+{
+    magic = 0;
+    version = 0;
+    size = 0;
+    memset(entries, 0, sizeof(entries));
+}
+
+void LatencyTable::clear_measured()
+{
+    for (LatencyEntry &entry : entries) {
+        entry.rtt_us = 0;
+        entry.jitter_us = 0;
+    }
+}
+
+void LatencyTable::set_measured(uint16_t buzzer_id, uint32_t rtt_us, uint32_t jitter_us)
+{
+    if (buzzer_id >= LATENCY_IDS) {
+        return;
+    }
+    entries[buzzer_id].rtt_us = rtt_us < 0xffff ? rtt_us : 0xffff;
+    entries[buzzer_id].jitter_us = jitter_us < 0xffff ? jitter_us : 0xffff;
+}
+
+void LatencyTable::set_compensation(uint16_t buzzer_id, uint16_t compensation_us)
+{
+    if (buzzer_id < LATENCY_IDS) {
+        entries[buzzer_id].compensation_us = compensation_us;
+    }
+}
+
+void LatencyTable::normalize()
+{
+    uint16_t fastest = 0xffff;
+    for (const LatencyEntry &entry : entries) {
+        if (entry.rtt_us != 0 && entry.rtt_us < fastest) {
+            fastest = entry.rtt_us;
+        }
+    }
+    for (LatencyEntry &entry : entries) {
+        entry.compensation_us = entry.rtt_us != 0 ? (entry.rtt_us - fastest) / 2 : 0;
+    }
+}
+
+uint16_t LatencyTable::calibrated() const
+{
+    uint16_t n = 0;
+    for (const LatencyEntry &entry : entries) {
+        n += entry.rtt_us != 0;
+    }
+    return n;
+}
+
+void LatencyTable::seal()
+{
+    magic = LATENCY_TABLE_MAGIC;
+    version = LATENCY_TABLE_VERSION;
+    size = sizeof(LatencyTable);
+}
+
+bool LatencyTable::valid() const
+{
+    return magic == LATENCY_TABLE_MAGIC && version == LATENCY_TABLE_VERSION && size == sizeof(LatencyTable);
+}
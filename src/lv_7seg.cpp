@@ -1,5 +1,13 @@
 #include "lv_7seg.h"
-#include "esp_log.h"
+#include <src/draw/sw/lv_draw_sw.h>
+#include <math.h>
+#include <stdlib.h>
+#ifdef ESP_PLATFORM
+#include <esp_heap_caps.h>
+#endif
+
+#define MY_CLASS &lv_7seg_class
+#define DISPLAY_CLASS &lv_7seg_display_class
 
 static const uint8_t SEGMENTS_FOR_DIGIT[10] = {
     // bits: gfedcba  (bit0 = a, bit1 = b, ... bit6 = g)
@@ -24,156 +32,685 @@ static const uint8_t SEGMENTS_FOR_DIGIT[10] = {
     // 9
     0b01101111
 };
+#define SEGMENTS_MINUS  (0b01000000)
+
+#define SLANT           (0.1f)          // horizontal shift per pixel of height, LV_7SEG_STYLE_SLANTED
+#define AA_SUBSAMPLES   (8)             // per axis, only for pixels an edge passes through
+#define GHOST_OPA       (LV_OPA_10)
+#define GLOW_OPA        (LV_OPA_60)
+#define MASK_SHAPE      (LV_7SEG_STYLE_SLANTED | LV_7SEG_STYLE_GLOW)    // style bits the masks depend on
+
+static void lv_7seg_constructor(const lv_obj_class_t * class_p, lv_obj_t * obj);
+static void lv_7seg_event(const lv_obj_class_t * class_p, lv_event_t * e);
+static void lv_7seg_display_constructor(const lv_obj_class_t * class_p, lv_obj_t * obj);
+static void lv_7seg_display_event(const lv_obj_class_t * class_p, lv_event_t * e);
+
+static uint32_t invalidated_px = 0;    // all widgets, wraps
 
-// Helper: set segment (child index) on/off
-static void set_seg_on(lv_obj_t * cont, int child_index, bool on)
+const lv_obj_class_t lv_7seg_class = {
+    .base_class = &lv_obj_class,
+    .constructor_cb = lv_7seg_constructor,
+    .event_cb = lv_7seg_event,
+    .instance_size = sizeof(lv_7seg_t),
+};
+
+const lv_obj_class_t lv_7seg_display_class = {
+    .base_class = &lv_obj_class,
+    .constructor_cb = lv_7seg_display_constructor,
+    .event_cb = lv_7seg_display_event,
+    .instance_size = sizeof(lv_7seg_display_t),
+};
+
+// Screen areas of segments a..g and the dot of the digit at `digit`: segment thickness is a tenth
+// of the height, the dot sits in the bottom right corner.
+static void segment_areas(const lv_area_t * digit, lv_area_t * areas)
 {
-    lv_obj_t * child = lv_obj_get_child(cont, child_index);
-    if (!child) {
-      ESP_LOGE("", "7seg: no seg %d", child_index);
-      return;
+    lv_coord_t w = lv_area_get_width(digit);
+    lv_coord_t h = lv_area_get_height(digit);
+    lv_coord_t thick = h / 10;
+    if (thick < 2) thick = 2;
+    lv_coord_t hor_w = lv_coord_t(w - 2.5 * thick);     // a, d, g
+    lv_coord_t ver_h = lv_coord_t(h / 2 - thick * 1.5); // b, c, e, f
+    lv_coord_t inset = lv_coord_t(thick * 1.25);        // vertical segments from the top and bottom edge
+    lv_coord_t dot = lv_coord_t(thick * 1.2);
+    if (dot < 3) dot = 3;
+
+    const lv_coord_t x[8] = {
+        thick, (lv_coord_t)(w - 2 * thick), (lv_coord_t)(w - 2 * thick), thick,
+        (lv_coord_t)(thick / 2), (lv_coord_t)(thick / 2), thick, (lv_coord_t)(w - dot)
+    };
+    const lv_coord_t y[8] = {
+        (lv_coord_t)(thick / 2), inset, (lv_coord_t)(h - ver_h - inset), (lv_coord_t)(h - thick - thick / 2),
+        (lv_coord_t)(h - ver_h - inset), inset, (lv_coord_t)(h / 2 - thick / 2), (lv_coord_t)(h - dot)
+    };
+    for (int i = 0; i < 8; ++i) {
+        bool horizontal = i == 0 || i == 3 || i == 6;
+        lv_coord_t sw = i == 7 ? dot : horizontal ? hor_w : thick;
+        lv_coord_t sh = i == 7 ? dot : horizontal ? thick : ver_h;
+        areas[i].x1 = digit->x1 + x[i];
+        areas[i].y1 = digit->y1 + y[i];
+        areas[i].x2 = areas[i].x1 + sw - 1;
+        areas[i].y2 = areas[i].y1 + sh - 1;
     }
+}
 
-    if (on) {
-        lv_obj_clear_flag(child, LV_OBJ_FLAG_HIDDEN);
-        lv_obj_set_style_opa(child, LV_OPA_COVER, 0);
-    } else {
-        lv_obj_add_flag(child, LV_OBJ_FLAG_HIDDEN);
+static void invalidate_segments(lv_obj_t * obj, const lv_area_t * digit, uint8_t mask)
+{
+    if (lv_area_get_width(digit) <= 0 || lv_area_get_height(digit) <= 0) return;   // not laid out yet
+
+    lv_area_t areas[8];
+    segment_areas(digit, areas);
+    for (int i = 0; i < 8; ++i) {
+        if ((mask >> i) & 0x1) {
+            lv_obj_invalidate_area(obj, &areas[i]);
+            invalidated_px += lv_area_get_size(&areas[i]);
+        }
     }
 }
 
-lv_obj_t * lv_7seg_create(lv_obj_t * parent, lv_coord_t w, lv_coord_t h)
+static void draw_segments(lv_draw_ctx_t * draw_ctx, const lv_draw_rect_dsc_t * dsc, const lv_area_t * digit,
+                          uint8_t mask)
 {
-    static lv_style_t s_on;
-    static lv_style_t s_bg;
-    static bool styles_init = false;
-    if (!styles_init) {
-        lv_style_init(&s_on);
-        lv_style_set_bg_color(&s_on, lv_color_hex(0x000000));
-        lv_style_set_radius(&s_on, LV_RADIUS_CIRCLE);
-        lv_style_set_pad_all(&s_on, 0);
-
-        lv_style_init(&s_bg);
-        lv_style_set_bg_opa(&s_bg, LV_OPA_TRANSP);
-        lv_style_set_radius(&s_bg, 0);
-        lv_style_set_pad_all(&s_bg, 0);
-        styles_init = true;
-    }
-
-    lv_obj_t * cont = lv_obj_create(parent);
-    lv_obj_set_size(cont, w, h);
-    lv_obj_clear_flag(cont, LV_OBJ_FLAG_SCROLLABLE);
-    lv_obj_set_style_pad_all(cont, 0, 0);
-    lv_obj_set_style_border_width(cont, 0, 0);
-    lv_obj_add_style(cont, &s_bg, 0);
-
-    // thickness relative to height
-    lv_coord_t thick = lv_coord_t(h / 10);
-    if (thick < 2) thick = 2;
+    if (!mask || !_lv_area_is_on(digit, draw_ctx->clip_area)) return;
 
-    // Create segments. We'll use simple rectangles and position them with fixed offsets.
-    // seg a (top) -- horizontal
-    lv_obj_t * seg_a = lv_obj_create(cont);
-    lv_obj_set_size(seg_a, w - 2.5 * thick, thick);
-    lv_obj_align(seg_a, LV_ALIGN_TOP_LEFT, thick*1.0, thick/2);
-    lv_obj_add_style(seg_a, &s_on, 0);
-
-    // seg b (top-right)
-    lv_obj_t * seg_b = lv_obj_create(cont);
-    lv_obj_set_size(seg_b, thick, h/2 - thick * 1.50);
-    lv_obj_align(seg_b, LV_ALIGN_TOP_RIGHT, -thick, thick * 1.25);
-    lv_obj_add_style(seg_b, &s_on, 0);
-
-    // seg c (bottom-right)
-    lv_obj_t * seg_c = lv_obj_create(cont);
-    lv_obj_set_size(seg_c, thick, h/2 - thick * 1.5);
-    lv_obj_align(seg_c, LV_ALIGN_BOTTOM_RIGHT, -thick, -thick * 1.25);
-    lv_obj_add_style(seg_c, &s_on, 0);
-
-    // seg d (bottom)
-    lv_obj_t * seg_d = lv_obj_create(cont);
-    lv_obj_set_size(seg_d, w - 2.5*thick, thick);
-    lv_obj_align(seg_d, LV_ALIGN_BOTTOM_LEFT, thick*1.0, -thick/2);
-    lv_obj_add_style(seg_d, &s_on, 0);
-
-    // seg e (bottom-left)
-    lv_obj_t * seg_e = lv_obj_create(cont);
-    lv_obj_set_size(seg_e, thick, h/2 - thick * 1.5);
-    lv_obj_align(seg_e, LV_ALIGN_BOTTOM_LEFT, thick/2, -thick * 1.25);
-    lv_obj_add_style(seg_e, &s_on, 0);
-
-    // seg f (top-left)
-    lv_obj_t * seg_f = lv_obj_create(cont);
-    lv_obj_set_size(seg_f, thick, h/2 - thick * 1.5);
-    lv_obj_align(seg_f, LV_ALIGN_TOP_LEFT, thick/2, thick * 1.25);
-    lv_obj_add_style(seg_f, &s_on, 0);
-
-    // seg g (middle horizontal)
-    lv_obj_t * seg_g = lv_obj_create(cont);
-    lv_obj_set_size(seg_g, w - 2.5*thick, thick);
-    lv_obj_align(seg_g, LV_ALIGN_LEFT_MID, thick*1.0, 0);
-    lv_obj_add_style(seg_g, &s_on, 0);
-
-    // dot
-    lv_obj_t * seg_dot = lv_obj_create(cont);
-    lv_coord_t dot_sz = thick * 1.2;
-    if (dot_sz < 3) dot_sz = 3;
-    lv_obj_set_size(seg_dot, dot_sz, dot_sz);
-    lv_obj_align(seg_dot, LV_ALIGN_BOTTOM_RIGHT, 0, 0);
-    lv_obj_add_style(seg_dot, &s_on, 0);
-
-    lv_7seg_set_digit(cont, ' ', false);
-
-    return cont;
+    lv_area_t areas[8];
+    segment_areas(digit, areas);
+    for (int i = 0; i < 8; ++i) {
+        if (((mask >> i) & 0x1) && _lv_area_is_on(&areas[i], draw_ctx->clip_area)) {
+            lv_draw_rect(draw_ctx, dsc, &areas[i]);
+        }
+    }
+}
+
+// Mask path of lv_7seg_display: hexagonal segments, and the dot, rasterized with anti-aliasing
+// into A8 masks once per digit size and shape, then blended with the segment colour directly
+// into the draw buffer. Nothing is recomputed per frame, unlike the rounded rectangles whose
+// corner masks LVGL rebuilds for every segment. The ghost of an unlit segment is its mask at
+// GHOST_OPA, the glow a blurred copy of the mask rasterized along with it.
+typedef struct {
+    lv_area_t area;     // relative to the digit's top left corner
+    lv_opa_t * mask;    // lv_area_get_size(&area) bytes
+} seg_mask_t;
+
+typedef struct {
+    lv_coord_t w;
+    lv_coord_t h;       // 0: unused entry
+    uint8_t shape;      // MASK_SHAPE bits of the style
+    uint32_t used;      // lv_tick_get() of the last lookup, the oldest entry is replaced
+    seg_mask_t segment[8];
+    seg_mask_t glow[8];     // only with LV_7SEG_STYLE_GLOW
+} mask_set_t;
+
+static mask_set_t mask_cache[LV_7SEG_MASK_CACHE_SIZE];
+
+static void * mask_alloc(size_t size)
+{
+#ifdef ESP_PLATFORM
+    void * buf = heap_caps_malloc(size, MALLOC_CAP_SPIRAM);
+    if (buf) return buf;
+#endif
+    return malloc(size);
+}
+
+static void mask_set_free(mask_set_t * set)
+{
+    for (int i = 0; i < 8; ++i) {
+        free(set->segment[i].mask);
+        free(set->glow[i].mask);
+    }
+    lv_memset_00(set, sizeof(mask_set_t));
+}
+
+// Coverage of the convex polygon `n` points `px`/`py` in pixel coordinates. Pixels farther than
+// half a diagonal from every edge are fully in or out, the others are supersampled.
+static bool rasterize(seg_mask_t * out, const float * px, const float * py, int n)
+{
+    float min_x = px[0], max_x = px[0], min_y = py[0], max_y = py[0];
+    for (int i = 1; i < n; ++i) {
+        min_x = LV_MIN(min_x, px[i]);
+        max_x = LV_MAX(max_x, px[i]);
+        min_y = LV_MIN(min_y, py[i]);
+        max_y = LV_MAX(max_y, py[i]);
+    }
+    out->area.x1 = (lv_coord_t)floorf(min_x);
+    out->area.y1 = (lv_coord_t)floorf(min_y);
+    out->area.x2 = (lv_coord_t)ceilf(max_x) - 1;
+    out->area.y2 = (lv_coord_t)ceilf(max_y) - 1;
+    lv_coord_t w = lv_area_get_width(&out->area);
+    lv_coord_t h = lv_area_get_height(&out->area);
+    out->mask = (lv_opa_t *)mask_alloc(w * h);
+    if (!out->mask) return false;
+
+    // Edge i as a * x + b * y + c, the distance to the edge, positive inside.
+    float area2 = 0;
+    for (int i = 0; i < n; ++i) {
+        int j = (i + 1) % n;
+        area2 += px[i] * py[j] - px[j] * py[i];
+    }
+    float sign = area2 > 0 ? 1.0f : -1.0f;
+    float a[8], b[8], c[8];
+    for (int i = 0; i < n; ++i) {
+        int j = (i + 1) % n;
+        float dx = px[j] - px[i];
+        float dy = py[j] - py[i];
+        float len = sqrtf(dx * dx + dy * dy);
+        a[i] = -dy * sign / len;
+        b[i] = dx * sign / len;
+        c[i] = -(a[i] * px[i] + b[i] * py[i]);
+    }
+
+    lv_opa_t * dst = out->mask;
+    for (lv_coord_t y = out->area.y1; y <= out->area.y2; ++y) {
+        for (lv_coord_t x = out->area.x1; x <= out->area.x2; ++x) {
+            float cx = x + 0.5f;
+            float cy = y + 0.5f;
+            float inside = 1e9f;
+            for (int i = 0; i < n; ++i) {
+                inside = LV_MIN(inside, a[i] * cx + b[i] * cy + c[i]);
+            }
+            if (inside >= 0.71f) {
+                *dst++ = LV_OPA_COVER;
+            } else if (inside <= -0.71f) {
+                *dst++ = LV_OPA_TRANSP;
+            } else {
+                int hits = 0;
+                for (int sy = 0; sy < AA_SUBSAMPLES; ++sy) {
+                    for (int sx = 0; sx < AA_SUBSAMPLES; ++sx) {
+                        float fx = x + (sx + 0.5f) / AA_SUBSAMPLES;
+                        float fy = y + (sy + 0.5f) / AA_SUBSAMPLES;
+                        bool in = true;
+                        for (int i = 0; i < n && in; ++i) {
+                            in = a[i] * fx + b[i] * fy + c[i] >= 0;
+                        }
+                        hits += in;
+                    }
+                }
+                *dst++ = (lv_opa_t)(hits * LV_OPA_COVER / (AA_SUBSAMPLES * AA_SUBSAMPLES));
+            }
+        }
+    }
+    return true;
+}
+
+// One box blur pass of radius `r` along rows (`step` 1) or columns (`step` the row length).
+static void box_blur(lv_opa_t * buf, int count, int length, int stride, int step, int r, uint16_t * line)
+{
+    for (int k = 0; k < count; ++k) {
+        lv_opa_t * p = buf + k * stride;
+        for (int i = 0; i < length; ++i) line[i] = p[i * step];
+        uint32_t sum = 0;
+        for (int i = -r; i <= r; ++i) sum += (i >= 0 && i < length) ? line[i] : 0;
+        for (int i = 0; i < length; ++i) {
+            p[i * step] = (lv_opa_t)(sum / (2 * r + 1));
+            if (i - r >= 0) sum -= line[i - r];
+            if (i + r + 1 < length) sum += line[i + r + 1];
+        }
+    }
+}
+
+// The segment's mask widened by `r` on each side and blurred twice, about a Gaussian.
+static bool rasterize_glow(seg_mask_t * out, const seg_mask_t * segment, lv_coord_t r)
+{
+    out->area = segment->area;
+    lv_area_increase(&out->area, r, r);
+    int w = lv_area_get_width(&out->area);
+    int h = lv_area_get_height(&out->area);
+    out->mask = (lv_opa_t *)mask_alloc(w * h);
+    uint16_t * line = (uint16_t *)malloc(LV_MAX(w, h) * sizeof(uint16_t));
+    if (!out->mask || !line) {
+        free(line);
+        return false;
+    }
+
+    lv_memset_00(out->mask, w * h);
+    int sw = lv_area_get_width(&segment->area);
+    for (int y = 0; y < lv_area_get_height(&segment->area); ++y) {
+        lv_memcpy(out->mask + (y + r) * w + r, segment->mask + y * sw, sw);
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        box_blur(out->mask, h, w, w, 1, r / 2, line);
+        box_blur(out->mask, w, h, 1, w, r / 2, line);
+    }
+    free(line);
+    return true;
+}
+
+// Same layout as segment_areas(), with the segments meeting in points on their centre lines.
+static bool rasterize_set(mask_set_t * set)
+{
+    float w = set->w;
+    float h = set->h;
+    float thick = LV_MAX(set->h / 10, 2);
+    float half = thick / 2;
+    float gap = thick / 5;
+    float left = thick;                 // centre lines
+    float right = w - thick * 1.5f;
+    float top = thick;
+    float middle = h / 2;
+    float bottom = h - thick;
+    float dot = LV_MAX(thick * 1.2f, 3.0f);
+    float slant = (set->shape & LV_7SEG_STYLE_SLANTED) ? SLANT : 0;
+
+    // Horizontal segments a, d, g and vertical segments b, c, e, f as (x, y0, y1) or (y, x0, x1).
+    const float hor[3][3] = { { top, left, right }, { bottom, left, right }, { middle, left, right } };
+    const float ver[4][3] = { { right, top, middle }, { right, middle, bottom }, { left, middle, bottom },
+                              { left, top, middle } };
+    const int hor_index[3] = { 0, 3, 6 };
+    const int ver_index[4] = { 1, 2, 4, 5 };
+
+    float px[6], py[6];
+    bool ok = true;
+    for (int k = 0; k < 3; ++k) {
+        float y = hor[k][0], x0 = hor[k][1] + gap, x1 = hor[k][2] - gap;
+        const float sx[6] = { x0, x0 + half, x1 - half, x1, x1 - half, x0 + half };
+        const float sy[6] = { y, y - half, y - half, y, y + half, y + half };
+        for (int i = 0; i < 6; ++i) {
+            px[i] = sx[i] + slant * (middle - sy[i]);
+            py[i] = sy[i];
+        }
+        ok = ok && rasterize(&set->segment[hor_index[k]], px, py, 6);
+    }
+    for (int k = 0; k < 4; ++k) {
+        float x = ver[k][0], y0 = ver[k][1] + gap, y1 = ver[k][2] - gap;
+        const float sx[6] = { x, x + half, x + half, x, x - half, x - half };
+        const float sy[6] = { y0, y0 + half, y1 - half, y1, y1 - half, y0 + half };
+        for (int i = 0; i < 6; ++i) {
+            px[i] = sx[i] + slant * (middle - sy[i]);
+            py[i] = sy[i];
+        }
+        ok = ok && rasterize(&set->segment[ver_index[k]], px, py, 6);
+    }
+    const float dx[4] = { w - dot, w, w, w - dot };
+    const float dy[4] = { h - dot, h - dot, h, h };
+    for (int i = 0; i < 4; ++i) {
+        px[i] = dx[i] + slant * (middle - dy[i]);
+        py[i] = dy[i];
+    }
+    ok = ok && rasterize(&set->segment[7], px, py, 4);
+
+    if (set->shape & LV_7SEG_STYLE_GLOW) {
+        for (int i = 0; i < 8 && ok; ++i) {
+            ok = rasterize_glow(&set->glow[i], &set->segment[i], (lv_coord_t)half);
+        }
+    }
+    return ok;
+}
+
+// Masks for digits of `w` x `h` with the shape bits of `style`, rasterized on first use.
+// NULL if they do not fit into memory, the caller falls back to rectangles.
+static const mask_set_t * mask_set_get(lv_coord_t w, lv_coord_t h, uint8_t style)
+{
+    if (w <= 0 || h <= 0) return NULL;
+
+    uint8_t shape = style & MASK_SHAPE;
+    mask_set_t * oldest = &mask_cache[0];
+    for (int i = 0; i < LV_7SEG_MASK_CACHE_SIZE; ++i) {
+        mask_set_t * set = &mask_cache[i];
+        if (set->h && set->w == w && set->h == h && set->shape == shape) {
+            set->used = lv_tick_get();
+            return set;
+        }
+        if (!set->h || (oldest->h && lv_tick_elaps(set->used) > lv_tick_elaps(oldest->used))) {
+            oldest = set;
+        }
+    }
+
+    mask_set_free(oldest);
+    oldest->w = w;
+    oldest->h = h;
+    oldest->shape = shape;
+    oldest->used = lv_tick_get();
+    if (!rasterize_set(oldest)) {
+        LV_LOG_WARN("no memory for 7-segment masks of %dx%d", w, h);
+        mask_set_free(oldest);
+        return NULL;
+    }
+    return oldest;
+}
+
+static void blend_mask(lv_draw_ctx_t * draw_ctx, const lv_area_t * digit, const seg_mask_t * mask,
+                       lv_color_t color, lv_opa_t opa)
+{
+    lv_area_t area = mask->area;
+    lv_area_move(&area, digit->x1, digit->y1);
+    if (!_lv_area_is_on(&area, draw_ctx->clip_area)) return;
+
+    lv_draw_sw_blend_dsc_t dsc;
+    lv_memset_00(&dsc, sizeof(dsc));
+    dsc.blend_area = &area;
+    dsc.mask_buf = mask->mask;
+    dsc.mask_area = &area;
+    dsc.mask_res = LV_DRAW_MASK_RES_CHANGED;
+    dsc.color = color;
+    dsc.opa = opa;
+    dsc.blend_mode = LV_BLEND_MODE_NORMAL;
+    lv_draw_sw_blend(draw_ctx, &dsc);
+}
+
+static void draw_masked(lv_draw_ctx_t * draw_ctx, const mask_set_t * set, const lv_area_t * digit,
+                        uint8_t segments, uint8_t style, lv_color_t color)
+{
+    for (int i = 0; i < 8 && (style & LV_7SEG_STYLE_GLOW); ++i) {
+        if ((segments >> i) & 0x1) blend_mask(draw_ctx, digit, &set->glow[i], color, GLOW_OPA);
+    }
+    for (int i = 0; i < 8; ++i) {
+        if ((segments >> i) & 0x1) {
+            blend_mask(draw_ctx, digit, &set->segment[i], color, LV_OPA_COVER);
+        } else if (style & LV_7SEG_STYLE_GHOST) {
+            blend_mask(draw_ctx, digit, &set->segment[i], color, GHOST_OPA);
+        }
+    }
+}
+
+static void invalidate_masked(lv_obj_t * obj, const mask_set_t * set, const lv_area_t * digit, uint8_t mask,
+                              uint8_t style)
+{
+    for (int i = 0; i < 8; ++i) {
+        if ((mask >> i) & 0x1) {
+            lv_area_t area = (style & LV_7SEG_STYLE_GLOW) ? set->glow[i].area : set->segment[i].area;
+            lv_area_move(&area, digit->x1, digit->y1);
+            lv_obj_invalidate_area(obj, &area);
+            invalidated_px += lv_area_get_size(&area);
+        }
+    }
+}
+
+static uint8_t segments_for(const char digit, const bool dot)
+{
+    uint8_t bits = 0;
+    if ((uint8_t)digit <= 9) {
+        bits = SEGMENTS_FOR_DIGIT[(uint8_t)digit];
+    } else if (digit >= '0' && digit <= '9') {
+        bits = SEGMENTS_FOR_DIGIT[digit - '0'];
+    } else if (digit == '-') {
+        bits = SEGMENTS_MINUS;
+    }
+    return bits | (dot ? LV_7SEG_DOT : 0);
+}
+
+uint32_t lv_7seg_invalidated_px(void)
+{
+    return invalidated_px;
+}
+
+// x / 10 is (x * 0xcccd) >> 19 for x < 81920, a 32-bit multiply, and the remainder a
+// multiply-subtract. Splitting the value at 10^8 and 10^4 first, with reciprocals checked against
+// every 32-bit value, leaves three independent chains of at most four digits. Fixed trip count,
+// so the only branch is the loop.
+static inline uint32_t div10(uint32_t x)
+{
+    return (x * 0xcccdu) >> 19;
+}
+
+uint8_t lv_7seg_bcd(uint32_t value, uint8_t * digits)
+{
+    uint32_t high = (uint32_t)(((uint64_t)value * 0xabcc7712u) >> 58);     // / 10^8
+    uint32_t rest = value - high * 100000000u;
+    uint32_t mid = (uint32_t)(((uint64_t)rest * 0xd1b71759u) >> 45);       // / 10^4
+    uint32_t low = rest - mid * 10000u;
+    for (uint8_t i = 0; i < 4; ++i) {
+        uint32_t low_quotient = div10(low);
+        uint32_t mid_quotient = div10(mid);
+        digits[i] = (uint8_t)(low - low_quotient * 10);
+        digits[i + 4] = (uint8_t)(mid - mid_quotient * 10);
+        low = low_quotient;
+        mid = mid_quotient;
+    }
+    uint32_t high_quotient = div10(high);
+    digits[8] = (uint8_t)(high - high_quotient * 10);
+    digits[9] = (uint8_t)high_quotient;
+
+    static const uint32_t POWERS[LV_7SEG_BCD_DIGITS - 1] = {
+        10, 100, 1000, 10000, 100000, 1000000, 10000000, 100000000, 1000000000
+    };
+    uint8_t significant = 1;
+    for (uint8_t i = 0; i < LV_7SEG_BCD_DIGITS - 1; ++i) {
+        significant += value >= POWERS[i];
+    }
+    return significant;
+}
+
+lv_obj_t * lv_7seg_create(lv_obj_t * parent, lv_coord_t w, lv_coord_t h)
+{
+    lv_obj_t * obj = lv_obj_class_create_obj(MY_CLASS, parent);
+    lv_obj_class_init_obj(obj);
+    lv_obj_set_size(obj, w, h);
+    return obj;
 }
 
 void lv_7seg_set_digit(lv_obj_t * obj, const char digit, const bool dot)
 {
     if (!obj) return;
 
-    uint8_t bits = 0;
-    switch(digit) {
-      case 0: bits = SEGMENTS_FOR_DIGIT[0]; break;
-      case 1: bits = SEGMENTS_FOR_DIGIT[1]; break;
-      case 2: bits = SEGMENTS_FOR_DIGIT[2]; break;
-      case 3: bits = SEGMENTS_FOR_DIGIT[3]; break;
-      case 4: bits = SEGMENTS_FOR_DIGIT[4]; break;
-      case 5: bits = SEGMENTS_FOR_DIGIT[5]; break;
-      case 6: bits = SEGMENTS_FOR_DIGIT[6]; break;
-      case 7: bits = SEGMENTS_FOR_DIGIT[7]; break;
-      case 8: bits = SEGMENTS_FOR_DIGIT[8]; break;
-      case 9: bits = SEGMENTS_FOR_DIGIT[9]; break;
-        case '0': bits = SEGMENTS_FOR_DIGIT[0]; break;
-        case '1': bits = SEGMENTS_FOR_DIGIT[1]; break;
-        case '2': bits = SEGMENTS_FOR_DIGIT[2]; break;
-        case '3': bits = SEGMENTS_FOR_DIGIT[3]; break;
-        case '4': bits = SEGMENTS_FOR_DIGIT[4]; break;
-        case '5': bits = SEGMENTS_FOR_DIGIT[5]; break;
-        case '6': bits = SEGMENTS_FOR_DIGIT[6]; break;
-        case '7': bits = SEGMENTS_FOR_DIGIT[7]; break;
-        case '8': bits = SEGMENTS_FOR_DIGIT[8]; break;
-        case '9': bits = SEGMENTS_FOR_DIGIT[9]; break;
-        case ' ': bits = 0; break;
-        case '-': bits = 0b01000000; break;
-        default: bits = 0; // clear all segments
-    }
-
-    // bit 0 = a -> child index 0
-    for (int i = 0; i < 7; ++i) {
-        bool on = (bits >> i) & 0x1;
-        set_seg_on(obj, i, on);
-    }
-    set_seg_on(obj, 7, dot);
+    lv_7seg_set_segments(obj, segments_for(digit, dot));
+}
+
+void lv_7seg_set_segments(lv_obj_t * obj, uint8_t mask)
+{
+    if (!obj) return;
+
+    lv_7seg_t * seg = (lv_7seg_t *)obj;
+    uint8_t changed = seg->segments ^ mask;
+    if (!changed) return;
+    seg->segments = mask;
+    invalidate_segments(obj, &obj->coords, changed);
 }
 
 void lv_7seg_set_color(lv_obj_t * obj, lv_color_t color)
 {
     if (!obj) return;
 
-    for (int i = 0; i < 8; ++i) {
-        lv_obj_t * seg = lv_obj_get_child(obj, i);
-        if (seg) {
-            lv_obj_set_style_bg_color(seg, color, 0);
+    lv_7seg_t * seg = (lv_7seg_t *)obj;
+    if (lv_color_to32(seg->color) == lv_color_to32(color)) return;
+    seg->color = color;
+    invalidate_segments(obj, &obj->coords, seg->segments);
+}
+
+static void lv_7seg_constructor(const lv_obj_class_t * class_p, lv_obj_t * obj)
+{
+    LV_UNUSED(class_p);
+    lv_7seg_t * seg = (lv_7seg_t *)obj;
+    seg->segments = 0;
+    seg->color = lv_color_hex(0x000000);
+    lv_obj_clear_flag(obj, LV_OBJ_FLAG_SCROLLABLE);
+}
+
+static void lv_7seg_event(const lv_obj_class_t * class_p, lv_event_t * e)
+{
+    LV_UNUSED(class_p);
+
+    lv_res_t res = lv_obj_event_base(MY_CLASS, e);
+    if (res != LV_RES_OK) return;
+    if (lv_event_get_code(e) != LV_EVENT_DRAW_MAIN) return;
+
+    lv_obj_t * obj = lv_event_get_target(e);
+    lv_7seg_t * seg = (lv_7seg_t *)obj;
+
+    lv_draw_rect_dsc_t dsc;
+    lv_draw_rect_dsc_init(&dsc);
+    dsc.bg_color = seg->color;
+    dsc.radius = LV_RADIUS_CIRCLE;
+    draw_segments(lv_event_get_draw_ctx(e), &dsc, &obj->coords, seg->segments);
+}
+
+// Area of digit `index`, counted from the left.
+static void digit_area(lv_obj_t * obj, uint8_t index, lv_area_t * area)
+{
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    area->x1 = obj->coords.x1 + index * display->pitch;
+    area->y1 = obj->coords.y1;
+    area->x2 = area->x1 + display->digit_w - 1;
+    area->y2 = obj->coords.y2;
+}
+
+// With the mask path, also what the glow reaches. Changes of an unlit segment matter to the ghost.
+static void display_invalidate(lv_obj_t * obj, uint8_t index, uint8_t mask)
+{
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    lv_area_t area;
+    digit_area(obj, index, &area);
+    const mask_set_t * set = NULL;
+    if (display->style && lv_area_get_height(&area) > 0) {
+        set = mask_set_get(display->digit_w, lv_area_get_height(&area), display->style);
+    }
+    if (set) {
+        invalidate_masked(obj, set, &area, mask, display->style);
+    } else {
+        invalidate_segments(obj, &area, mask);
+    }
+}
+
+static void display_set_segments(lv_obj_t * obj, uint8_t index, uint8_t mask)
+{
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    uint8_t changed = display->segments[index] ^ mask;
+    if (!changed) return;
+    display->segments[index] = mask;
+    display_invalidate(obj, index, changed);
+}
+
+lv_obj_t * lv_7seg_display_create(lv_obj_t * parent, uint8_t digits, lv_coord_t digit_w, lv_coord_t h,
+                                  lv_coord_t pitch)
+{
+    if (digits < 1) digits = 1;
+    if (digits > LV_7SEG_DISPLAY_MAX_DIGITS) digits = LV_7SEG_DISPLAY_MAX_DIGITS;
+
+    lv_obj_t * obj = lv_obj_class_create_obj(DISPLAY_CLASS, parent);
+    lv_obj_class_init_obj(obj);
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    display->digits = digits;
+    display->digit_w = digit_w;
+    display->pitch = pitch;
+    lv_obj_set_size(obj, pitch * (digits - 1) + digit_w, h);
+    return obj;
+}
+
+void lv_7seg_display_set_value(lv_obj_t * obj, uint32_t value, uint8_t decimals, uint8_t format)
+{
+    if (!obj) return;
+
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    uint8_t n = display->digits;
+    uint8_t bcd[LV_7SEG_BCD_DIGITS];
+    uint8_t significant = lv_7seg_bcd(value, bcd);
+    if (decimals >= LV_7SEG_BCD_DIGITS) decimals = LV_7SEG_BCD_DIGITS - 1;
+    if (significant < decimals + 1) significant = decimals + 1;     // 0.123, not .123
+
+    // Auto-ranging drops fraction digits, truncating, until the value fits.
+    uint8_t drop = 0;
+    if (significant > n && (format & LV_7SEG_AUTO_RANGE)) {
+        drop = significant - n < decimals ? significant - n : decimals;
+    }
+    if (significant - drop > n) {
+        lv_7seg_display_fill(obj, '-', false);
+        return;
+    }
+
+    for (uint8_t i = 0; i < n; ++i) {
+        uint8_t pos = drop + n - 1 - i;     // power of ten shown by digit i
+        bool blank = (format & LV_7SEG_BLANK_ZEROS) && pos >= significant;
+        bool dot = decimals > drop && pos == decimals;
+        uint8_t mask = blank ? 0 : SEGMENTS_FOR_DIGIT[bcd[pos]];
+        display_set_segments(obj, i, mask | (dot ? LV_7SEG_DOT : 0));
+    }
+}
+
+void lv_7seg_display_set_digit(lv_obj_t * obj, uint8_t index, const char digit, const bool dot)
+{
+    if (!obj) return;
+
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    if (index >= display->digits) return;
+    display_set_segments(obj, index, segments_for(digit, dot));
+}
+
+void lv_7seg_display_fill(lv_obj_t * obj, const char digit, const bool dot)
+{
+    if (!obj) return;
+
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    uint8_t mask = segments_for(digit, dot);
+    for (uint8_t i = 0; i < display->digits; ++i) {
+        display_set_segments(obj, i, mask);
+    }
+}
+
+void lv_7seg_display_set_color(lv_obj_t * obj, lv_color_t color)
+{
+    if (!obj) return;
+
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    if (lv_color_to32(display->color) == lv_color_to32(color)) return;
+    display->color = color;
+    for (uint8_t i = 0; i < display->digits; ++i) {
+        display_invalidate(obj, i, (display->style & LV_7SEG_STYLE_GHOST) ? 0xff : display->segments[i]);
+    }
+}
+
+void lv_7seg_display_set_style(lv_obj_t * obj, uint8_t style)
+{
+    if (!obj) return;
+
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    if (display->style == style) return;
+    lv_obj_invalidate(obj);
+    display->style = style;
+    lv_obj_refresh_ext_draw_size(obj);
+    lv_obj_invalidate(obj);
+}
+
+static void lv_7seg_display_constructor(const lv_obj_class_t * class_p, lv_obj_t * obj)
+{
+    LV_UNUSED(class_p);
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    display->digits = 1;
+    display->digit_w = 0;
+    display->pitch = 0;
+    display->style = 0;
+    lv_memset_00(display->segments, sizeof(display->segments));
+    display->color = lv_color_hex(0x000000);
+    lv_obj_clear_flag(obj, LV_OBJ_FLAG_SCROLLABLE);
+}
+
+// All digits in one pass, with one descriptor or one mask set.
+static void lv_7seg_display_event(const lv_obj_class_t * class_p, lv_event_t * e)
+{
+    LV_UNUSED(class_p);
+
+    lv_res_t res = lv_obj_event_base(DISPLAY_CLASS, e);
+    if (res != LV_RES_OK) return;
+
+    lv_obj_t * obj = lv_event_get_target(e);
+    lv_7seg_display_t * display = (lv_7seg_display_t *)obj;
+    lv_event_code_t code = lv_event_get_code(e);
+    if (code == LV_EVENT_REFR_EXT_DRAW_SIZE && (display->style & LV_7SEG_STYLE_GLOW)) {
+        lv_event_set_ext_draw_size(e, LV_MAX(lv_obj_get_height(obj) / 10, 2));  // glow radius and slant
+        return;
+    }
+    if (code != LV_EVENT_DRAW_MAIN) return;
+
+    lv_draw_ctx_t * draw_ctx = lv_event_get_draw_ctx(e);
+    // The masks are blended straight into the buffer, which would ignore other active draw masks.
+    const mask_set_t * set = NULL;
+    if (display->style && !lv_draw_mask_is_any(&obj->coords)) {
+        set = mask_set_get(display->digit_w, lv_obj_get_height(obj), display->style);
+    }
+    if (set) {
+        for (uint8_t i = 0; i < display->digits; ++i) {
+            lv_area_t area;
+            digit_area(obj, i, &area);
+            draw_masked(draw_ctx, set, &area, display->segments[i], display->style, display->color);
         }
+        return;
     }
-}
\ No newline at end of file
+
+    lv_draw_rect_dsc_t dsc;
+    lv_draw_rect_dsc_init(&dsc);
+    dsc.bg_color = display->color;
+    dsc.radius = LV_RADIUS_CIRCLE;
+    for (uint8_t i = 0; i < display->digits; ++i) {
+        lv_area_t area;
+        digit_area(obj, i, &area);
+        draw_segments(draw_ctx, &dsc, &area, display->segments[i]);
+    }
+}
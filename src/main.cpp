@@ -5,13 +5,32 @@
 #include "lvgl_v8_port.h"
 #include <demos/lv_demos.h>
 #include "lv_7seg.h"
+#include "color_fade.h"
 #include "driver/twai.h"
+#include "game_engine.h"
+#include "spsc_ring.h"
+#include "tx_scheduler.h"
+#include "session_log.h"
+#include "result_store.h"
+#include "result_log.h"
+#include "tournament.h"
+#include "can_bus.h"
+#ifdef BUZZER_SIMULATION
+#include "sim_bus.h"
+#endif
+#include "time_service.h"
+#include "esp_heap_caps.h"
+#include "esp_attr.h"
+#include "esp_system.h"
+#include "esp_mac.h"
+#include <LittleFS.h>
+#include <time.h>
 
 #include <vector>
-#include <cstring>
 #include <atomic>
+#include <cstring>
 
-static void twai_send_message(uint32_t id, const uint8_t* data, uint8_t len);
+static void twai_send_message(uint32_t id, const uint8_t* data, uint8_t len, TxPriority priority);
 
 using namespace esp_panel::drivers;
 using namespace esp_panel::board;
@@ -26,58 +45,69 @@ extern const lv_img_dsc_t difficulty1;
 extern const lv_img_dsc_t difficulty2;
 extern const lv_img_dsc_t difficulty3;
 
-class BuzzerButton;
-
-std::vector<BuzzerButton> buzzers;
-std::vector<lv_obj_t*> buzzer_indicators;
-
-enum GameState {
-    GAME_IDLE,
-    GAME_READYSETGO,
-    GAME_PREPARING,
-    GAME_STARTING,
-    GAME_WAIT_FOR_BUZZER1,
-    GAME_WAIT_FOR_BUZZER2,
-    GAME_ROUND_COMPLETE,
-    GAME_FINISHED,
-    GAME_END
-};
-
-GameState game_state = GAME_IDLE;
-uint8_t game_variant = 0;
-uint8_t current_round = 0;
-uint16_t waitforbuzzer_index = 0xffff;
-uint16_t waitforbuzzer_id = 0;
-uint32_t total_time = 0;
-std::atomic<uint32_t> buzzer_time = 0;
-uint32_t local_time = 0;
-uint32_t random_start_time = 0;
-const uint8_t TOTAL_ROUNDS = 5;
-
-uint32_t next_can_packet_millis = 0;
-
-class BuzzerButton {
-public:
-    uint16_t buzzer_id;
-    uint32_t last_press_id;
-    uint32_t last_press_online;
-    bool used_in_game;
-    bool pressed;
-    bool waiting_for_press;
-    bool bus_offline;
-    uint32_t press_time; // Time when the button was pressed
-    BuzzerButton(uint16_t id, bool used) : buzzer_id(id), used_in_game(used), pressed(false), waiting_for_press(false), press_time(0), last_press_id(0), last_press_online(0), bus_offline(true) {
-        //
-    }
-
-    void clear() {
-        pressed = false;
-        waiting_for_press = false;
-        press_time = 0;
-        last_press_id = 0;
-        last_press_online = 0;
+#define INDICATOR_ROWS              (23)    // buzzer indicators per column
+#ifndef DISPLAY_TENTHS_DEFAULT
+#define DISPLAY_TENTHS_DEFAULT      (false)
+#endif
+#ifndef SEVEN_SEGMENT_STYLE
+#define SEVEN_SEGMENT_STYLE         (LV_7SEG_STYLE_SLANTED)     // LV_7SEG_STYLE_* flags of the time display
+#endif
+#define INDICATOR_SYNC_PERIOD_MS    (50)
+#define DISPLAY_TIME_MAX_MS         (9999999)   // 9999.9 s in five digits, dots only above
+#define FADE_RUNNING                "running"   // game screen background while the clock runs
+#define FADE_RUNNING_PERIOD_MS      (512)
+
+std::vector<lv_obj_t*> buzzer_indicators;    // owned by the LVGL task, see indicator_sync()
+static portMUX_TYPE indicator_lock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t indicator_colors[BUZZER_REGISTRY_CAPACITY];
+static uint16_t indicator_count = 0;
+static bool indicators_dirty = false;
+static bool display_tenths = DISPLAY_TENTHS_DEFAULT;   // 0.1 ms digit below 10 s, settings switch
+
+static QueueHandle_t game_queue = nullptr;
+static SpscRing<BuzzerFrame, 256> rx_ring;  // producer: twai_rx_task, consumer: loop()
+static SpscRing<CanFrame, 32> tournament_ring;  // producer: twai_rx_task, consumer: loop()
+static std::atomic<uint8_t> tournament_request(0);  // variant to start a tournament with, set by the UI
+static uint32_t rx_ring_reported_drops = 0;
+static TxScheduler tx_scheduler;            // guarded by tx_lock, drained by twai_tx_task
+static portMUX_TYPE tx_lock = portMUX_INITIALIZER_UNLOCKED;
+static TaskHandle_t tx_task_handle = nullptr;
+static CanBus *can_bus = nullptr;           // TWAI controller, or the simulated buzzer wall
+static BusHealth bus_health;                // written by bus_health_task, read anywhere
+static BusHealthStats bus_reported;
+static CanAcceptance rx_acceptance;         // exact set of our identifiers, fixed at setup(), see can_filter_init()
+static std::atomic<uint32_t> rx_unwanted(0);    // frames that passed the acceptance filter but are not ours
+static uint32_t rx_reported_unwanted = 0;
+#ifdef BUZZER_SIMULATION
+static SimBus *sim_bus = nullptr;
+static uint32_t sim_frames = 0;             // frames handled by the game loop since the last report
+static int64_t sim_worst_dispatch_us = 0;   // RX timestamp to engine dispatch
+static int64_t sim_next_report = 0;
+#endif
+static uint32_t tx_reported_drops = 0;
+static SessionRecorder session_log;         // producer: loop(), consumer: session_flush_task
+static uint32_t session_reported_drops = 0;
+#ifdef SEVEN_SEGMENT_REPORT
+static uint32_t seven_reported_px = 0;      // lv_7seg_invalidated_px() at the last report
+static int64_t seven_reported_us = 0;
+#endif
+static ResultStore results;                 // index, owned by the game task after setup()
+static QueueHandle_t result_queue = nullptr;    // records for results_flush_task
+// Raw bytes: a GameSnapshot object here would be reset by its constructor at every boot.
+// game_snapshot.h bounds its size by GAME_SNAPSHOT_RTC_MAX.
+alignas(8) static RTC_NOINIT_ATTR uint8_t rtc_snapshot[sizeof(GameSnapshot)];
+
+// Queue a touch command for the game engine. Called from LVGL event callbacks.
+static void game_post_command(GameCommand command, uint8_t arg = 0)
+{
+    GameEvent event = {};
+    event.type = GAME_EVENT_COMMAND;
+    event.command = command;
+    event.arg = arg;
+    if (xQueueSend(game_queue, &event, 0) != pdTRUE) {
+        printf("!!! game queue full, command %d dropped\n", command);
     }
-};
+}
 
 class MainScreen {
     public:
@@ -95,6 +125,7 @@ class OverlayScreen {
     public:
         lv_obj_t *overlay_screen;
         lv_obj_t *label_1;
+        lv_obj_t *race_label;
 
         void init(MainScreen& mainscreen) {
             overlay_screen = lv_obj_create(mainscreen.main_screen);
@@ -111,6 +142,11 @@ class OverlayScreen {
             lv_label_set_text(label_1, "");
             lv_obj_set_style_text_font(label_1, &lv_font_caveat_80, 0);
             lv_obj_align(label_1, LV_ALIGN_BOTTOM_MID, 0, -90);
+
+            race_label = lv_label_create(overlay_screen);
+            lv_label_set_text(race_label, "");
+            lv_obj_set_style_text_font(race_label, &lv_font_robotocondensed_40, 0);
+            lv_obj_align(race_label, LV_ALIGN_TOP_LEFT, 10, 10);
         }
 };
 OverlayScreen overlayscreen;
@@ -130,6 +166,12 @@ class StartScreen {
         lv_obj_t *startLargeLabel;
         lv_obj_t *settingsBtn;
         lv_obj_t *settingsLabel;
+        lv_obj_t *raceBtn;
+        lv_obj_t *raceLabel;
+        lv_obj_t *resumeBtn;
+        lv_obj_t *resumeLabel;
+        lv_obj_t *tournamentBtn;
+        lv_obj_t *tournamentLabel;
 
         void init(MainScreen& mainscreen) {
             start_screen = lv_obj_create(mainscreen.main_screen);
@@ -180,22 +222,93 @@ class StartScreen {
             settingsLabel = lv_img_create(startLargeBtn);
             lv_img_set_src(settingsLabel, &difficulty3);
             lv_obj_center(settingsLabel);
+
+            raceBtn = lv_btn_create(start_screen);
+            lv_obj_set_style_bg_color(raceBtn, lv_color_hex(0xc5c405), LV_PART_MAIN);
+            lv_obj_set_style_text_color(raceBtn, lv_color_black(), LV_PART_MAIN);
+            lv_obj_set_size(raceBtn, 120, 60);
+            lv_obj_add_event_cb(raceBtn, [](lv_event_t *e){StartScreen *self = static_cast<StartScreen*>(lv_event_get_user_data(e));self->handle_race(e);}, LV_EVENT_ALL,  static_cast<void*>(this));
+            lv_obj_align(raceBtn, LV_ALIGN_BOTTOM_LEFT, 5, -5);
+            raceLabel = lv_label_create(raceBtn);
+            lv_label_set_text(raceLabel, "2 P");
+            lv_obj_set_style_text_font(raceLabel, &lv_font_robotocondensed_40, 0);
+            lv_obj_center(raceLabel);
+
+            resumeBtn = lv_btn_create(start_screen);
+            lv_obj_set_style_bg_color(resumeBtn, lv_color_hex(0xc5c405), LV_PART_MAIN);
+            lv_obj_set_style_text_color(resumeBtn, lv_color_black(), LV_PART_MAIN);
+            lv_obj_set_size(resumeBtn, 250, 60);
+            lv_obj_add_event_cb(resumeBtn, [](lv_event_t *e){StartScreen *self = static_cast<StartScreen*>(lv_event_get_user_data(e));self->handle_resume(e);}, LV_EVENT_ALL,  static_cast<void*>(this));
+            lv_obj_align(resumeBtn, LV_ALIGN_BOTTOM_MID, 0, -5);
+            lv_obj_add_flag(resumeBtn, LV_OBJ_FLAG_HIDDEN);
+            resumeLabel = lv_label_create(resumeBtn);
+            lv_label_set_text(resumeLabel, "Weiterspielen");
+            lv_obj_set_style_text_font(resumeLabel, &lv_font_robotocondensed_40, 0);
+            lv_obj_center(resumeLabel);
+
+            tournamentBtn = lv_btn_create(start_screen);
+            lv_obj_set_style_bg_color(tournamentBtn, lv_color_hex(0xc5c405), LV_PART_MAIN);
+            lv_obj_set_style_text_color(tournamentBtn, lv_color_black(), LV_PART_MAIN);
+            lv_obj_set_size(tournamentBtn, 160, 60);
+            lv_obj_add_event_cb(tournamentBtn, [](lv_event_t *e){StartScreen *self = static_cast<StartScreen*>(lv_event_get_user_data(e));self->handle_tournament(e);}, LV_EVENT_ALL,  static_cast<void*>(this));
+            lv_obj_align(tournamentBtn, LV_ALIGN_TOP_RIGHT, -5, 5);
+            tournamentLabel = lv_label_create(tournamentBtn);
+            lv_label_set_text(tournamentLabel, "Turnier");
+            lv_obj_set_style_text_font(tournamentLabel, &lv_font_robotocondensed_40, 0);
+            lv_obj_center(tournamentLabel);
+        }
+
+        // All displays on the bus, started on the coordinator. Click: medium, long press: large.
+        void handle_tournament(lv_event_t * e)
+        {
+            lv_event_code_t code = lv_event_get_code(e);
+            uint8_t variant = 0;
+            if(code == LV_EVENT_SHORT_CLICKED) {
+                variant = 2;
+            } else if(code == LV_EVENT_LONG_PRESSED) {
+                variant = 3;
+            }
+            if (variant) {
+                tournament_request.store(variant);
+                GameEvent event = {};
+                event.type = GAME_EVENT_TIMER;  // wake the game task
+                xQueueSend(game_queue, &event, 0);
+            }
+        }
+
+        // Shown after a reset interrupted a game, see GameEngine::load_snapshot().
+        void handle_resume(lv_event_t * e)
+        {
+            lv_event_code_t code = lv_event_get_code(e);
+            if(code == LV_EVENT_CLICKED) {
+                game_post_command(GAME_CMD_RESUME);
+            }
+        }
+
+        void show_resume(bool visible) {
+            if (visible) {
+                lv_obj_clear_flag(resumeBtn, LV_OBJ_FLAG_HIDDEN);
+            } else {
+                lv_obj_add_flag(resumeBtn, LV_OBJ_FLAG_HIDDEN);
+            }
+        }
+
+        // Click: two players with their own buzzers, long press: both race for the same position.
+        void handle_race(lv_event_t * e)
+        {
+            lv_event_code_t code = lv_event_get_code(e);
+            if(code == LV_EVENT_SHORT_CLICKED) {
+                game_post_command(GAME_CMD_START_RACE, 2);
+            } else if(code == LV_EVENT_LONG_PRESSED) {
+                game_post_command(GAME_CMD_START_RACE_SHARED, 2);
+            }
         }
 
         void handle_startMedium(lv_event_t * e)
         {
             lv_event_code_t code = lv_event_get_code(e);
             if(code == LV_EVENT_CLICKED) {
-                switch (game_state) {
-                    case GAME_IDLE:
-                        game_variant = 2;
-                        game_state = GAME_READYSETGO;
-                        gameScreenShow();
-                        break;
-
-                    default:
-                        break;
-                }
+                game_post_command(GAME_CMD_START, 2);
             }
         }
 
@@ -203,16 +316,7 @@ class StartScreen {
         {
             lv_event_code_t code = lv_event_get_code(e);
             if(code == LV_EVENT_CLICKED) {
-                switch (game_state) {
-                    case GAME_IDLE:
-                        game_variant = 1;
-                        game_state = GAME_READYSETGO;
-                        gameScreenShow();
-                        break;
-
-                    default:
-                        break;
-                }
+                game_post_command(GAME_CMD_START, 1);
             }
         }
 
@@ -220,16 +324,7 @@ class StartScreen {
         {
             lv_event_code_t code = lv_event_get_code(e);
             if(code == LV_EVENT_CLICKED) {
-                switch (game_state) {
-                    case GAME_IDLE:
-                        game_variant = 3;
-                        game_state = GAME_READYSETGO;
-                        gameScreenShow();
-                        break;
-
-                    default:
-                        break;
-                }
+                game_post_command(GAME_CMD_START, 3);
             }
         }
 
@@ -237,7 +332,7 @@ class StartScreen {
         {
             lv_event_code_t code = lv_event_get_code(e);
             if(code == LV_EVENT_CLICKED) {
-                //settingsScreenShow();
+                settingsScreenShow();
             }
         }
 
@@ -259,6 +354,12 @@ class SettingsScreen {
         lv_obj_t *oklabel;
         lv_obj_t *cancelbtn;
         lv_obj_t *cancellabel;
+        lv_obj_t *tenthsswitch;
+        lv_obj_t *tenthslabel;
+        lv_obj_t *calibratebtn;
+        lv_obj_t *calibratelabel;
+        lv_obj_t *latencylist;
+        lv_obj_t *latencylabel;
 
         void init(MainScreen& mainscreen) {
             settings_screen = lv_obj_create(mainscreen.main_screen);
@@ -290,6 +391,64 @@ class SettingsScreen {
             lv_obj_set_style_text_font(cancellabel, &lv_font_robotocondensed_40, 0);
             lv_obj_center(cancellabel);
             lv_obj_add_flag(cancelbtn, LV_OBJ_FLAG_HIDDEN);
+
+            tenthsswitch = lv_switch_create(settings_screen);
+            lv_obj_set_size(tenthsswitch, 100, 50);
+            lv_obj_align(tenthsswitch, LV_ALIGN_TOP_LEFT, 20, 20);
+            if (display_tenths) {
+                lv_obj_add_state(tenthsswitch, LV_STATE_CHECKED);
+            }
+            lv_obj_add_event_cb(tenthsswitch, [](lv_event_t *e){SettingsScreen *self = static_cast<SettingsScreen*>(lv_event_get_user_data(e));self->handle_tenths();}, LV_EVENT_VALUE_CHANGED,  static_cast<void*>(this));
+            tenthslabel = lv_label_create(settings_screen);
+            lv_label_set_text(tenthslabel, "Zeit auf 0,1 ms");
+            lv_obj_set_style_text_font(tenthslabel, &lv_font_robotocondensed_40, 0);
+            lv_obj_align_to(tenthslabel, tenthsswitch, LV_ALIGN_OUT_RIGHT_MID, 20, 0);
+
+            calibratebtn = lv_btn_create(settings_screen);
+            lv_obj_set_style_bg_color(calibratebtn, lv_color_hex(0xc5c405), LV_PART_MAIN);
+            lv_obj_set_style_text_color(calibratebtn, lv_color_black(), LV_PART_MAIN);
+            lv_obj_add_event_cb(calibratebtn, [](lv_event_t *e){SettingsScreen *self = static_cast<SettingsScreen*>(lv_event_get_user_data(e));self->handle_calibrate(e);}, LV_EVENT_ALL,  static_cast<void*>(this));
+            lv_obj_align(calibratebtn, LV_ALIGN_TOP_RIGHT, -20, 20);
+            calibratelabel = lv_label_create(calibratebtn);
+            lv_label_set_text(calibratelabel, "Kalibrieren");
+            lv_obj_set_style_text_font(calibratelabel, &lv_font_robotocondensed_40, 0);
+            lv_obj_center(calibratelabel);
+
+            // one line per calibrated buzzer, scrolls with a full wall
+            latencylist = lv_obj_create(settings_screen);
+            lv_obj_set_size(latencylist, LV_PCT(90), LV_PCT(60));
+            lv_obj_align(latencylist, LV_ALIGN_TOP_MID, 0, 100);
+            lv_obj_set_style_bg_opa(latencylist, 0, LV_PART_MAIN);
+            lv_obj_set_style_border_width(latencylist, 0, LV_PART_MAIN);
+            latencylabel = lv_label_create(latencylist);
+            lv_label_set_text(latencylabel, "");
+            lv_obj_set_style_text_font(latencylabel, &lv_font_montserrat_20, 0);
+        }
+
+        void handle_calibrate(lv_event_t * e)
+        {
+            lv_event_code_t code = lv_event_get_code(e);
+            if(code == LV_EVENT_CLICKED) {
+                game_post_command(GAME_CMD_CALIBRATE);
+            }
+        }
+
+        // Latency and jitter of every calibrated buzzer. Takes no lock, the caller holds it.
+        void show_latency(const LatencyTable& table) {
+            static char text[LATENCY_IDS * 64];
+            size_t len = 0;
+            for (uint16_t id = 1; id < LATENCY_IDS && len < sizeof(text); id++) {
+                const LatencyEntry &entry = table[id];
+                if (entry.rtt_us) {
+                    len += snprintf(text + len, sizeof(text) - len, "%sBuzzer %d: Umlauf %u us, Jitter %u us, Ausgleich %u us",
+                                    len ? "\n" : "", id, entry.rtt_us, entry.jitter_us, entry.compensation_us);
+                }
+            }
+            lv_label_set_text(latencylabel, len ? text : "Nicht kalibriert");
+        }
+
+        void handle_tenths() {
+            display_tenths = lv_obj_has_state(tenthsswitch, LV_STATE_CHECKED);
         }
 
         void handle_ok() {
@@ -312,11 +471,7 @@ SettingsScreen settingsscreen;
 
 class GameScreen {
     public:
-        lv_obj_t * seven1;
-        lv_obj_t * seven2;
-        lv_obj_t * seven3;
-        lv_obj_t * seven4;
-        lv_obj_t * seven5;
+        lv_obj_t * seven;
         lv_obj_t *game_screen;
         lv_obj_t *okbtn;
         lv_obj_t *oklabel;
@@ -374,44 +529,17 @@ class GameScreen {
             lv_obj_center(testlabel);
             lv_obj_add_flag(testbtn, LV_OBJ_FLAG_HIDDEN);
 
-            seven1 = lv_7seg_create(game_screen, 170, 320);
-            lv_obj_align(seven1, LV_ALIGN_TOP_LEFT, 5, 0);
-
-            seven2 = lv_7seg_create(game_screen, 170, 320);
-            lv_obj_align(seven2, LV_ALIGN_TOP_LEFT, 5 + 150, 0);
-
-            seven3 = lv_7seg_create(game_screen, 170, 320);
-            lv_obj_align(seven3, LV_ALIGN_TOP_LEFT, 5 + 150 * 2, 0);
-
-            seven4 = lv_7seg_create(game_screen, 170, 320);
-            lv_obj_align(seven4, LV_ALIGN_TOP_LEFT, 5 + 150 * 3, 0);
-
-            seven5 = lv_7seg_create(game_screen, 170, 320  );
-            lv_obj_align(seven5, LV_ALIGN_TOP_LEFT, 5 + 150 * 4, 0);
-
-            lv_7seg_set_digit(seven1, ' ', false);
-            lv_7seg_set_digit(seven2, ' ', false);
-            lv_7seg_set_digit(seven3, ' ', false);
-            lv_7seg_set_digit(seven4, ' ', false);
-            lv_7seg_set_digit(seven5, ' ', false);
+            seven = lv_7seg_display_create(game_screen, 5, 170, 320, 150);
+            lv_obj_align(seven, LV_ALIGN_TOP_LEFT, 5, 0);
+            lv_7seg_display_set_style(seven, SEVEN_SEGMENT_STYLE);
+            lv_7seg_display_fill(seven, ' ', false);
         }
 
         void handle_ok(lv_event_t * e)
         {
             lv_event_code_t code = lv_event_get_code(e);
             if(code == LV_EVENT_CLICKED) {
-                switch (game_state) {
-                    case GAME_END:
-                        game_state = GAME_IDLE;
-                        lvgl_port_lock(-1);
-                        lv_label_set_text(overlayscreen.label_1, "");
-                        lvgl_port_unlock();
-                        startScreenShow();
-                        break;
-
-                    default:
-                        break;
-                }
+                game_post_command(GAME_CMD_OK);
             }
         }
 
@@ -419,11 +547,7 @@ class GameScreen {
         {
             lv_event_code_t code = lv_event_get_code(e);
             if(code == LV_EVENT_CLICKED) {
-                game_state = GAME_IDLE;
-                lvgl_port_lock(-1);
-                lv_label_set_text(overlayscreen.label_1, "Spiel abgebrochen");
-                lvgl_port_unlock();
-                startScreenShow();
+                game_post_command(GAME_CMD_CANCEL);
             }
         }
 
@@ -431,56 +555,25 @@ class GameScreen {
         {
             lv_event_code_t code = lv_event_get_code(e);
             if(code == LV_EVENT_CLICKED) {
-                switch (game_state) {
-                    case GAME_WAIT_FOR_BUZZER2:
-                        buzzers[waitforbuzzer_index].pressed = true;
-                        buzzers[waitforbuzzer_index].press_time = millis() - local_time;
-                        break;
-                }
+                game_post_command(GAME_CMD_TEST);
             }
         }
 
-        void display_time(uint32_t time_ms) {
-            uint8_t upper = (time_ms / 10000);
-            if (upper == 0) {
-                lv_7seg_set_digit(seven1, ' ', false);
-                lv_7seg_set_digit(seven2, (time_ms / 1000) % 10, true);
-                lv_7seg_set_digit(seven3, (time_ms / 100) % 10, false);
-                lv_7seg_set_digit(seven4, (time_ms / 10) % 10, false);
-                lv_7seg_set_digit(seven5, time_ms % 10, false);
-            } else if (upper < 10) {
-                lv_7seg_set_digit(seven1, upper, false);
-                lv_7seg_set_digit(seven2, (time_ms / 1000) % 10, true);
-                lv_7seg_set_digit(seven3, (time_ms / 100) % 10, false);
-                lv_7seg_set_digit(seven4, (time_ms / 10) % 10, false);
-                lv_7seg_set_digit(seven5, time_ms % 10, false);
-            } else if (upper < 100) {
-                lv_7seg_set_digit(seven1, (time_ms / 100000) % 10, false);
-                lv_7seg_set_digit(seven2, (time_ms / 10000) % 10, false);
-                lv_7seg_set_digit(seven3, (time_ms / 1000) % 10, true);
-                lv_7seg_set_digit(seven4, (time_ms / 100) % 10, false);
-                lv_7seg_set_digit(seven5, (time_ms / 10) % 10, false);
-            } else if (upper < 1000) {
-                lv_7seg_set_digit(seven1, (time_ms / 1000000) % 10, false);
-                lv_7seg_set_digit(seven2, (time_ms / 100000) % 10, false);
-                lv_7seg_set_digit(seven3, (time_ms / 10000) % 10, false);
-                lv_7seg_set_digit(seven4, (time_ms / 1000) % 10, true);
-                lv_7seg_set_digit(seven5, (time_ms / 100) % 10, false);
+        // Seconds with three decimals, or four below 10 s when display_tenths is on. Fraction
+        // digits make room for the seconds from 100 s on.
+        void display_time(int64_t time_us) {
+            uint32_t time_ms = time_us / 1000;
+            if (time_ms > DISPLAY_TIME_MAX_MS) {
+                lv_7seg_display_fill(seven, ' ', true);
+            } else if (time_ms < 10000 && display_tenths) {
+                lv_7seg_display_set_value(seven, time_us / 100, 4, LV_7SEG_BLANK_ZEROS | LV_7SEG_AUTO_RANGE);
             } else {
-                lv_7seg_set_digit(seven1, ' ', true);
-                lv_7seg_set_digit(seven2, ' ', true);
-                lv_7seg_set_digit(seven3, ' ', true);
-                lv_7seg_set_digit(seven4, ' ', true);
-                lv_7seg_set_digit(seven5, ' ', true);
+                lv_7seg_display_set_value(seven, time_ms, 3, LV_7SEG_BLANK_ZEROS | LV_7SEG_AUTO_RANGE);
             }
         }
 
         void show() {
-            lv_7seg_set_digit(seven1, ' ', true);
-            lv_7seg_set_digit(seven2, ' ', true);
-            lv_7seg_set_digit(seven3, ' ', true);
-            lv_7seg_set_digit(seven4, ' ', true);
-            lv_7seg_set_digit(seven5, ' ', true);
+            lv_7seg_display_fill(seven, ' ', true);
             lv_obj_set_style_bg_color(game_screen, lv_color_hex(0xe4032e), LV_PART_MAIN);
             lv_obj_clear_flag(game_screen, LV_OBJ_FLAG_HIDDEN);
         }
@@ -489,53 +582,27 @@ class GameScreen {
             lv_obj_add_flag(game_screen, LV_OBJ_FLAG_HIDDEN);
         }
 
-        void readysetgo() {
-            lvgl_port_lock(-1);
+        void gamestarted() {
             lv_obj_add_flag(okbtn, LV_OBJ_FLAG_HIDDEN);
             lv_obj_clear_flag(cancelbtn, LV_OBJ_FLAG_HIDDEN);
             lv_obj_clear_flag(testbtn, LV_OBJ_FLAG_HIDDEN);
-            lv_7seg_set_digit(seven1, ' ', false);
-            lv_7seg_set_digit(seven2, ' ', false);
-            lv_7seg_set_digit(seven3, '3', false);
-            lv_7seg_set_digit(seven4, ' ', false);
-            lv_7seg_set_digit(seven5, ' ', false);
-            lv_label_set_text(overlayscreen.label_1, "Bereit?");
-            lvgl_port_unlock();
-            delay(1000);
-            lvgl_port_lock(-1);
-            lv_7seg_set_digit(seven3, '2', false);
-            lv_label_set_text(overlayscreen.label_1, "Auf die Plätze...");
-            lvgl_port_unlock();
-            delay(1000);
-            lvgl_port_lock(-1);
-            lv_7seg_set_digit(seven3, '1', false);
-            lv_label_set_text(overlayscreen.label_1, "Fertig...");
-            lvgl_port_unlock();
-            delay(1000);
-            lvgl_port_lock(-1);
-            lv_7seg_set_digit(seven5, ' ', false);
-            lv_label_set_text(overlayscreen.label_1, "Los!");
-            lvgl_port_unlock();
+            lv_7seg_display_fill(seven, ' ', false);
+        }
+
+        void countdown(char digit) {
+            lv_7seg_display_set_digit(seven, 2, digit, false);
         }
 
         void gameended() {
             lv_obj_clear_flag(okbtn, LV_OBJ_FLAG_HIDDEN);
             lv_obj_add_flag(cancelbtn, LV_OBJ_FLAG_HIDDEN);
             lv_obj_add_flag(testbtn, LV_OBJ_FLAG_HIDDEN);
-            lv_7seg_set_color(seven1, lv_color_hex(0xc5c405));
-            lv_7seg_set_color(seven2, lv_color_hex(0xc5c405));
-            lv_7seg_set_color(seven3, lv_color_hex(0xc5c405));
-            lv_7seg_set_color(seven4, lv_color_hex(0xc5c405));
-            lv_7seg_set_color(seven5, lv_color_hex(0xc5c405));
+            lv_7seg_display_set_color(seven, lv_color_hex(0xc5c405));
             lv_obj_set_style_bg_color(game_screen, lv_color_hex(0xe4032e), LV_PART_MAIN);
         }
 
         void sevensegcolor(lv_color_t color) {
-            lv_7seg_set_color(seven1, color);
-            lv_7seg_set_color(seven2, color);
-            lv_7seg_set_color(seven3, color);
-            lv_7seg_set_color(seven4, color);
-            lv_7seg_set_color(seven5, color);
+            lv_7seg_display_set_color(seven, color);
         }
 };
 GameScreen gamescreen;
@@ -564,287 +631,456 @@ void startScreenShow() {
     lvgl_port_unlock();
 }
 
-void game_tick() {
-    bool bSendCan = millis() > next_can_packet_millis;
-    if(bSendCan) {
-        next_can_packet_millis = millis() + 1000;
-    }
+// Colour animations of the UI, stepped by the LVGL task. The game task starts and stops them.
+static ColorFades fades;
 
-    lvgl_port_lock(-1);
-    for(uint16_t i = 0; i < buzzers.size(); i++) {
-        BuzzerButton &buzzer = buzzers[i];
+extern GameEngine engine;   // the hooks read the mode and race state back
+static void results_add_game();
 
-        if (!buzzer.bus_offline) {
-            if (millis() - buzzer.last_press_online > 1000) {
-                buzzer.bus_offline = true;
-                printf("!!!! Buzzer %d went offline\n", buzzer.buzzer_id);
-            }
+// LVGL/TWAI side of the game engine. Runs in the game task, so every UI call takes the LVGL lock.
+class DisplayHooks : public GameHooks {
+    public:
+        void send_can(uint32_t id, const uint8_t* data, uint8_t len, TxPriority priority) override {
+            twai_send_message(id, data, len, priority);
         }
 
-        if(buzzer_indicators.size() <= i) {
-            lv_obj_t * indicator = lv_obj_create(overlayscreen.overlay_screen);
-            buzzer_indicators.push_back(indicator);
+        uint32_t random_range(uint32_t lo, uint32_t hi) override {
+            uint32_t value = random(lo, hi);
+            session_log.random(value);
+            return value;
+        }
 
-            lv_obj_set_size(buzzer_indicators[i], 15, 15);
-            lv_obj_align(buzzer_indicators[i], LV_ALIGN_TOP_RIGHT, -5, 5 + i * 20);
-            lv_obj_set_style_radius(buzzer_indicators[i], LV_RADIUS_CIRCLE, LV_PART_MAIN);
+        int64_t now_us() override {
+            int64_t value = time_us();
+            session_log.now_us(value);
+            return value;
         }
 
-        if(buzzers[i].bus_offline) {
-            lv_obj_set_style_bg_color(buzzer_indicators[i], lv_color_hex(0xff8800), LV_PART_MAIN);
-        } else {
-            if(buzzers[i].used_in_game) {
-                if (buzzers[i].pressed) {
-                    lv_obj_set_style_bg_color(buzzer_indicators[i], lv_color_hex(0x000000), LV_PART_MAIN);
-                } else {
-                    lv_obj_set_style_bg_color(buzzer_indicators[i], lv_color_hex(0x00ff00), LV_PART_MAIN);
-                }
+        void state_changed(GameState state, int64_t total_us) override {
+            session_log.state(state, total_us);
+            lvgl_port_lock(-1);
+            if (state == GAME_WAIT_FOR_BUZZER2) {
+                fades.start(FADE_RUNNING);
             } else {
-                lv_obj_set_style_bg_color(buzzer_indicators[i], lv_color_hex(0x008800), LV_PART_MAIN);
+                fades.stop(FADE_RUNNING);
             }
+            lvgl_port_unlock();
+            if (state == GAME_END) {
+                results_add_game();
+            }
+#ifdef BUZZER_SIMULATION
+            if (state == GAME_PREPARING) {
+                sim_bus->reset_outcome();
+            } else if (state == GAME_END && !engine.racing()) {
+                // the sim presses at most one wrong buzzer per round, on whole milliseconds
+                SimStats stats = sim_bus->counters();
+                uint32_t total_ms = total_us / 1000;
+                uint32_t expected_ms = stats.expected_total_ms + stats.penalties * game_mode_penalty(engine.mode(), 1);
+                printf("sim: %s, game total %lld us, expected %lu ms over %lu rounds: %s\n", engine.mode().name,
+                       (long long)total_us, (unsigned long)expected_ms, (unsigned long)stats.rounds,
+                       total_ms == expected_ms ? "OK" : "MISMATCH");
+            }
+#endif
         }
-    }
-    lvgl_port_unlock();
 
-    switch (game_state) {
-        case GAME_IDLE:
-            if (bSendCan) {
-                uint8_t data[8] = {0};
-                data[0] = 0x00;
-                twai_send_message(0x7ff, data, 1);
-            }
-            break;
+        void latency_calibrated(const LatencyTable& table) override;
 
-        case GAME_READYSETGO:
+        // Every state transition; RTC memory keeps it through a watchdog reset or panic.
+        void save_snapshot(const GameSnapshot& snapshot) override {
+            memcpy(rtc_snapshot, &snapshot, sizeof(snapshot));
+        }
+
+        void show_start_screen(const char* message) override {
             lvgl_port_lock(-1);
-            startscreen.hide();
-            gamescreen.show();
+            lv_label_set_text(overlayscreen.label_1, message);
+            lv_label_set_text(overlayscreen.race_label, "");
+            startscreen.show_resume(engine.resumable());
             lvgl_port_unlock();
-            gamescreen.readysetgo();
-            game_state = GAME_PREPARING;
-            break;
+            startScreenShow();
+        }
 
-        case GAME_PREPARING:
-            current_round = 0;
-            total_time = 0;
+        void show_game_screen() override {
+            gameScreenShow();
+            lvgl_port_lock(-1);
+            gamescreen.gamestarted();
+            lvgl_port_unlock();
+        }
 
+        void show_message(const char* message) override {
             lvgl_port_lock(-1);
-            gamescreen.display_time(total_time);
-            gamescreen.sevensegcolor(lv_color_hex(0xe4032e));
+            lv_label_set_text(overlayscreen.label_1, message);
             lvgl_port_unlock();
+        }
 
-            game_state = GAME_STARTING;
-            break;
+        void show_countdown(char digit) override {
+            lvgl_port_lock(-1);
+            gamescreen.countdown(digit);
+            lvgl_port_unlock();
+        }
 
-        case GAME_STARTING:
-            for (BuzzerButton &buzzer : buzzers) {
-                buzzer.clear();
-            }
-            current_round++;
-            if (current_round <= TOTAL_ROUNDS) {
-                std::vector<uint8_t> available_buzzers;
-                for(uint16_t i = 0; i < buzzers.size(); i++) {
-                    BuzzerButton &buzzer = buzzers[i];
-                    if (buzzer.used_in_game) {
-                        available_buzzers.push_back(i);
-                    }
-                }
-                if (!available_buzzers.empty()) {
-                    waitforbuzzer_index = available_buzzers[random(0, available_buzzers.size())];
-                    waitforbuzzer_id = buzzers[waitforbuzzer_index].buzzer_id;
-                } else {
-                    lvgl_port_lock(-1);
-                    lv_label_set_text(overlayscreen.label_1, "Keine Buzzer vorhanden!");
-                    lvgl_port_unlock();
-                    game_state = GAME_FINISHED; // No available buzzers
-                    break;
+        void show_time(int64_t time_us, uint32_t color) override {
+            lvgl_port_lock(-1);
+            gamescreen.display_time(time_us);
+            gamescreen.sevensegcolor(lv_color_hex(color));
+            lvgl_port_unlock();
+        }
+
+        void show_running(int64_t time_us, int64_t now_us) override {
+            lvgl_port_lock(-1);
+            gamescreen.display_time(time_us);
+            lvgl_port_unlock();
+        }
+
+        void show_round(uint8_t round) override {
+            char meldung[32];
+            snprintf(meldung, sizeof(meldung), "Runde %d/%d", round, engine.mode().rounds);
+            lvgl_port_lock(-1);
+            lv_obj_set_style_bg_color(gamescreen.game_screen, lv_color_hex(0xc5c405), LV_PART_MAIN);
+            lv_label_set_text(overlayscreen.label_1, meldung);
+            lvgl_port_unlock();
+        }
+
+        void show_finished(int64_t total_us) override {
+            lvgl_port_lock(-1);
+            gamescreen.display_time(total_us);
+            gamescreen.gameended();
+            lvgl_port_unlock();
+        }
+
+        void show_race(const RaceBoard& board, bool finished) override {
+            char text[RACE_MAX_PLAYERS * 32];
+            size_t len = 0;
+            for (uint8_t pos = 0; pos < board.player_count() && len < sizeof(text); pos++) {
+                uint8_t p = board.leader(pos);
+                const RacePlayer &player = board.player(p);
+                len += snprintf(text + len, sizeof(text) - len, "%s%d. Spieler %d  %lu.%03lu", pos ? "\n" : "", pos + 1, p + 1,
+                                (unsigned long)(player.total_us / 1000000), (unsigned long)(player.total_us / 1000 % 1000));
+                if (player.penalties && len < sizeof(text)) {
+                    len += snprintf(text + len, sizeof(text) - len, " (%d Strafen)", player.penalties);
                 }
-                random_start_time = millis() + random(1500, 3000);
-
-                char meldung[32];
-                snprintf(meldung, sizeof(meldung), "Runde %d", current_round);
-                lvgl_port_lock(-1);
-                lv_obj_set_style_bg_color(gamescreen.game_screen, lv_color_hex(0xc5c405), LV_PART_MAIN);
-                lv_label_set_text(overlayscreen.label_1, meldung);
-                lvgl_port_unlock();
-                game_state = GAME_WAIT_FOR_BUZZER1;
-            } else {
-                lvgl_port_lock(-1);
-                lv_label_set_text(overlayscreen.label_1, "Spiel beendet!");
-                lvgl_port_unlock();
-                game_state = GAME_FINISHED;
             }
-            break;
+            lvgl_port_lock(-1);
+            lv_label_set_text(overlayscreen.race_label, text);
+            if (finished) {
+                snprintf(text, sizeof(text), "Spieler %d gewinnt!", board.leader(0) + 1);
+                lv_label_set_text(overlayscreen.label_1, text);
+            }
+            lvgl_port_unlock();
+        }
 
-        case GAME_WAIT_FOR_BUZZER1:
-            {
-                if (millis() < random_start_time) {
-                    break;
-                }
-                buzzers[waitforbuzzer_index].waiting_for_press = true;
-                local_time = millis();
-                buzzer_time = 0xffffffff;
+        void buzzer_changed(uint16_t i) override;
+        void buzzer_set_changed(uint16_t count) override;
+};
+DisplayHooks displayhooks;
+GameEngine engine(displayhooks);
 
-                uint8_t data[8] = {0};
-                data[0] = 0x01;
-                twai_send_message(buzzers[waitforbuzzer_index].buzzer_id | 0x100, data, 1);
+static esp_timer_handle_t lit_timer = nullptr;
 
-                char meldung[32];
-                snprintf(meldung, sizeof(meldung), "Buzzer %d !!!", waitforbuzzer_id);
-                lvgl_port_lock(-1);
-                lv_label_set_text(overlayscreen.label_1, meldung);
-                lvgl_port_unlock();
+// Wakes the game task at the lit time of a released tournament round, finer than a tick.
+static void lit_timer_expired(void *arg)
+{
+    GameEvent event = {};
+    event.type = GAME_EVENT_TIMER;
+    xQueueSend(game_queue, &event, 0);
+}
 
-                game_state = GAME_WAIT_FOR_BUZZER2;
-            }
-            break;
+// Tournament play holds the rounds; the session log records every change for the replay.
+static void hold_rounds(bool hold)
+{
+    if (hold != engine.holding()) {
+        session_log.hold(hold);
+        engine.hold_rounds(hold);
+    }
+}
 
-        case GAME_WAIT_FOR_BUZZER2:
-            {
-                lvgl_port_lock(-1);
-                if (buzzer_time != 0xffffffff) {
-                    gamescreen.display_time(total_time + buzzer_time);
-                } else {
-                    printf("!!! buzzer_time still not set\n");
-                    gamescreen.display_time(total_time + (millis() - local_time));
-                }
-                lvgl_port_unlock();
-
-                lv_color_t color;
-                uint8_t col = (millis() >> 1) % 256;
-                if (col < 128) {
-                    // Fade from col1 (0xe4032e) to col2 (0xc5c405)
-                    uint8_t r = ((0xe4 * (127 - col)) + (0xc5 * col)) / 127;
-                    uint8_t g = ((0x03 * (127 - col)) + (0xc4 * col)) / 127;
-                    uint8_t b = ((0x2e * (127 - col)) + (0x05 * col)) / 127;
-                    color = lv_color_make(r, g, b);
-                } else {
-                    // Fade from col2 (0xc5c405) back to col1 (0xe4032e)
-                    uint8_t t = col - 128;
-                    uint8_t r = ((0xc5 * (127 - t)) + (0xe4 * t)) / 127;
-                    uint8_t g = ((0xc4 * (127 - t)) + (0x03 * t)) / 127;
-                    uint8_t b = ((0x05 * (127 - t)) + (0x2e * t)) / 127;
-                    color = lv_color_make(r, g, b);
-                }
+// Tournament side of the display. Runs in the game task like DisplayHooks.
+class TournamentDisplayHooks : public TournamentHooks {
+    public:
+        void send_can(uint32_t id, const uint8_t* data, uint8_t len) override {
+            twai_send_message(id, data, len, TX_PRIORITY_GAME);
+        }
 
-                lv_obj_set_style_bg_color(gamescreen.game_screen, color, LV_PART_MAIN);
-
-
-                for(BuzzerButton &buzzer : buzzers) {
-                    if (buzzer.pressed) {
-                        if (buzzer.waiting_for_press) {
-                            total_time += buzzer.press_time;
-                            game_state = GAME_ROUND_COMPLETE;
-                            break;
-                        } else {
-                            total_time += 1000; // Add 1000ms penalty for incorrect buzzer
-                            printf("!!! penalty for buzzer %d\n", buzzer.buzzer_id);
-                        }
-                        buzzer.pressed = false;
-                    }
-                }
+        uint32_t random_range(uint32_t lo, uint32_t hi) override {
+            return random(lo, hi);
+        }
 
-                if (bSendCan) {
-                    uint8_t data[8] = {0};
-                    data[0] = 0x01;
-                    twai_send_message(buzzers[waitforbuzzer_index].buzzer_id | 0x100, data, 1);
-                }
+        int64_t now_us() override {
+            return time_us();
+        }
+
+        // Right away, so the engine never reports the previous heat's result for this one.
+        void start_heat(uint8_t heat, uint8_t variant) override {
+            hold_rounds(true);
+            if (engine.state() == GAME_END) {
+                run_command(GAME_CMD_OK, 0);
+            } else if (engine.state() != GAME_IDLE) {
+                run_command(GAME_CMD_CANCEL, 0);
             }
-            break;
+            run_command(GAME_CMD_START, variant);
+        }
 
-        case GAME_ROUND_COMPLETE:
-            {
-                waitforbuzzer_index = 0xffff;
-                waitforbuzzer_id = 0;
-                if (bSendCan) {
-                    uint8_t data[8] = {0};
-                    data[0] = 0x00;
-                    twai_send_message(0x7ff, data, 1);
+        void release_round(uint8_t round, int64_t lit_us) override {
+            session_log.release(lit_us);
+            engine.release(lit_us);
+            int64_t delay_us = lit_us - time_us();
+            esp_timer_stop(lit_timer);
+            esp_timer_start_once(lit_timer, delay_us > 0 ? delay_us : 0);
+        }
+
+        void show_standing(const TournamentBracket& bracket, uint8_t self, bool final) override {
+            uint8_t nodes[TOURNAMENT_MAX_NODES];
+            uint8_t count = bracket.ranking(nodes);
+            char text[8 * 40];
+            size_t len = snprintf(text, sizeof(text), "Lauf %d", bracket.heat());
+            // the label fits eight lines below the heat
+            for (uint8_t pos = 0; pos < count && pos < 8 && len < sizeof(text); pos++) {
+                uint8_t n = nodes[pos];
+                if (bracket.has_result(n)) {
+                    int64_t total = bracket.total(n);
+                    len += snprintf(text + len, sizeof(text) - len, "\n%d. Wand %d  %lu.%03lu%s", pos + 1, n,
+                                    (unsigned long)(total / 1000000), (unsigned long)(total / 1000 % 1000),
+                                    (bracket.survivors() >> n) & 1 ? " *" : "");
+                } else if (bracket.dnf(n)) {
+                    len += snprintf(text + len, sizeof(text) - len, "\n%d. Wand %d  abgebrochen", pos + 1, n);
+                } else {
+                    len += snprintf(text + len, sizeof(text) - len, "\n%d. Wand %d  -", pos + 1, n);
                 }
-                for (BuzzerButton &buzzer : buzzers) {
-                    buzzer.clear();
+            }
+            char message[32] = "";
+            if (final) {
+                if (count && bracket.has_result(nodes[0])) {
+                    snprintf(message, sizeof(message), "Wand %d gewinnt!", nodes[0]);
+                } else {
+                    snprintf(message, sizeof(message), "Turnier beendet");
                 }
-                game_state = GAME_STARTING;
+            } else if ((bracket.survivors() >> self) & 1) {
+                snprintf(message, sizeof(message), "Weiter in Lauf %d", bracket.heat() + 1);
+            } else if (bracket.reported() && ((bracket.entrants() >> self) & 1)) {
+                snprintf(message, sizeof(message), "Ausgeschieden");
             }
-            break;
-
-        case GAME_FINISHED:
             lvgl_port_lock(-1);
-            gamescreen.display_time(total_time);
-            gamescreen.gameended();
+            lv_label_set_text(overlayscreen.race_label, text);
+            lv_label_set_text(overlayscreen.label_1, message);
             lvgl_port_unlock();
-            game_state = GAME_END;
-            break;
+        }
 
-        case GAME_END:
-            // wait key press
-            break;
+    private:
+        // Outside engine.handle(), recorded like a queued command for replay.
+        void run_command(GameCommand command, uint8_t arg) {
+            GameEvent event = {};
+            event.type = GAME_EVENT_COMMAND;
+            event.command = command;
+            event.arg = arg;
+            int64_t now = time_us();
+            session_log.event(event, now);
+            engine.handle(event, now);
+        }
+};
+TournamentDisplayHooks tournamenthooks;
+static TournamentNode *tournament = nullptr;   // created in setup() with the node id
+
+// The game loop only records indicator colours; indicator_sync() applies them in the LVGL task.
+void DisplayHooks::buzzer_changed(uint16_t i) {
+    const BuzzerButton &buzzer = engine.buttons()[i];
+
+    uint32_t color;
+    if(buzzer.bus_offline) {
+        color = 0xff8800;
+    } else {
+        if(buzzer.used_in_game) {
+            if (buzzer.pressed) {
+                color = 0x000000;
+            } else {
+                color = 0x00ff00;
+            }
+        } else {
+            color = 0x008800;
+        }
+    }
+
+    taskENTER_CRITICAL(&indicator_lock);
+    if (indicator_colors[i] != color) {
+        indicator_colors[i] = color;
+        indicators_dirty = true;
     }
+    taskEXIT_CRITICAL(&indicator_lock);
 }
 
-static void twai_send_message(uint32_t id, const uint8_t* data, uint8_t len) {
-  twai_message_t message;
-  message.extd = (id & 0x80000000) != 0;
-  message.identifier = id & 0x1FFFFFFF;
-  message.data_length_code = len;
-  for (int i = 0; i < message.data_length_code; i++) {
-    message.data[i] = data[i];
-  }
-  if (twai_transmit(&message, pdMS_TO_TICKS(1000)) == ESP_OK) {
-    printf("Message queued for transmission\n"); // Print success message
-  } else {
-    printf("Failed to queue message for transmission\n"); // Print failure message
-  }
-  memset(message.data, 0, sizeof(message.data)); // Clear the entire array
+void DisplayHooks::buzzer_set_changed(uint16_t count) {
+    taskENTER_CRITICAL(&indicator_lock);
+    indicator_count = count;
+    indicators_dirty = true;
+    taskEXIT_CRITICAL(&indicator_lock);
 }
 
-static void handle_rx_message(const twai_message_t &message)
+// LVGL timer: create, retire and recolour the indicators in one batch.
+static void indicator_sync(lv_timer_t *timer)
 {
-    // Assuming the message ID corresponds to the buzzer ID
-    uint16_t buzzer_id = message.identifier;
-    uint32_t press_id = message.data[0];
-    uint32_t press_millis = message.data[4] << 24 | message.data[5] << 16 | message.data[6] << 8 | message.data[7];
-    printf("Message received from buzzer %d\n", buzzer_id);
-    for(BuzzerButton &buzzer : buzzers) {
-        if(buzzer.buzzer_id == buzzer_id) {
-            if (buzzer.last_press_id != press_id) {
-                if (game_state == GAME_WAIT_FOR_BUZZER2) {
-                    if (buzzer.last_press_online != 0) {
-                        buzzer.last_press_id = press_id;
-                        if (!buzzer.pressed) {
-                            buzzer.pressed = true;
-                            buzzer.press_time = press_millis;
-                        }
-                    }
-                } else {
-                    printf("!!! press buzzer_id %d, id %d not in game\n", buzzer_id, press_id);
-                }
-            }
-            
-            if (waitforbuzzer_index != 0xffffffff) {
-                if (buzzers[waitforbuzzer_index].buzzer_id == buzzer_id) {
-                    buzzer_time = press_millis;
-                }
-            }
+    static uint32_t shown_colors[BUZZER_REGISTRY_CAPACITY];
+    uint32_t colors[BUZZER_REGISTRY_CAPACITY];
 
-            buzzer.last_press_online = millis();
-            if (buzzer.bus_offline) {
-                printf("!!!! Buzzer %d went online\n", buzzer.buzzer_id);
-                buzzer.bus_offline = false;
-            }
+    taskENTER_CRITICAL(&indicator_lock);
+    if (!indicators_dirty) {
+        taskEXIT_CRITICAL(&indicator_lock);
+        return;
+    }
+    uint16_t count = indicator_count;
+    memcpy(colors, indicator_colors, count * sizeof(colors[0]));
+    indicators_dirty = false;
+    taskEXIT_CRITICAL(&indicator_lock);
+
+    while (buzzer_indicators.size() > count) {
+        lv_obj_del(buzzer_indicators.back());
+        buzzer_indicators.pop_back();
+    }
+    for (uint16_t i = 0; i < count; i++) {
+        if (buzzer_indicators.size() <= i) {
+            lv_obj_t * indicator = lv_obj_create(overlayscreen.overlay_screen);
+            buzzer_indicators.push_back(indicator);
+
+            lv_obj_set_size(indicator, 15, 15);
+            lv_obj_align(indicator, LV_ALIGN_TOP_RIGHT, -5 - (i / INDICATOR_ROWS) * 20, 5 + (i % INDICATOR_ROWS) * 20);
+            lv_obj_set_style_radius(indicator, LV_RADIUS_CIRCLE, LV_PART_MAIN);
+            shown_colors[i] = colors[i] + 1;
+        }
+        if (shown_colors[i] != colors[i]) {
+            lv_obj_set_style_bg_color(buzzer_indicators[i], lv_color_hex(colors[i]), LV_PART_MAIN);
+            shown_colors[i] = colors[i];
         }
     }
 }
 
 #define TWAI_RX_PIN 19
 #define TWAI_TX_PIN 20
+#define TWAI_RX_QUEUE_LEN           (32)
+#define TWAI_TX_QUEUE_LEN           (2)     // keep frames in the scheduler, where they can coalesce
+#define TWAI_TX_TIMEOUT_MS          (100)
+#define TWAI_TX_TASK_STACK_SIZE     (3 * 1024)
+#define TWAI_TX_TASK_PRIORITY       (configMAX_PRIORITIES - 3)
+#define TWAI_RX_TASK_STACK_SIZE     (4 * 1024)
+#define TWAI_RX_TASK_PRIORITY       (configMAX_PRIORITIES - 2)  // above LVGL and the game loop
+#define TWAI_RX_TASK_CORE           (0)                         // the game loop and LVGL run on the Arduino core
+#define TWAI_RX_BATCH               (32)
+#define TWAI_RX_POLL_MS             (100)
+#define BUS_HEALTH_PERIOD_MS        (100)
+#define BUS_HEALTH_TASK_STACK_SIZE  (3 * 1024)
+#define BUS_HEALTH_TASK_PRIORITY    (configMAX_PRIORITIES - 3)
+#define GAME_QUEUE_LENGTH           (32)
+#ifndef TOURNAMENT_NODE
+#define TOURNAMENT_NODE             (-1)    // build flag per display, -1: low bits of the MAC address
+#endif
+#ifndef BUZZER_UNUSED_IDS
+#define BUZZER_UNUSED_IDS           3       // build flag: wall positions that never light, comma-separated
+#endif
+#ifndef WALL_BUZZER_FIRST
+#define WALL_BUZZER_FIRST           WALL_FIRST_ID   // build flags per display when walls share a bus:
+#endif
+#ifndef WALL_BUZZER_LAST
+#define WALL_BUZZER_LAST            WALL_LAST_ID    // the buzzer ids of this display's wall
+#endif
+#define RX_UNWANTED_REPORT_STEP     (100)   // report the unwanted frame count every this many
+#ifdef SEVEN_SEGMENT_REPORT
+// Build with -D SEVEN_SEGMENT_REPORT to print the invalidated 7-segment pixels per second.
+#define SEVEN_REPORT_PERIOD_MS      (1000)  // reported while nonzero
+#endif
+
+#ifdef BUZZER_SIMULATION
+// Build with -D BUZZER_SIMULATION=<n> to replace the TWAI controller by n virtual buzzers.
+// All of them are registered up to the registry capacity, the rest is load on the bus.
+#define SIM_HEARTBEAT_MS            (100)
+#define SIM_REACTION_MIN_MS         (150)
+#define SIM_REACTION_MAX_MS         (900)
+#define SIM_LOSS_PERMILLE           (5)
+#define SIM_DUPLICATE_PERMILLE      (20)
+#define SIM_WRONG_PRESS_PERMILLE    (200)
+#define SIM_BUSOFF_PERIOD_MS        (60000)
+#define SIM_BUSOFF_MS               (1500)  // long enough for the offline timeout
+#define SIM_DRIFT_PPM               (50)
+#define SIM_REPORT_PERIOD_MS        (5000)
+
+static int64_t sim_clock()
+{
+    return time_us();
+}
+
+static void sim_sleep(uint32_t ms)
+{
+    vTaskDelay(pdMS_TO_TICKS(ms) ? pdMS_TO_TICKS(ms) : 1);
+}
+#endif
+
+// Non-blocking: queue the frame in the TX scheduler and wake the TX task.
+static void twai_send_message(uint32_t id, const uint8_t* data, uint8_t len, TxPriority priority) {
+  taskENTER_CRITICAL(&tx_lock);
+  tx_scheduler.enqueue(id, data, len, priority);
+  taskEXIT_CRITICAL(&tx_lock);
+  if (tx_task_handle != nullptr) {
+    xTaskNotifyGive(tx_task_handle);
+  }
+}
+
+static TxStats twai_tx_stats() {
+  taskENTER_CRITICAL(&tx_lock);
+  TxStats stats = tx_scheduler.counters();
+  taskEXIT_CRITICAL(&tx_lock);
+  return stats;
+}
+
+// Owns CanBus::transmit(). Only this task waits for room in the driver TX queue.
+static void twai_tx_task(void *arg)
+{
+  for (;;) {
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    for (;;) {
+      TxFrame frame;
+      taskENTER_CRITICAL(&tx_lock);
+      bool pending = tx_scheduler.next(frame);
+      taskEXIT_CRITICAL(&tx_lock);
+      if (!pending) {
+        break;
+      }
+
+      CanFrame message;
+      message.id = frame.id;
+      message.len = frame.len;
+      memcpy(message.data, frame.data, sizeof(message.data));
+      bool sent = can_bus->transmit(message, TWAI_TX_TIMEOUT_MS);
+
+      taskENTER_CRITICAL(&tx_lock);
+      if (sent) {
+        tx_scheduler.mark_sent();
+      } else {
+        tx_scheduler.mark_failed();
+      }
+      taskEXIT_CRITICAL(&tx_lock);
+    }
+  }
+}
 
-bool twai_init()
+// TWAI register layout for standard frames: single mode matches the id in bits 31..21,
+// dual mode filter 1 in bits 31..21 and filter 2 in bits 15..5. RTR and data bits are don't care.
+static twai_filter_config_t twai_filter_config(const CanFilter& filter)
+{
+  twai_filter_config_t f_config;
+  if (filter.dual) {
+    f_config.acceptance_code = (uint32_t)filter.ranges[0].code << 21 | (uint32_t)filter.ranges[1].code << 5;
+    f_config.acceptance_mask = (uint32_t)filter.ranges[0].mask << 21 | 0x1F0000 | (uint32_t)filter.ranges[1].mask << 5 | 0x1F;
+  } else {
+    f_config.acceptance_code = (uint32_t)filter.ranges[0].code << 21;
+    f_config.acceptance_mask = (uint32_t)filter.ranges[0].mask << 21 | 0x1FFFFF;
+  }
+  f_config.single_filter = !filter.dual;
+  return f_config;
+}
+
+bool twai_init(const CanFilter& filter)
 {
   // Initialize configuration structures using macro initializers
   twai_general_config_t g_config = TWAI_GENERAL_CONFIG_DEFAULT((gpio_num_t)TWAI_TX_PIN, (gpio_num_t)TWAI_RX_PIN, TWAI_MODE_NORMAL);
+  g_config.rx_queue_len = TWAI_RX_QUEUE_LEN;
+  g_config.tx_queue_len = TWAI_TX_QUEUE_LEN;
   twai_timing_config_t t_config = TWAI_TIMING_CONFIG_250KBITS();
-  twai_filter_config_t f_config = TWAI_FILTER_CONFIG_ACCEPT_ALL();
+  twai_filter_config_t f_config = twai_filter_config(filter);
 
   // Install TWAI driver
   if (twai_driver_install(&g_config, &t_config, &f_config) != ESP_OK)
@@ -866,7 +1102,7 @@ bool twai_init()
   twai_clear_transmit_queue();
 
   // Reconfigure alerts to detect frame receive, Bus-Off error, and RX queue full states
-  uint32_t alerts_to_enable = TWAI_ALERT_RX_DATA | TWAI_ALERT_ERR_PASS | TWAI_ALERT_BUS_ERROR | TWAI_ALERT_RX_QUEUE_FULL | TWAI_ALERT_RECOVERY_IN_PROGRESS | TWAI_ALERT_BUS_RECOVERED | TWAI_ALERT_ERR_PASS;
+  uint32_t alerts_to_enable = TWAI_ALERT_ERR_PASS | TWAI_ALERT_BUS_ERROR | TWAI_ALERT_RX_QUEUE_FULL | TWAI_ALERT_RECOVERY_IN_PROGRESS | TWAI_ALERT_BUS_RECOVERED | TWAI_ALERT_ERR_PASS;
   if (twai_reconfigure_alerts(alerts_to_enable, NULL) == ESP_OK)
   {
     Serial.println("CAN Alerts reconfigured"); // Print success message
@@ -879,52 +1115,472 @@ bool twai_init()
   return true;
 }
 
-void twai_receive()
+class TwaiBus : public CanBus {
+  public:
+    TwaiBus() {}
+
+    bool transmit(const CanFrame& frame, uint32_t timeout_ms) override {
+      twai_message_t message = {};
+      message.extd = (frame.id & 0x80000000) != 0;
+      message.identifier = frame.id & 0x1FFFFFFF;
+      message.data_length_code = frame.len;
+      memcpy(message.data, frame.data, sizeof(message.data));
+      return twai_transmit(&message, pdMS_TO_TICKS(timeout_ms)) == ESP_OK;
+    }
+
+    bool status(CanStatus& status) override {
+      twai_status_info_t info;
+      esp_err_t err = twai_get_status_info(&info);
+      if (err != ESP_OK) {
+        return false;
+      }
+      switch (info.state) {
+        case TWAI_STATE_RUNNING:    status.state = BUS_STATE_RUNNING; break;
+        case TWAI_STATE_BUS_OFF:    status.state = BUS_STATE_BUS_OFF; break;
+        case TWAI_STATE_RECOVERING: status.state = BUS_STATE_RECOVERING; break;
+        default:                    status.state = BUS_STATE_STOPPED; break;
+      }
+      status.tx_error_counter = info.tx_error_counter;
+      status.rx_error_counter = info.rx_error_counter;
+      status.bus_error_count = info.bus_error_count;
+      status.arb_lost_count = info.arb_lost_count;
+      status.rx_missed_count = info.rx_missed_count + info.rx_overrun_count;
+      status.tx_failed_count = info.tx_failed_count;
+      return true;
+    }
+
+    void recover() override {
+      twai_initiate_recovery();
+    }
+
+    void start() override {
+      twai_start();
+    }
+
+    // Blocks in twai_receive(), which the TWAI ISR wakes for every frame, and stamps each frame
+    // as it is read, so a frame that queued up behind others is late only by their copies.
+    // Frames already queued are read without waiting. Extended and remote frames are not ours.
+    size_t receive(CanFrame* frames, size_t max, uint32_t timeout_ms) override {
+      size_t n = 0;
+      TickType_t wait = timeout_ms == CAN_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(timeout_ms);
+      twai_message_t message;
+      while (n < max && twai_receive(&message, n == 0 ? wait : 0) == ESP_OK)
+      {
+          int64_t now = time_us();
+          if (message.extd || message.rtr) {
+              continue;
+          }
+          frames[n].id = message.identifier;
+          frames[n].len = message.data_length_code;
+          memcpy(frames[n].data, message.data, sizeof(frames[n].data));
+          frames[n].rx_time_us = now;
+          n++;
+      }
+      report_alerts();
+      return n;
+    }
+
+  private:
+    // Bus errors are only logged here; BusHealth acts on the controller state.
+    void report_alerts() {
+      uint32_t alerts_triggered;
+      if (twai_read_alerts(&alerts_triggered, 0) != ESP_OK) {
+        return;
+      }
+      if (alerts_triggered & TWAI_ALERT_BUS_ERROR)
+      {
+          twai_status_info_t twaistatus;                                       // Create status info structure
+          twai_get_status_info(&twaistatus);                                   // Get status information
+          Serial.println("Alert: A (Bit, Stuff, CRC, Form, ACK) error has occurred on the bus."); // Print bus error alert
+          Serial.printf("Bus error count: %d\n", twaistatus.bus_error_count);                     // Print bus error count
+      }
+      else if (alerts_triggered & TWAI_ALERT_ERR_PASS)
+      {
+          Serial.println("Alert: TWAI controller has become error passive."); // Print passive error alert
+      }
+      else if (alerts_triggered & TWAI_ALERT_RX_QUEUE_FULL)
+      {
+          // Frames were lost in the driver, the ones still queued are valid.
+          twai_status_info_t twaistatus;                                       // Create status info structure
+          twai_get_status_info(&twaistatus);                                   // Get status information
+          Serial.println("Alert: The RX queue is full causing a received frame to be lost."); // Print RX queue full alert
+          Serial.printf("RX buffered: %d\t", twaistatus.msgs_to_rx);                          // Print buffered RX messages
+          Serial.printf("RX missed: %d\t", twaistatus.rx_missed_count);                       // Print missed RX count
+          Serial.printf("RX overrun %d\n", twaistatus.rx_overrun_count);                      // Print RX overrun count
+      }
+    }
+};
+
+// Drops what the hardware filter let through but is not ours, decodes every other frame with its
+// own reception time, pushes it into the RX ring for the game loop and posts one wake-up per batch.
+static void twai_rx_task(void *arg)
 {
-  // Check if alert happened
-  uint32_t alerts_triggered;
-  if (twai_read_alerts(&alerts_triggered, 0) == ESP_OK) {
-    if (alerts_triggered & TWAI_ALERT_BUS_ERROR)
-    {
-        twai_status_info_t twaistatus;                                       // Create status info structure
-        twai_get_status_info(&twaistatus);                                   // Get status information
-        Serial.println("Alert: A (Bit, Stuff, CRC, Form, ACK) error has occurred on the bus."); // Print bus error alert
-        Serial.printf("Bus error count: %d\n", twaistatus.bus_error_count);                     // Print bus error count
-    }
-    else if (alerts_triggered & TWAI_ALERT_ERR_PASS)
-    {
-        Serial.println("Alert: TWAI controller has become error passive."); // Print passive error alert
-    }
-    else if (alerts_triggered & TWAI_ALERT_RX_QUEUE_FULL)
-    {
-        twai_status_info_t twaistatus;                                       // Create status info structure
-        twai_get_status_info(&twaistatus);                                   // Get status information
-        Serial.println("Alert: The RX queue is full causing a received frame to be lost."); // Print RX queue full alert
-        Serial.printf("RX buffered: %d\t", twaistatus.msgs_to_rx);                          // Print buffered RX messages
-        Serial.printf("RX missed: %d\t", twaistatus.rx_missed_count);                       // Print missed RX count
-        Serial.printf("RX overrun %d\n", twaistatus.rx_overrun_count);                      // Print RX overrun count
-        twai_clear_receive_queue();
-        twai_clear_transmit_queue();
-    }
-
-    if (alerts_triggered & TWAI_ALERT_RX_DATA)
-    {
-        // One or more messages received. Handle all.
-        twai_message_t message;
-        while (twai_receive(&message, 0) == ESP_OK)
-        {                             // Receive messages
-        handle_rx_message(message); // Handle each received message
+  static CanFrame frames[TWAI_RX_BATCH];
+  for (;;) {
+    size_t n = can_bus->receive(frames, TWAI_RX_BATCH, TWAI_RX_POLL_MS);
+    bool received = false;
+    for (size_t i = 0; i < n; i++) {
+        if (!rx_acceptance.accepts(frames[i].id)) {
+            rx_unwanted.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        if ((frames[i].id & TOURNAMENT_ID_MASK) == TOURNAMENT_ID) {
+            received |= tournament_ring.push(frames[i]);
+            continue;
+        }
+        BuzzerFrame events[BUZZER_FRAME_MAX_EVENTS];
+        uint8_t count = buzzer_frame_decode(frames[i].id, frames[i].data, frames[i].len, frames[i].rx_time_us, events);
+        if (count == 0) {
+            rx_unwanted.fetch_add(1, std::memory_order_relaxed);
+        }
+        for (uint8_t e = 0; e < count; e++) {
+            received |= rx_ring.push(events[e]);
         }
     }
+    if (received) {
+        GameEvent event = {};
+        event.type = GAME_EVENT_RX;
+        xQueueSend(game_queue, &event, 0); // a full queue already holds a wake-up
+    }
+  }
+}
+
+// Samples the controller and recovers from bus-off, see BusHealth for the backoff.
+static void bus_health_task(void *arg)
+{
+  for (;;) {
+    vTaskDelay(pdMS_TO_TICKS(BUS_HEALTH_PERIOD_MS));
+    CanStatus status;
+    if (!can_bus->status(status)) {
+      continue;
+    }
+    switch (bus_health.sample(status, time_ms())) {
+      case BUS_ACTION_RECOVER:
+        can_bus->recover();
+        break;
+      case BUS_ACTION_START:
+        can_bus->start();
+        break;
+      default:
+        break;
+    }
   }
+}
+
+#define SESSION_LOG_RECORDS         (64 * 1024) // 1 MB of PSRAM
+#define SESSION_FILE                "/session.bin"
+#define SESSION_PREV_FILE           "/session.prev.bin"
+#define SESSION_FILE_MAX_SIZE       (1024 * 1024)
+#define SESSION_FLUSH_PERIOD_MS     (250)
+#define SESSION_FLUSH_BATCH         (64)
+#define SESSION_TASK_STACK_SIZE     (4 * 1024)
+#define SESSION_TASK_PRIORITY       (1)         // below the game loop, flash writes must never stall it
+
+// Append the recorded session to LittleFS. The previous boot's session is kept as SESSION_PREV_FILE.
+static void session_flush_task(void *arg)
+{
+    LittleFS.remove(SESSION_PREV_FILE);
+    LittleFS.rename(SESSION_FILE, SESSION_PREV_FILE);
+
+    File file = LittleFS.open(SESSION_FILE, FILE_WRITE);
+    if (!file) {
+        printf("!!! Failed to open %s\n", SESSION_FILE);
+        vTaskDelete(NULL);
+        return;
+    }
+
+    static SessionRecord batch[SESSION_FLUSH_BATCH];
+    size_t written = 0;
+    while (1) {
+        vTaskDelay(pdMS_TO_TICKS(SESSION_FLUSH_PERIOD_MS));
+
+        size_t n;
+        bool dirty = false;
+        while ((n = session_log.read(batch, SESSION_FLUSH_BATCH)) > 0) {
+            if (written + n * sizeof(SessionRecord) > SESSION_FILE_MAX_SIZE) {
+                // keep draining the ring, the file holds the start of the session
+                continue;
+            }
+            written += file.write((const uint8_t *)batch, n * sizeof(SessionRecord));
+            dirty = true;
+        }
+        if (dirty) {
+            file.flush();
+        }
+    }
+}
 
+static void session_log_init()
+{
+    SessionRecord *storage = (SessionRecord *)heap_caps_malloc(SESSION_LOG_RECORDS * sizeof(SessionRecord), MALLOC_CAP_SPIRAM);
+    if (storage == nullptr) {
+        printf("!!! No PSRAM for the session log\n");
+        return;
+    }
+    if (!LittleFS.begin(true)) {
+        printf("!!! Failed to mount LittleFS, session log disabled\n");
+        heap_caps_free(storage);
+        return;
+    }
+    session_log.begin(storage, SESSION_LOG_RECORDS);
+    xTaskCreate(session_flush_task, "session_log", SESSION_TASK_STACK_SIZE, NULL, SESSION_TASK_PRIORITY, NULL);
+}
+
+#define RESULTS_QUEUE_LENGTH        (RACE_MAX_PLAYERS * 2)
+#define RESULTS_TASK_STACK_SIZE     (4 * 1024)
+#define RESULTS_TASK_PRIORITY       (1)
+#define RESULTS_CLOCK_VALID         (1704067200)    // 2024-01-01: the wall clock was set
+
+// ResultLog files on LittleFS. A write is committed by closing the file; LittleFS rolls an
+// interrupted write back to the last close, so the log never holds a torn record, and a file
+// opened for writing replaces the old one on close.
+class LittleFsResultFiles : public ResultFiles {
+public:
+    size_t read(const char* name, size_t offset, void* data, size_t len) override {
+        if (!LittleFS.exists(name)) {
+            return 0;
+        }
+        File file = LittleFS.open(name, FILE_READ);
+        size_t n = file && file.seek(offset) ? file.read((uint8_t *)data, len) : 0;
+        file.close();
+        return n;
+    }
+    bool append(const char* name, const void* data, size_t len) override {
+        return write(name, FILE_APPEND, data, len);
+    }
+    bool replace(const char* name, const void* data, size_t len) override {
+        return write(name, FILE_WRITE, data, len);
+    }
+    void remove(const char* name) override {
+        if (LittleFS.exists(name)) {
+            LittleFS.remove(name);
+        }
+    }
+
+private:
+    bool write(const char* name, const char* mode, const void* data, size_t len) {
+        File file = LittleFS.open(name, mode);
+        bool ok = file && file.write((const uint8_t *)data, len) == len;
+        file.close();
+        if (!ok) {
+            printf("!!! Failed to write %s\n", name);
+        }
+        return ok;
+    }
+};
+
+static LittleFsResultFiles result_files;
+static ResultLog result_log(result_files);  // the flush task's, after setup()
+
+// Append finished games to the results log, checkpointing it when full.
+static void results_flush_task(void *arg)
+{
+    ResultRecord record;
+    while (1) {
+        if (xQueueReceive(result_queue, &record, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        uint32_t checkpoints = result_log.checkpoints();
+        if (!result_log.append(record)) {
+            printf("!!! Failed to log a result\n");
+        } else if (result_log.checkpoints() != checkpoints) {
+            printf("Results: checkpoint %lu written\n", (unsigned long)result_log.generation());
+        }
+    }
+}
+
+// Rebuild the high-score index from the last checkpoint and the log after it, before the game
+// task runs. The game task indexes new results in its own copy.
+static void results_init()
+{
+    result_queue = xQueueCreate(RESULTS_QUEUE_LENGTH, sizeof(ResultRecord));
+    if (!LittleFS.begin(true)) {
+        printf("!!! Failed to mount LittleFS, results are not kept\n");
+        return;
+    }
+
+    int64_t start = time_us();
+    uint32_t read = result_log.load();
+    results = result_log.index();
+    printf("Results: %lu games indexed in %lld us from checkpoint %lu and %lu log records, %lu corrupt records skipped\n",
+           (unsigned long)results.records(), (long long)(time_us() - start), (unsigned long)result_log.generation(),
+           (unsigned long)read, (unsigned long)results.corrupt());
+    xTaskCreate(results_flush_task, "results", RESULTS_TASK_STACK_SIZE, NULL, RESULTS_TASK_PRIORITY, NULL);
+}
+
+#define LATENCY_FILE                "/latency.bin"
+
+static LatencyTable latency_stored;
+
+// Load the press compensation before the game task runs. The session log records it, so a
+// replay scores the presses the same way.
+static void latency_init()
+{
+    File file = LittleFS.open(LATENCY_FILE, FILE_READ);
+    if (file) {
+        if (file.read((uint8_t *)&latency_stored, sizeof(latency_stored)) != sizeof(latency_stored) || !latency_stored.valid()) {
+            printf("!!! %s is not a latency table, ignored\n", LATENCY_FILE);
+            latency_stored.clear();
+        }
+        file.close();
+    }
+    engine.set_latency(latency_stored);
+    for (uint16_t id = 0; id < LATENCY_IDS; id++) {
+        if (latency_stored.compensation_us(id)) {
+            session_log.latency(id, latency_stored.compensation_us(id));
+        }
+    }
+    printf("Latency: %u buzzers calibrated\n", latency_stored.calibrated());
+}
+
+// Id 0 is no buzzer; it keeps the list valid when the build flag is empty.
+static const uint16_t buzzer_unused_ids[] = {0, BUZZER_UNUSED_IDS};
+
+// Before discovery registers anything, so the buzzers of other walls stay out and the unused
+// positions never light. The session log records both settings for the replay.
+static void buzzers_init()
+{
+    engine.set_wall(WALL_BUZZER_FIRST, WALL_BUZZER_LAST);
+    session_log.wall(WALL_BUZZER_FIRST, WALL_BUZZER_LAST);
+    printf("Wall: buzzers %u to %u\n", WALL_BUZZER_FIRST, WALL_BUZZER_LAST);
+    for (uint16_t id : buzzer_unused_ids) {
+        if (id != 0) {
+            engine.set_used(id, false);
+            session_log.buzzer(id, false);
+            printf("Buzzer %u is not used in games\n", id);
+        }
+    }
+}
+
+// After a calibration, in the game task while idle. LittleFS replaces the file atomically on close.
+void DisplayHooks::latency_calibrated(const LatencyTable& table) {
+    latency_stored = table;
+    latency_stored.seal();
+    File file = LittleFS.open(LATENCY_FILE, FILE_WRITE);
+    if (!file || file.write((const uint8_t *)&latency_stored, sizeof(latency_stored)) != sizeof(latency_stored)) {
+        printf("!!! Failed to write %s\n", LATENCY_FILE);
+    }
+    file.close();
+    lvgl_port_lock(-1);
+    settingsscreen.show_latency(table);
+    lvgl_port_unlock();
+}
+
+static uint16_t results_today()
+{
+    time_t now = time(nullptr);
+    return now >= RESULTS_CLOCK_VALID ? now / 86400 : RESULT_NO_DAY;
+}
+
+static ResultRank results_add(uint8_t player, int64_t total_us, uint8_t penalties)
+{
+    const ReactionStats &stats = engine.stats(player);
+    ResultRecord record = {};
+    record.mode = engine.variant();
+    record.player = player;
+    record.total_us = total_us < UINT32_MAX ? total_us : UINT32_MAX;
+    record.best_us = stats.count() ? stats.min_us() : 0;
+    record.day = results_today();
+    record.penalties = penalties;
+    record.anticipations = stats.anticipations();
+    result_seal(record);
+    if (xQueueSend(result_queue, &record, 0) != pdTRUE) {
+        printf("!!! results queue full, game not saved\n");
+    }
+    return results.add(record);
+}
+
+// Game task, on GAME_END: index the result, queue it for flash and tell the player the rank.
+// A game that stopped early, or a race player who timed out in a round, did not finish (DNF)
+// and is not stored.
+static void results_add_game()
+{
+    if (result_queue == nullptr) {
+        return;
+    }
+    if (!engine.complete()) {
+        printf("game ended after %d of %d rounds, not saved\n", engine.round() - 1, engine.mode().rounds);
+        return;
+    }
+    if (engine.racing()) {
+        const RaceBoard &board = engine.race();
+        for (uint8_t p = 0; p < board.player_count(); p++) {
+            if (board.finished_all(p)) {
+                results_add(p, board.player(p).total_us, board.player(p).penalties);
+            }
+        }
+        return;
+    }
+
+    ResultRank rank = results_add(0, engine.total(), engine.penalties());
+    char meldung[48];
+    if (rank.all_time == 1) {
+        snprintf(meldung, sizeof(meldung), "Neuer Rekord!");
+    } else if (rank.all_time) {
+        snprintf(meldung, sizeof(meldung), "Platz %d der Bestenliste", rank.all_time);
+    } else if (rank.day) {
+        snprintf(meldung, sizeof(meldung), "Platz %d heute", rank.day);
+    } else {
+        return;
+    }
+    lvgl_port_lock(-1);
+    lv_label_set_text(overlayscreen.label_1, meldung);
+    lvgl_port_unlock();
+}
+
+static GameSnapshot restored_snapshot;      // loaded into the engine, logged once the session log runs
+
+// Offer the game that a watchdog reset or panic interrupted. RTC memory is undefined after
+// power-on, so other resets never look at it.
+static bool snapshot_restore()
+{
+    switch (esp_reset_reason()) {
+        case ESP_RST_PANIC:
+        case ESP_RST_INT_WDT:
+        case ESP_RST_TASK_WDT:
+        case ESP_RST_WDT:
+            break;
+        default:
+            return false;
+    }
+    memcpy((void *)&restored_snapshot, rtc_snapshot, sizeof(restored_snapshot));
+    return engine.load_snapshot(restored_snapshot);
+}
+
+// The acceptance set depends only on the wall, so the hardware filter is installed once with the
+// driver and never reinstalled; rx_acceptance drops the rest of what the filter lets through.
+static CanFilter can_filter_init()
+{
+    rx_acceptance.add_display(engine.wall_first_id(), engine.wall_last_id());
+    CanFilter filter = can_filter_compute(rx_acceptance);
+    printf("CAN filter: %s, %u identifiers pass for %u wanted\n", filter.dual ? "dual" : "single",
+           filter.accepted, filter.wanted);
+    return filter;
+}
+
+// Tournament node id: the TOURNAMENT_NODE build flag, or the low 4 bits of the MAC address.
+// A clash is reported by TournamentNode.
+static uint8_t tournament_node_id()
+{
+    if (TOURNAMENT_NODE >= 0) {
+        return TOURNAMENT_NODE % TOURNAMENT_MAX_NODES;
+    }
+    uint8_t mac[6] = {};
+    esp_efuse_mac_get_default(mac);
+    return mac[5] % TOURNAMENT_MAX_NODES;
 }
 
 void setup()
 {
-    delay(3000); // Wait for 2 seconds to allow serial monitor to connect
+    bool resuming = snapshot_restore();
+    if (!resuming) {
+        delay(3000); // Wait for 2 seconds to allow serial monitor to connect
+    }
 
     Serial.begin(115200);
+    if (resuming) {
+        Serial.println("Game interrupted by a reset, offering to resume");
+    }
 
     Serial.println("Initializing board");
     Board *board = new Board();
@@ -951,27 +1607,205 @@ void setup()
     Serial.println("Initializing LVGL");
     lvgl_port_init(board->getLCD(), board->getTouch());
 
-    Serial.println("Initializing TWAI");
-    twai_init();
-
+    // The UI first, so an interrupted game is offered before the flash and the bus are set up;
+    // a touch is queued until loop() runs.
+    game_queue = xQueueCreate(GAME_QUEUE_LENGTH, sizeof(GameEvent));
     Serial.println("Creating UI");
-
     lvgl_port_lock(-1);
     mainscreen.init(lv_scr_act());
     startscreen.init(mainscreen);
     gamescreen.init(mainscreen);
+    fades.add(FADE_RUNNING, gamescreen.game_screen, COLOR_FADE_BG, 0xe4032e, 0xc5c405, FADE_RUNNING_PERIOD_MS);
     overlayscreen.init(mainscreen);
     settingsscreen.init(mainscreen);
+    if (resuming) {
+        lv_label_set_text(overlayscreen.label_1, "Spiel unterbrochen");
+        startscreen.show_resume(true);
+    }
     lvgl_port_unlock();
+    if (resuming) {
+        // esp_timer time, which starts after the bootloaders: add their ~0.3 s for the full boot
+        printf("Resume offered %lld ms after boot\n", (long long)(time_us() / 1000));
+    }
+
+    session_log_init();
+    if (resuming) {
+        session_log.snapshot(restored_snapshot);   // GAME_CMD_RESUME continues it
+    }
+    results_init();
+    latency_init();
+    buzzers_init();
+
+    const esp_timer_create_args_t lit_timer_args = {
+        .callback = &lit_timer_expired,
+        .name = "lit"
+    };
+    esp_timer_create(&lit_timer_args, &lit_timer);
+    tournament = new TournamentNode(tournamenthooks, tournament_node_id());
+    printf("Tournament node %d\n", tournament->node());
+
+    CanFilter can_filter = can_filter_init();
+#ifdef BUZZER_SIMULATION
+    Serial.println("Simulating buzzers");
+    SimConfig sim_config = {};
+    sim_config.buzzers = BUZZER_SIMULATION;
+    sim_config.scored_buzzers = BUZZER_REGISTRY_CAPACITY;
+    sim_config.heartbeat_ms = SIM_HEARTBEAT_MS;
+    sim_config.press_distribution = SIM_PRESS_NORMAL;
+    sim_config.reaction_min_ms = SIM_REACTION_MIN_MS;
+    sim_config.reaction_max_ms = SIM_REACTION_MAX_MS;
+    sim_config.loss_permille = SIM_LOSS_PERMILLE;
+    sim_config.duplicate_permille = SIM_DUPLICATE_PERMILLE;
+    sim_config.wrong_press_permille = SIM_WRONG_PRESS_PERMILLE;
+    sim_config.busoff_period_ms = SIM_BUSOFF_PERIOD_MS;
+    sim_config.busoff_ms = SIM_BUSOFF_MS;
+    sim_config.drift_ppm = SIM_DRIFT_PPM;
+    sim_config.payload_version = BUZZER_PAYLOAD_VERSION;
+    sim_config.seed = esp_random();
+    sim_bus = new SimBus(sim_config, sim_clock, sim_sleep);
+    sim_bus->set_filter(can_filter);
+    can_bus = sim_bus;
+#else
+    Serial.println("Initializing TWAI");
+    if (twai_init(can_filter)) {
+        can_bus = new TwaiBus();
+    }
+#endif
+    if (can_bus != nullptr) {
+        xTaskCreatePinnedToCore(twai_rx_task, "twai_rx", TWAI_RX_TASK_STACK_SIZE, NULL, TWAI_RX_TASK_PRIORITY, NULL, TWAI_RX_TASK_CORE);
+        xTaskCreatePinnedToCore(twai_tx_task, "twai_tx", TWAI_TX_TASK_STACK_SIZE, NULL, TWAI_TX_TASK_PRIORITY, &tx_task_handle, TWAI_RX_TASK_CORE);
+        xTaskCreatePinnedToCore(bus_health_task, "bus_health", BUS_HEALTH_TASK_STACK_SIZE, NULL, BUS_HEALTH_TASK_PRIORITY, NULL, TWAI_RX_TASK_CORE);
+    }
 
-    buzzers.insert(buzzers.end(), BuzzerButton(1, true));
-    buzzers.insert(buzzers.end(), BuzzerButton(2, true));
-    buzzers.insert(buzzers.end(), BuzzerButton(3, false));
-    buzzers.insert(buzzers.end(), BuzzerButton(4, true));
+    lvgl_port_lock(-1);
+    lv_timer_create(indicator_sync, INDICATOR_SYNC_PERIOD_MS, NULL);
+    settingsscreen.show_latency(engine.latency());
+    lvgl_port_unlock();
+    printf("Setup done %lld ms after boot\n", (long long)(time_us() / 1000));
 }
 
+// The game task sleeps until the next queued event or engine deadline.
 void loop()
 {
-    game_tick();
-    twai_receive();
+    GameEvent event;
+    // Round the wait up to whole ticks, so the engine does not wake just before its deadline.
+    int64_t deadline = engine.next_deadline();
+    if (tournament->next_deadline() < deadline) {
+        deadline = tournament->next_deadline();
+    }
+    int64_t wait_us = deadline - time_us();
+    TickType_t wait_ticks = 0;
+    if (wait_us > 0) {
+        wait_ticks = (wait_us + portTICK_PERIOD_MS * 1000 - 1) / (portTICK_PERIOD_MS * 1000);
+    }
+    if (xQueueReceive(game_queue, &event, wait_ticks) != pdTRUE) {
+        event.type = GAME_EVENT_TIMER;
+    }
+
+    BuzzerFrame frame;
+    while (rx_ring.pop(frame)) {
+        session_log.frame(frame);
+        if (!engine.handle_frame(frame)) {
+            rx_unwanted.fetch_add(1, std::memory_order_relaxed);
+        }
+#ifdef BUZZER_SIMULATION
+        int64_t dispatch_us = time_us() - frame.rx_time_us;
+        if (dispatch_us > sim_worst_dispatch_us) {
+            sim_worst_dispatch_us = dispatch_us;
+        }
+        sim_frames++;
+#endif
+    }
+    CanFrame rx;
+    while (tournament_ring.pop(rx)) {
+        tournament->handle_frame(rx, rx.rx_time_us);
+    }
+    int64_t now = time_us();
+    uint8_t variant = tournament_request.exchange(0);
+    if (variant && !tournament->start(variant, now)) {
+        char message[40];
+        if (tournament->coordinator() == TOURNAMENT_NO_NODE) {
+            snprintf(message, sizeof(message), "Suche Wände...");
+        } else if (!tournament->coordinating()) {
+            snprintf(message, sizeof(message), "Start an Wand %d", tournament->coordinator());
+        } else {
+            snprintf(message, sizeof(message), tournament->phase() == TOURNAMENT_IDLE ? "Keine zweite Wand" : "Turnier läuft");
+        }
+        displayhooks.show_message(message);
+    }
+    if (game_time_reached(now, tournament->next_deadline())) {
+        tournament->tick(now);
+    }
+    hold_rounds(tournament->phase() == TOURNAMENT_PLAYING);
+
+    session_log.event(event, now);
+    engine.handle(event, now);
+
+    if (engine.held()) {
+        tournament->round_ready(engine.round(), now);
+    } else if (engine.state() == GAME_END) {
+        tournament->game_finished(engine.complete() ? engine.total() : TOURNAMENT_DNF, engine.penalties(), now);
+    }
+
+    uint32_t drops = rx_ring.drops();
+    if (drops != rx_ring_reported_drops) {
+        printf("!!! RX ring full, %lu frames dropped\n", (unsigned long)(drops - rx_ring_reported_drops));
+        rx_ring_reported_drops = drops;
+    }
+
+    BusHealthStats bus = bus_health.stats();
+    if (bus.state != bus_reported.state || bus.bus_off_count != bus_reported.bus_off_count) {
+        printf("CAN bus %s: TEC %u (%+d/s) REC %u (%+d/s), %u bus errors/s, %u arbitration lost/s, "
+               "%u bus-off, %u recoveries, next backoff %lu ms\n",
+               bus_state_name(bus.state), bus.tec, bus.tec_trend, bus.rec, bus.rec_trend, bus.bus_error_rate,
+               bus.arb_lost_rate, bus.bus_off_count, bus.recoveries, (unsigned long)bus.backoff_ms);
+        bus_reported = bus;
+    }
+
+    uint32_t unwanted = rx_unwanted.load(std::memory_order_relaxed);
+    if (unwanted - rx_reported_unwanted >= RX_UNWANTED_REPORT_STEP) {
+        printf("CAN filter: %lu unwanted frames passed the hardware filter\n", (unsigned long)unwanted);
+        rx_reported_unwanted = unwanted;
+    }
+
+    TxStats tx_stats = twai_tx_stats();
+    if (tx_stats.dropped != tx_reported_drops) {
+        printf("!!! TX dropped %lu (queued %lu, coalesced %lu, sent %lu)\n", (unsigned long)tx_stats.dropped,
+               (unsigned long)tx_stats.queued, (unsigned long)tx_stats.coalesced, (unsigned long)tx_stats.sent);
+        tx_reported_drops = tx_stats.dropped;
+    }
+
+    drops = session_log.drops();
+    if (drops != session_reported_drops) {
+        printf("!!! Session log full, %lu records dropped\n", (unsigned long)(drops - session_reported_drops));
+        session_reported_drops = drops;
+    }
+
+#ifdef SEVEN_SEGMENT_REPORT
+    // The loop may sleep longer than the period when idle, so the rate is over the actual interval.
+    if (game_time_reached(now, seven_reported_us + TIME_US(SEVEN_REPORT_PERIOD_MS))) {
+        lvgl_port_lock(-1);
+        uint32_t px = lv_7seg_invalidated_px();
+        lvgl_port_unlock();
+        if (px != seven_reported_px) {
+            printf("7seg: %llu px invalidated/s\n",
+                   (unsigned long long)((px - seven_reported_px) * 1000000ULL / (now - seven_reported_us)));
+        }
+        seven_reported_px = px;
+        seven_reported_us = now;
+    }
+#endif
+
+#ifdef BUZZER_SIMULATION
+    if (game_time_reached(now, sim_next_report)) {
+        SimStats stats = sim_bus->counters();
+        printf("sim: %lu frames/s, worst dispatch %lld us, bus %lu generated %lu lost %lu duplicated %lu bus-off\n",
+               (unsigned long)(sim_frames * 1000 / SIM_REPORT_PERIOD_MS), (long long)sim_worst_dispatch_us,
+               (unsigned long)stats.generated, (unsigned long)stats.lost, (unsigned long)stats.duplicated,
+               (unsigned long)stats.busoff_events);
+        sim_frames = 0;
+        sim_worst_dispatch_us = 0;
+        sim_next_report = now + TIME_US(SIM_REPORT_PERIOD_MS);
+    }
+#endif
 }
@@ -0,0 +1,29 @@
+#include "press_window.h"
+
+PressOrder PressWindow::accept(uint8_t id)
+{
+    PressOrder order = classify(id);
+    int8_t diff = (int8_t)(id - head);
+    switch (order) {
+        case PRESS_NEW:
+            seen = diff >= PRESS_WINDOW_SIZE ? 0 : seen << diff;
+            seen |= 1;
+            head = id;
+            lost += diff - 1;
+            break;
+
+        case PRESS_LATE:
+            seen |= 1u << -diff;
+            late++;
+            if (lost) {
+                lost--;
+            }
+            break;
+
+        case PRESS_DUPLICATE:
+        case PRESS_STALE:
+            duplicates++;
+            break;
+    }
+    return order;
+}
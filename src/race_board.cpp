@@ -0,0 +1,97 @@
+#include "race_board.h"
+#include <string.h>
+
+void RaceBoard::start(uint8_t count)
+{
+    players = count > RACE_MAX_PLAYERS ? RACE_MAX_PLAYERS : count;
+    finished = 0;
+    current_round = 0;
+    memset(entries, 0, sizeof(entries));
+    for (uint8_t p = 0; p < RACE_MAX_PLAYERS; p++) {
+        order[p] = p;
+        position[p] = p;
+        entries[p].round_us = -1;
+    }
+}
+
+void RaceBoard::start_round()
+{
+    finished = 0;
+    if (current_round < RACE_MAX_ROUNDS) {
+        current_round++;
+    }
+    for (uint8_t p = 0; p < players; p++) {
+        entries[p].round_us = -1;
+    }
+}
+
+uint8_t RaceBoard::finish(uint8_t player, int64_t reaction_us)
+{
+    if (!racing(player) || current_round == 0) {
+        return 0;
+    }
+    entries[player].round_us = reaction_us;
+
+    // insert into the round order, moving slower finishers down one place
+    uint8_t pos = finished++;
+    while (pos > 0 && entries[round_order[pos - 1]].round_us > reaction_us) {
+        uint8_t slower = round_order[pos - 1];
+        round_order[pos] = slower;
+        entries[slower].placements[current_round - 1] = pos + 1;
+        pos--;
+    }
+    round_order[pos] = player;
+    entries[player].placements[current_round - 1] = pos + 1;
+
+    add_total(player, reaction_us);
+    return pos + 1;
+}
+
+void RaceBoard::penalty(uint8_t player, uint32_t penalty_us)
+{
+    if (player >= players) {
+        return;
+    }
+    entries[player].penalties++;
+    entries[player].penalty_us += penalty_us;
+    add_total(player, penalty_us);
+}
+
+bool RaceBoard::finished_all(uint8_t player) const
+{
+    if (player >= players || current_round == 0) {
+        return false;
+    }
+    for (uint8_t r = 0; r < current_round; r++) {
+        if (entries[player].placements[r] == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void RaceBoard::close_round(int64_t timeout_us)
+{
+    for (uint8_t p = 0; p < players; p++) {
+        if (entries[p].round_us < 0) {
+            entries[p].round_us = timeout_us;
+            add_total(p, timeout_us);
+        }
+    }
+    finished = players;
+}
+
+// Totals only grow, so a player can only move towards the end of the leaderboard.
+void RaceBoard::add_total(uint8_t player, int64_t us)
+{
+    entries[player].total_us += us;
+    uint8_t pos = position[player];
+    while (pos + 1 < players && entries[order[pos + 1]].total_us < entries[player].total_us) {
+        uint8_t faster = order[pos + 1];
+        order[pos] = faster;
+        position[faster] = pos;
+        pos++;
+    }
+    order[pos] = player;
+    position[player] = pos;
+}
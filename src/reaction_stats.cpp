@@ -0,0 +1,42 @@
+#include "reaction_stats.h"
+#include <math.h>
+#include <string.h>
+
+void ReactionStats::reset()
+{
+    n = 0;
+    anticipated = 0;
+    mean = 0;
+    m2 = 0;
+    fastest = 0;
+    slowest = 0;
+    memset(bins, 0, sizeof(bins));
+}
+
+bool ReactionStats::add(int64_t reaction_us)
+{
+    int64_t bin = reaction_us / REACTION_HIST_BIN_US;
+    bins[bin < 0 ? 0 : bin >= REACTION_HIST_BINS ? REACTION_HIST_BINS - 1 : bin]++;
+
+    if (reaction_us < REACTION_ANTICIPATION_US) {
+        anticipated++;
+        return true;
+    }
+
+    if (n == 0 || reaction_us < fastest) {
+        fastest = reaction_us;
+    }
+    if (n == 0 || reaction_us > slowest) {
+        slowest = reaction_us;
+    }
+    n++;
+    double delta = reaction_us - mean;
+    mean += delta / n;
+    m2 += delta * (reaction_us - mean);
+    return false;
+}
+
+double ReactionStats::stddev_us() const
+{
+    return sqrt(variance_us2());
+}
@@ -0,0 +1,77 @@
+#include "result_log.h"
+#include <stddef.h>
+#include <type_traits>
+
+static_assert(std::is_trivially_copyable<ResultStore>::value, "the checkpoint saves ResultStore byte for byte");
+
+static uint8_t checkpoint_crc(const ResultCheckpoint& checkpoint)
+{
+    uint8_t crc = result_crc_bytes(&checkpoint, offsetof(ResultCheckpoint, crc), 0);
+    return result_crc_bytes(&checkpoint.store, sizeof(checkpoint.store), crc);
+}
+
+ResultLog::ResultLog(ResultFiles& files) :
+    files(files), saved(), tail(0), written(0)
+{
+}
+
+const char* ResultLog::log_name(uint32_t generation)
+{
+    return generation & 1 ? RESULT_LOG_FILE_ODD : RESULT_LOG_FILE;
+}
+
+uint32_t ResultLog::load()
+{
+    tail = 0;
+    if (files.read(RESULT_CHECKPOINT_FILE, 0, &saved, sizeof(saved)) != sizeof(saved) ||
+        saved.magic != RESULT_CHECKPOINT_MAGIC || saved.size != sizeof(saved) || saved.crc != checkpoint_crc(saved)) {
+        saved = ResultCheckpoint();
+    }
+    // the other name holds the previous log if its removal was cut off
+    files.remove(log_name(saved.generation + 1));
+
+    ResultRecord chunk[RESULT_LOAD_CHUNK];
+    size_t bytes;
+    while ((bytes = files.read(log_name(saved.generation), tail * sizeof(ResultRecord), chunk, sizeof(chunk))) >= sizeof(ResultRecord)) {
+        size_t count = bytes / sizeof(ResultRecord);
+        saved.store.load(chunk, count);
+        tail += count;
+    }
+    uint32_t records = tail;
+    if (tail >= RESULT_CHECKPOINT_RECORDS) {
+        checkpoint();
+    }
+    return records;
+}
+
+bool ResultLog::append(const ResultRecord& record)
+{
+    if (!files.append(log_name(saved.generation), &record, sizeof(record))) {
+        return false;
+    }
+    saved.store.add(record);
+    if (++tail >= RESULT_CHECKPOINT_RECORDS) {
+        checkpoint();
+    }
+    return true;
+}
+
+// Commit the index as the start of the next generation, then drop the log it covers. On failure
+// the current log simply grows until the next try.
+bool ResultLog::checkpoint()
+{
+    uint32_t generation = saved.generation;
+    files.remove(log_name(generation + 1));
+    saved.magic = RESULT_CHECKPOINT_MAGIC;
+    saved.size = sizeof(saved);
+    saved.generation = generation + 1;
+    saved.crc = checkpoint_crc(saved);
+    if (!files.replace(RESULT_CHECKPOINT_FILE, &saved, sizeof(saved))) {
+        saved.generation = generation;
+        return false;
+    }
+    files.remove(log_name(generation));
+    tail = 0;
+    written++;
+    return true;
+}
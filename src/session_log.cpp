@@ -0,0 +1,305 @@
+#include "session_log.h"
+#include <stdio.h>
+#include <string.h>
+
+SessionRecorder::SessionRecorder() :
+    records(nullptr), mask(0), head(0), tail(0), dropped(0)
+{
+}
+
+// Drop the newest record rather than block the game when the flush task falls behind.
+void SessionRecorder::append(const SessionRecord& record)
+{
+    if (records == nullptr) {
+        return;
+    }
+    uint32_t h = head.load(std::memory_order_relaxed);
+    if (h - tail.load(std::memory_order_acquire) > mask) {
+        dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    records[h & mask] = record;
+    head.store(h + 1, std::memory_order_release);
+}
+
+size_t SessionRecorder::read(SessionRecord* out, size_t max)
+{
+    if (records == nullptr) {
+        return 0;
+    }
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    size_t n = 0;
+    while (t != h && n < max) {
+        out[n++] = records[t & mask];
+        t++;
+    }
+    tail.store(t, std::memory_order_release);
+    return n;
+}
+
+void SessionRecorder::begin(SessionRecord* storage, uint32_t capacity)
+{
+    records = storage;
+    mask = capacity - 1;
+
+    SessionRecord record = {};
+    record.type = SESSION_REC_BEGIN;
+    record.value = SESSION_LOG_VERSION;
+    append(record);
+}
+
+void SessionRecorder::frame(const BuzzerFrame& frame)
+{
+    SessionRecord record = {};
+    record.type = SESSION_REC_FRAME;
+    record.a = frame.kind;
+    record.b = frame.press_id;
+    record.c = frame.buzzer_id;
+    record.value = frame.press_millis;
+    record.stamp = frame.rx_time_us;
+    append(record);
+}
+
+void SessionRecorder::event(const GameEvent& event, int64_t now)
+{
+    SessionRecord record = {};
+    record.type = SESSION_REC_EVENT;
+    record.a = event.type;
+    record.b = event.command;
+    record.c = event.arg;
+    record.stamp = now;
+    append(record);
+}
+
+void SessionRecorder::random(uint32_t value)
+{
+    SessionRecord record = {};
+    record.type = SESSION_REC_RANDOM;
+    record.value = value;
+    append(record);
+}
+
+void SessionRecorder::now_us(int64_t value)
+{
+    SessionRecord record = {};
+    record.type = SESSION_REC_NOW_US;
+    record.stamp = value;
+    append(record);
+}
+
+void SessionRecorder::state(GameState state, int64_t total_us)
+{
+    SessionRecord record = {};
+    record.type = SESSION_REC_STATE;
+    record.a = state;
+    record.stamp = total_us;
+    append(record);
+}
+
+void SessionRecorder::buzzer(uint16_t id, bool used)
+{
+    SessionRecord record = {};
+    record.type = SESSION_REC_BUZZER;
+    record.a = used;
+    record.c = id;
+    append(record);
+}
+
+void SessionRecorder::wall(uint8_t first, uint8_t last)
+{
+    SessionRecord record = {};
+    record.type = SESSION_REC_WALL;
+    record.a = first;
+    record.b = last;
+    append(record);
+}
+
+void SessionRecorder::latency(uint16_t id, uint16_t compensation_us)
+{
+    SessionRecord record = {};
+    record.type = SESSION_REC_LATENCY;
+    record.c = id;
+    record.value = compensation_us;
+    append(record);
+}
+
+void SessionRecorder::snapshot(const GameSnapshot& snapshot)
+{
+    const uint8_t *bytes = (const uint8_t *)&snapshot;
+    for (uint16_t chunk = 0; chunk < SESSION_SNAPSHOT_CHUNKS; chunk++) {
+        uint8_t data[SESSION_SNAPSHOT_CHUNK] = {0};
+        size_t offset = chunk * SESSION_SNAPSHOT_CHUNK;
+        size_t len = sizeof(snapshot) - offset < SESSION_SNAPSHOT_CHUNK ? sizeof(snapshot) - offset : SESSION_SNAPSHOT_CHUNK;
+        memcpy(data, bytes + offset, len);
+
+        SessionRecord record = {};
+        record.type = SESSION_REC_SNAPSHOT;
+        record.a = chunk;
+        record.b = chunk >> 8;
+        memcpy(&record.value, data, sizeof(record.value));
+        memcpy(&record.stamp, data + sizeof(record.value), sizeof(record.stamp));
+        append(record);
+    }
+}
+
+void SessionRecorder::hold(bool hold)
+{
+    SessionRecord record = {};
+    record.type = SESSION_REC_HOLD;
+    record.a = hold;
+    append(record);
+}
+
+void SessionRecorder::release(int64_t lit_us)
+{
+    SessionRecord record = {};
+    record.type = SESSION_REC_RELEASE;
+    record.stamp = lit_us;
+    append(record);
+}
+
+// Forwards UI effects, answers random/clock queries from the log and checks state transitions.
+class ReplayHooks : public GameHooks {
+public:
+    ReplayHooks(const SessionRecord* records, size_t count, GameHooks& ui) :
+        records(records), count(count), pos(0), ui(ui), diverged(false) {}
+
+    // The next record must be the value the engine is asking for.
+    const SessionRecord* take(SessionRecordType type) {
+        if (pos < count && records[pos].type == type) {
+            return &records[pos++];
+        }
+        diverged = true;
+        return nullptr;
+    }
+
+    void send_can(uint32_t id, const uint8_t* data, uint8_t len, TxPriority priority) override { ui.send_can(id, data, len, priority); }
+    uint32_t random_range(uint32_t lo, uint32_t) override {
+        const SessionRecord *record = take(SESSION_REC_RANDOM);
+        return record ? record->value : lo;
+    }
+    int64_t now_us() override {
+        const SessionRecord *record = take(SESSION_REC_NOW_US);
+        return record ? record->stamp : 0;
+    }
+    void show_start_screen(const char* message) override { ui.show_start_screen(message); }
+    void show_game_screen() override { ui.show_game_screen(); }
+    void show_message(const char* message) override { ui.show_message(message); }
+    void show_countdown(char digit) override { ui.show_countdown(digit); }
+    void show_time(int64_t time_us, uint32_t color) override { ui.show_time(time_us, color); }
+    void show_running(int64_t time_us, int64_t now_us) override { ui.show_running(time_us, now_us); }
+    void show_round(uint8_t round) override { ui.show_round(round); }
+    void show_finished(int64_t total_us) override { ui.show_finished(total_us); }
+    void buzzer_changed(uint16_t index) override { ui.buzzer_changed(index); }
+    void buzzer_set_changed(uint16_t count) override { ui.buzzer_set_changed(count); }
+    void show_race(const RaceBoard& board, bool finished) override { ui.show_race(board, finished); }
+    void state_changed(GameState state, int64_t total) override {
+        const SessionRecord *record = take(SESSION_REC_STATE);
+        if (record && (record->a != state || record->stamp != total)) {
+            printf("replay: state %d total %lld us, recorded state %d total %lld us\n", state, (long long)total,
+                   record->a, (long long)record->stamp);
+            diverged = true;
+        }
+        ui.state_changed(state, total);
+    }
+    // a replay must not replace the crash-resume snapshot of the real game
+    void save_snapshot(const GameSnapshot&) override {}
+    // nor the stored latency table
+    void latency_calibrated(const LatencyTable&) override {}
+
+    const SessionRecord* records;
+    size_t count;
+    size_t pos;
+    GameHooks& ui;
+    bool diverged;
+};
+
+bool session_replay(const SessionRecord* records, size_t count, GameHooks& hooks, int64_t* final_total)
+{
+    ReplayHooks replay(records, count, hooks);
+    GameEngine engine(replay);
+    GameSnapshot snapshot;
+
+    while (replay.pos < count && !replay.diverged) {
+        const SessionRecord &record = records[replay.pos++];
+        switch (record.type) {
+            case SESSION_REC_BEGIN:
+                if (record.value != SESSION_LOG_VERSION) {
+                    return false;
+                }
+                break;
+
+            case SESSION_REC_BUZZER:
+                engine.set_used(record.c, record.a);
+                break;
+
+            case SESSION_REC_WALL:
+                engine.set_wall(record.a, record.b);
+                break;
+
+            case SESSION_REC_LATENCY:
+                engine.set_compensation(record.c, record.value);
+                break;
+
+            case SESSION_REC_SNAPSHOT:
+                {
+                    size_t chunk = record.a | record.b << 8;
+                    if (chunk >= SESSION_SNAPSHOT_CHUNKS) {
+                        replay.diverged = true;
+                        break;
+                    }
+                    uint8_t data[SESSION_SNAPSHOT_CHUNK];
+                    memcpy(data, &record.value, sizeof(record.value));
+                    memcpy(data + sizeof(record.value), &record.stamp, sizeof(record.stamp));
+                    size_t offset = chunk * SESSION_SNAPSHOT_CHUNK;
+                    size_t len = sizeof(snapshot) - offset < SESSION_SNAPSHOT_CHUNK ? sizeof(snapshot) - offset : SESSION_SNAPSHOT_CHUNK;
+                    memcpy((uint8_t *)&snapshot + offset, data, len);
+                    if (chunk == SESSION_SNAPSHOT_CHUNKS - 1) {
+                        engine.load_snapshot(snapshot);
+                    }
+                }
+                break;
+
+            case SESSION_REC_HOLD:
+                engine.hold_rounds(record.a);
+                break;
+
+            case SESSION_REC_RELEASE:
+                engine.release(record.stamp);
+                break;
+
+            case SESSION_REC_FRAME:
+                {
+                    BuzzerFrame frame;
+                    frame.kind = (BuzzerFrameKind)record.a;
+                    frame.press_id = record.b;
+                    frame.buzzer_id = record.c;
+                    frame.press_millis = record.value;
+                    frame.rx_time_us = record.stamp;
+                    engine.handle_frame(frame);
+                }
+                break;
+
+            case SESSION_REC_EVENT:
+                {
+                    GameEvent event = {};
+                    event.type = (GameEventType)record.a;
+                    event.command = record.b;
+                    event.arg = record.c;
+                    engine.handle(event, record.stamp);
+                }
+                break;
+
+            default:
+                // a value the engine did not ask for
+                replay.diverged = true;
+                break;
+        }
+    }
+
+    if (final_total) {
+        *final_total = engine.total();
+    }
+    return !replay.diverged;
+}
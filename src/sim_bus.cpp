@@ -0,0 +1,438 @@
+#include "sim_bus.h"
+#include "game_engine.h"
+#include "latency_table.h"
+#include <string.h>
+
+SimBus::SimBus(const SimConfig& config, SimClockFn clock, SimSleepFn sleep) :
+    config(config), clock(clock), sleep(sleep), pending_head(0), pending_tail(0),
+    rng(config.seed ? config.seed : 1), was_bus_off(false)
+{
+    if (this->config.buzzers > SIM_MAX_BUZZERS) {
+        this->config.buzzers = SIM_MAX_BUZZERS;
+    }
+    if (this->config.reaction_max_ms < this->config.reaction_min_ms) {
+        this->config.reaction_max_ms = this->config.reaction_min_ms;
+    }
+    memset(&stats, 0, sizeof(stats));
+    memset(buzzers, 0, sizeof(buzzers));
+    filter = can_filter_compute(CanAcceptance());
+    version = 0;
+    plugged = this->config.initial_buzzers && this->config.initial_buzzers < this->config.buzzers ? this->config.initial_buzzers : this->config.buzzers;
+
+    // Spread the heartbeats over one period in id order, so the lowest ids are registered first.
+    int64_t now = clock();
+    for (uint16_t id = 1; id <= this->config.buzzers; id++) {
+        Buzzer &buzzer = buzzers[id];
+        buzzer.present = id <= plugged;
+        buzzer.next_heartbeat_us = now + (int64_t)this->config.heartbeat_ms * 1000 * id / (this->config.buzzers + 1);
+        buzzer.clock_offset_us = random();
+        if (this->config.drift_ppm) {
+            buzzer.drift_ppm = (int16_t)(random() % (2 * this->config.drift_ppm + 1)) - this->config.drift_ppm;
+        }
+    }
+    next_hotplug_us = now + (int64_t)this->config.hotplug_ms * 1000;
+}
+
+uint32_t SimBus::random()
+{
+    // xorshift32
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+bool SimBus::roll(uint16_t permille)
+{
+    return permille && random() % 1000 < permille;
+}
+
+uint32_t SimBus::reaction_ms()
+{
+    uint32_t lo = config.reaction_min_ms;
+    uint32_t range = config.reaction_max_ms - lo;
+    if (config.press_distribution == SIM_PRESS_NORMAL) {
+        // Irwin-Hall: the sum of 12 uniforms is close to normal with sigma 1
+        int32_t sum = 0;
+        for (int i = 0; i < 12; i++) {
+            sum += random() % 1001;
+        }
+        int32_t value = (int32_t)(lo + range / 2) + (sum - 6000) * (int32_t)range / 6000;
+        if (value < (int32_t)lo) {
+            return lo;
+        }
+        return (uint32_t)value > lo + range ? lo + range : value;
+    }
+    return lo + random() % (range + 1);
+}
+
+bool SimBus::bus_off(int64_t now)
+{
+    if (config.busoff_period_ms == 0) {
+        return false;
+    }
+    bool off = (now / 1000) % config.busoff_period_ms < config.busoff_ms;
+    if (off && !was_bus_off) {
+        stats.busoff_events++;
+    }
+    was_bus_off = off;
+    return off;
+}
+
+void SimBus::reset_outcome()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    stats.rounds = 0;
+    stats.expected_total_ms = 0;
+    stats.penalties = 0;
+}
+
+void SimBus::set_filter(const CanFilter& filter)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    this->filter = filter;
+}
+
+// Bus-off windows end by themselves; recover() only counts the requests.
+bool SimBus::status(CanStatus& status)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    memset(&status, 0, sizeof(status));
+    status.state = bus_off(clock()) ? BUS_STATE_BUS_OFF : BUS_STATE_RUNNING;
+    status.tx_error_counter = status.state == BUS_STATE_BUS_OFF ? 256 : 0;
+    status.tx_failed_count = stats.tx_failed;
+    status.rx_missed_count = stats.lost;
+    return true;
+}
+
+void SimBus::recover()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    stats.recoveries++;
+}
+
+SimStats SimBus::counters()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    return stats;
+}
+
+// A buzzer lights up and schedules its press; the keepalive repeats of a lit buzzer are ignored.
+void SimBus::light(uint8_t id, int64_t now)
+{
+    if (id == 0 || id > config.buzzers || !buzzers[id].present || buzzers[id].lit) {
+        return;
+    }
+    Buzzer &buzzer = buzzers[id];
+    uint32_t reaction = reaction_ms();
+    buzzer.lit = true;
+    buzzer.pressed = false;
+    buzzer.lit_us = now;
+    buzzer.press_due_us = now + (int64_t)reaction * 1000;
+    stats.rounds++;
+    stats.expected_total_ms += reaction;
+
+    // the wrong buzzer is on the same wall and not lit for another player
+    uint16_t first = 1;
+    uint16_t last = config.scored_buzzers < config.buzzers ? config.scored_buzzers : config.buzzers;
+    if (config.wall_buzzers) {
+        first = (id - 1) / config.wall_buzzers * config.wall_buzzers + 1;
+        if (first + config.wall_buzzers - 1 < last) {
+            last = first + config.wall_buzzers - 1;
+        }
+    }
+    if (last > first && roll(config.wrong_press_permille)) {
+        uint8_t wrong = first + random() % (last - first);
+        if (wrong >= id) {
+            wrong++;
+        }
+        if (buzzers[wrong].present && !buzzers[wrong].lit) {
+            buzzers[wrong].press_due_us = now + (int64_t)reaction * 500;
+            stats.penalties++;
+        }
+    }
+}
+
+// A plugged-in buzzer starts with a status frame right away.
+void SimBus::hotplug(int64_t now)
+{
+    if (config.hotplug_ms == 0 || plugged >= config.buzzers || now < next_hotplug_us) {
+        return;
+    }
+    Buzzer &buzzer = buzzers[++plugged];
+    buzzer.present = true;
+    buzzer.next_heartbeat_us = now;
+    next_hotplug_us = now + (int64_t)config.hotplug_ms * 1000;
+}
+
+// Buzzer n of the addressed wall answers with its status frame n reply slots after the request.
+void SimBus::discovery(const CanFrame& frame, int64_t now)
+{
+    int64_t slot_us = (frame.len > 0 ? frame.data[0] : 1) * 100;
+    uint8_t display_version = frame.len > 1 ? frame.data[1] : 0;
+    version = display_version < config.payload_version ? display_version : config.payload_version;
+    for (uint16_t id = 1; id <= config.buzzers; id++) {
+        Buzzer &buzzer = buzzers[id];
+        if (buzzer.present && wall_addressed(frame.data, frame.len, 2, id) && buzzer.next_heartbeat_us > now + id * slot_us) {
+            buzzer.next_heartbeat_us = now + id * slot_us;
+        }
+    }
+}
+
+// The addressed buzzer echoes a latency ping one frame time plus its echo delay later.
+void SimBus::echo(const CanFrame& frame, int64_t now)
+{
+    uint8_t id = frame.data[0];
+    if (id == 0 || id > config.buzzers || !buzzers[id].present || config.echo_delay_us[id] == SIM_NO_ECHO ||
+        pending_head - pending_tail >= SIM_PENDING_CAPACITY) {
+        return;
+    }
+    Pending &reply = pending[pending_head++ % SIM_PENDING_CAPACITY];
+    memset(&reply.frame, 0, sizeof(reply.frame));
+    reply.frame.id = LATENCY_ECHO_ID | id;
+    reply.frame.len = 1;
+    reply.frame.data[0] = frame.data[1];
+    reply.due_us = now + SIM_FRAME_US + config.echo_delay_us[id];
+}
+
+// Every buzzer of the addressed wall answers a sync with its own clock; the replies queue up on the bus.
+void SimBus::sync(const CanFrame& frame, int64_t now)
+{
+    int64_t due = now;
+    for (uint16_t id = 1; id <= config.buzzers; id++) {
+        if (pending_head - pending_tail >= SIM_PENDING_CAPACITY) {
+            break;
+        }
+        const Buzzer &buzzer = buzzers[id];
+        if (!buzzer.present || !wall_addressed(frame.data, frame.len, 1, id)) {
+            continue;
+        }
+        uint32_t stamp = (uint32_t)(now + buzzer.clock_offset_us + now * buzzer.drift_ppm / 1000000);
+        due += SIM_FRAME_US;
+
+        Pending &reply = pending[pending_head++ % SIM_PENDING_CAPACITY];
+        memset(&reply.frame, 0, sizeof(reply.frame));
+        reply.frame.id = TIME_SYNC_REPLY_ID | id;
+        reply.frame.len = 8;
+        reply.frame.data[0] = frame.data[0];
+        reply.frame.data[4] = stamp >> 24;
+        reply.frame.data[5] = stamp >> 16;
+        reply.frame.data[6] = stamp >> 8;
+        reply.frame.data[7] = stamp;
+        reply.due_us = due;
+    }
+}
+
+// The simulated bus never queues, so a transmit does not wait and needs no timeout.
+bool SimBus::transmit(const CanFrame& frame, uint32_t)
+{
+    std::lock_guard<std::mutex> guard(lock);
+    int64_t now = clock();
+    if (bus_off(now)) {
+        stats.tx_failed++;
+        return false;
+    }
+    stats.transmitted++;
+    if (roll(config.loss_permille)) {
+        stats.lost++;
+        return true;
+    }
+
+    if (frame.id == TX_ID_ALL_OFF) {
+        for (uint16_t id = 1; id <= config.buzzers; id++) {
+            Buzzer &buzzer = buzzers[id];
+            if (!wall_addressed(frame.data, frame.len, 1, id)) {
+                continue;
+            }
+            buzzer.lit = false;
+            buzzer.pressed = false;
+            buzzer.press_id = 0;
+            buzzer.press_ms = 0;
+            buzzer.press_due_us = 0;
+        }
+    } else if (frame.id == TIME_SYNC_ID) {
+        sync(frame, now);
+    } else if (frame.id == DISCOVERY_ID) {
+        discovery(frame, now);
+    } else if (frame.id == LATENCY_PING_ID && frame.len >= 2) {
+        echo(frame, now);
+    } else if ((frame.id & ~0xffu) == TX_ID_LIGHT_ON && frame.len > 0 && frame.data[0]) {
+        light(frame.id & 0xff, now);
+    }
+    return true;
+}
+
+// Put one frame on the bus, subject to loss and duplication. Returns false when `frames` is full.
+bool SimBus::emit(const CanFrame& frame, CanFrame* frames, size_t max, size_t& n)
+{
+    if (n >= max) {
+        return false;
+    }
+    stats.generated++;
+    if (roll(config.loss_permille)) {
+        stats.lost++;
+        return true;
+    }
+    if (!can_filter_matches(filter, frame.id)) {
+        stats.filtered++;
+        return true;
+    }
+    frames[n++] = frame;
+    uint32_t range = frame.id & ~0xffu;
+    if (n < max && (range == 0 || range == BUZZER_EVENT_ID) && roll(config.duplicate_permille)) {
+        frames[n++] = frame;
+        stats.duplicated++;
+    }
+    return true;
+}
+
+size_t SimBus::collect(int64_t now, CanFrame* frames, size_t max)
+{
+    size_t n = 0;
+    bool off = bus_off(now);
+    hotplug(now);
+
+    while (pending_tail != pending_head && pending[pending_tail % SIM_PENDING_CAPACITY].due_us <= now) {
+        Pending &reply = pending[pending_tail % SIM_PENDING_CAPACITY];
+        reply.frame.rx_time_us = reply.due_us;
+        if (!off && !emit(reply.frame, frames, max, n)) {
+            return n;
+        }
+        pending_tail++;
+    }
+
+    int64_t period_us = (int64_t)config.heartbeat_ms * 1000;
+    for (uint16_t id = 1; id <= config.buzzers; id++) {
+        Buzzer &buzzer = buzzers[id];
+        if (!buzzer.present) {
+            continue;
+        }
+        if (buzzer.press_due_us && buzzer.press_due_us <= now) {
+            // a press is sent right away, not with the next heartbeat
+            int64_t pressed_us = buzzer.press_due_us;
+            buzzer.press_due_us = 0;
+            buzzer.press_id++;
+            buzzer.press_pending = true;
+            if (buzzer.lit) {
+                buzzer.pressed = true;
+                buzzer.press_ms = (pressed_us - buzzer.lit_us) / 1000;
+                stats.presses++;
+            } else {
+                stats.wrong_presses++;
+            }
+            buzzer.next_heartbeat_us = pressed_us;
+        }
+        if (buzzer.next_heartbeat_us > now) {
+            continue;
+        }
+
+        // the frame is on the bus when it was due, however late this call came
+        int64_t due = buzzer.next_heartbeat_us;
+        CanFrame frame;
+        uint32_t ms = 0;
+        if (buzzer.lit) {
+            ms = buzzer.pressed ? buzzer.press_ms : (uint32_t)((due - buzzer.lit_us) / 1000);
+        }
+        status_frame(id, buzzer, ms, frame);
+        frame.rx_time_us = due;
+        if (!off && !emit(frame, frames, max, n)) {
+            return n;
+        }
+        buzzer.next_heartbeat_us += period_us;
+        if (buzzer.next_heartbeat_us <= now) {
+            buzzer.next_heartbeat_us = now + period_us;
+        }
+    }
+    return n;
+}
+
+// v0 status frame, or a v1 event frame with the pending press, a heartbeat and now and then
+// the battery voltage.
+void SimBus::status_frame(uint8_t id, Buzzer& buzzer, uint32_t ms, CanFrame& frame)
+{
+    memset(&frame, 0, sizeof(frame));
+    frame.len = 8;
+    if (version == 0) {
+        frame.id = id;
+        frame.data[0] = buzzer.press_id;
+        frame.data[4] = ms >> 24;
+        frame.data[5] = ms >> 16;
+        frame.data[6] = ms >> 8;
+        frame.data[7] = ms;
+        return;
+    }
+
+    frame.id = BUZZER_EVENT_ID | id;
+    frame.data[1] = ms >> 16;
+    frame.data[2] = ms >> 8;
+    frame.data[3] = ms;
+    uint8_t pos = 4;
+    uint8_t count = 0;
+    if (buzzer.press_pending) {
+        frame.data[pos++] = BUZZER_EVENT_PRESS << 5;
+        frame.data[pos++] = buzzer.press_id;
+        count++;
+        buzzer.press_pending = false;
+    } else {
+        frame.data[pos++] = BUZZER_EVENT_HEARTBEAT << 5;
+        frame.data[pos++] = buzzer.press_id;
+        count++;
+    }
+    if ((buzzer.heartbeats++ & 15) == 0) {
+        frame.data[pos++] = BUZZER_EVENT_BATTERY << 5;
+        frame.data[pos++] = (3700 + id) / 20;
+        count++;
+    }
+    frame.data[0] = 1 << 6 | count << 3;
+    frame.len = pos;
+}
+
+int64_t SimBus::next_due(int64_t now) const
+{
+    int64_t due = now + (int64_t)config.heartbeat_ms * 1000;
+    if (pending_tail != pending_head && pending[pending_tail % SIM_PENDING_CAPACITY].due_us < due) {
+        due = pending[pending_tail % SIM_PENDING_CAPACITY].due_us;
+    }
+    if (config.hotplug_ms && plugged < config.buzzers && next_hotplug_us < due) {
+        due = next_hotplug_us;
+    }
+    for (uint16_t id = 1; id <= config.buzzers; id++) {
+        const Buzzer &buzzer = buzzers[id];
+        if (!buzzer.present) {
+            continue;
+        }
+        if (buzzer.next_heartbeat_us < due) {
+            due = buzzer.next_heartbeat_us;
+        }
+        if (buzzer.press_due_us && buzzer.press_due_us < due) {
+            due = buzzer.press_due_us;
+        }
+    }
+    return due;
+}
+
+size_t SimBus::receive(CanFrame* frames, size_t max, uint32_t timeout_ms)
+{
+    int64_t deadline = clock() + (int64_t)timeout_ms * 1000;
+    for (;;) {
+        int64_t now = clock();
+        int64_t due;
+        size_t n;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            n = collect(now, frames, max);
+            due = next_due(now);
+        }
+        if (n > 0) {
+            return n;
+        }
+        if (now >= deadline) {
+            return 0;
+        }
+        if (due > deadline) {
+            due = deadline;
+        }
+        // sleep at least a millisecond, the frames due meanwhile come in one batch with their own stamps
+        sleep(due > now + 1000 ? (uint32_t)((due - now) / 1000) : 1);
+    }
+}
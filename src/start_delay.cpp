@@ -0,0 +1,101 @@
+#include "start_delay.h"
+#include <math.h>
+#include <string.h>
+
+// splitmix32 spreads one seed over the four state words, which must not all be zero.
+void Xoshiro128::seed(uint32_t value)
+{
+    for (int i = 0; i < 4; i++) {
+        uint32_t z = (value += 0x9e3779b9);
+        z = (z ^ (z >> 16)) * 0x85ebca6b;
+        z = (z ^ (z >> 13)) * 0xc2b2ae35;
+        s[i] = z ^ (z >> 16);
+    }
+    if ((s[0] | s[1] | s[2] | s[3]) == 0) {
+        s[0] = 1;
+    }
+}
+
+void Xoshiro128::save(uint32_t state[4]) const
+{
+    memcpy(state, s, sizeof(s));
+}
+
+void Xoshiro128::restore(const uint32_t state[4])
+{
+    memcpy(s, state, sizeof(s));
+    if ((s[0] | s[1] | s[2] | s[3]) == 0) {
+        s[0] = 1;
+    }
+}
+
+void StartDelay::begin(const GameMode& mode, uint32_t seed)
+{
+    this->mode = &mode;
+    rng.seed(seed);
+    block_pos = START_DELAY_BINS;
+}
+
+uint32_t StartDelay::next_ms()
+{
+    if (mode == nullptr) {
+        return 0;
+    }
+    uint32_t range = mode->delay_max_ms - mode->delay_min_ms;
+    switch (mode->delay) {
+        case GAME_DELAY_EXPONENTIAL:
+            {
+                // Exponential with a mean of a third of the window, truncated at its end by
+                // inverting the truncated CDF, so no probability piles up at delay_max_ms.
+                float mean = range / 3.0f;
+                if (mean < 1) {
+                    break;
+                }
+                float tail = -mean * logf(1 - rng.unit() * (1 - expf(-(float)range / mean)));
+                return mode->delay_min_ms + (tail < range ? (uint32_t)tail : range);
+            }
+
+        case GAME_DELAY_BALANCED:
+            {
+                // Every quarter of the window comes up once per block of four rounds, in
+                // shuffled order, with a uniform offset inside the quarter.
+                if (block_pos >= START_DELAY_BINS) {
+                    for (uint8_t i = 0; i < START_DELAY_BINS; i++) {
+                        block[i] = i;
+                    }
+                    for (uint8_t i = START_DELAY_BINS - 1; i > 0; i--) {
+                        uint8_t j = rng.below(i + 1);
+                        uint8_t t = block[i];
+                        block[i] = block[j];
+                        block[j] = t;
+                    }
+                    block_pos = 0;
+                }
+                uint32_t bin = block[block_pos++];
+                uint32_t lo = range * bin / START_DELAY_BINS;
+                uint32_t hi = range * (bin + 1) / START_DELAY_BINS;
+                return mode->delay_min_ms + lo + rng.below(hi - lo + (bin == START_DELAY_BINS - 1));
+            }
+
+        case GAME_DELAY_UNIFORM:
+            break;
+    }
+    return mode->delay_min_ms + rng.below(range + 1);
+}
+
+StartDelayState StartDelay::save() const
+{
+    StartDelayState state;
+    rng.save(state.rng);
+    memcpy(state.block, block, sizeof(block));
+    state.block_pos = block_pos;
+    return state;
+}
+
+void StartDelay::restore(const GameMode& mode, const StartDelayState& state)
+{
+    this->mode = &mode;
+    rng.restore(state.rng);
+    memcpy(block, state.block, sizeof(block));
+    block_pos = state.block_pos < START_DELAY_BINS ? state.block_pos : START_DELAY_BINS;
+}
@@ -0,0 +1,20 @@
+#include "time_service.h"
+
+#ifndef ARDUINO
+static int64_t mock_us = 0;
+
+int64_t time_us()
+{
+    return mock_us;
+}
+
+void time_mock_set(int64_t us)
+{
+    mock_us = us;
+}
+
+void time_mock_advance(int64_t us)
+{
+    mock_us += us;
+}
+#endif
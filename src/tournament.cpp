@@ -0,0 +1,591 @@
+#include "tournament.h"
+#include <stdio.h>
+#include <string.h>
+
+static void put32(uint8_t* data, uint32_t value)
+{
+    data[4] = value >> 24;
+    data[5] = value >> 16;
+    data[6] = value >> 8;
+    data[7] = value;
+}
+
+static uint32_t get32(const uint8_t* data)
+{
+    return ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) | ((uint32_t)data[6] << 8) | data[7];
+}
+
+static uint8_t lowest_node(uint32_t nodes)
+{
+    for (uint8_t n = 0; n < TOURNAMENT_MAX_NODES; n++) {
+        if ((nodes >> n) & 1) {
+            return n;
+        }
+    }
+    return TOURNAMENT_NO_NODE;
+}
+
+static uint8_t node_count(uint32_t nodes)
+{
+    uint8_t count = 0;
+    for (; nodes; nodes &= nodes - 1) {
+        count++;
+    }
+    return count;
+}
+
+void TournamentBracket::clear()
+{
+    memset(heats, 0, sizeof(heats));
+    current = 0;
+}
+
+void TournamentBracket::start_heat(uint8_t heat, uint32_t entrants)
+{
+    if (heat <= 1) {
+        clear();
+    }
+    current = heat == 0 ? 0 : heat > TOURNAMENT_MAX_HEATS ? TOURNAMENT_MAX_HEATS - 1 : heat - 1;
+    memset(&heats[current], 0, sizeof(heats[current]));
+    heats[current].entrants = entrants;
+}
+
+void TournamentBracket::record(uint8_t node, int64_t total_us, uint8_t penalties)
+{
+    Heat &h = heats[current];
+    if (node >= TOURNAMENT_MAX_NODES || !((h.entrants >> node) & 1)) {
+        return;
+    }
+    h.total_us[node] = total_us;
+    h.penalties[node] = penalties;
+    h.reported |= 1u << node;
+    if (total_us >= 0) {
+        h.finished |= 1u << node;
+    } else {
+        h.finished &= ~(1u << node);
+    }
+}
+
+uint8_t TournamentBracket::ranking(uint8_t* nodes) const
+{
+    const Heat &h = heats[current];
+    uint8_t count = 0;
+    for (uint8_t n = 0; n < TOURNAMENT_MAX_NODES; n++) {
+        if (!((h.entrants >> n) & 1)) {
+            continue;
+        }
+        // insertion sort, at most 16 entrants; ties go to the lower node id
+        uint8_t pos = count++;
+        bool timed = (h.finished >> n) & 1;
+        while (pos > 0) {
+            uint8_t other = nodes[pos - 1];
+            bool other_timed = (h.finished >> other) & 1;
+            if (other_timed && (!timed || h.total_us[other] <= h.total_us[n])) {
+                break;
+            }
+            if (!other_timed && !timed) {
+                break;
+            }
+            nodes[pos] = other;
+            pos--;
+        }
+        nodes[pos] = n;
+    }
+    return count;
+}
+
+uint32_t TournamentBracket::fastest_half() const
+{
+    const Heat &h = heats[current];
+    uint8_t nodes[TOURNAMENT_MAX_NODES];
+    uint8_t count = ranking(nodes);
+    uint8_t advance = (count + 1) / 2;
+    uint32_t survivors = 0;
+    for (uint8_t i = 0; i < advance && ((h.finished >> nodes[i]) & 1); i++) {
+        survivors |= 1u << nodes[i];
+    }
+    return survivors;
+}
+
+TournamentNode::TournamentNode(TournamentHooks& hooks, uint8_t node) :
+    hooks(hooks),
+    self(node & (TOURNAMENT_MAX_NODES - 1)),
+    leader(TOURNAMENT_NO_NODE),
+    started_us(-1),
+    next_hello(0),
+    next_deadline_us(0),
+    ping_seq(0),
+    next_ping(0),
+    sample_count(0),
+    sample_next(0),
+    clock_offset(0),
+    best_rtt(0),
+    node_phase(TOURNAMENT_IDLE),
+    heat(0),
+    variant(0),
+    entrants(0),
+    held_round(0),
+    released_round(0),
+    next_repeat(0),
+    result_pending(false),
+    result_total(0),
+    result_penalties(0),
+    running(false),
+    ready(0),
+    barrier_round(0),
+    barrier_deadline(0),
+    go_round(0),
+    go_lit(0),
+    result_deadline(0),
+    next_start(0),
+    heat_done(false),
+    collision(false)
+{
+    for (uint8_t n = 0; n < TOURNAMENT_MAX_NODES; n++) {
+        last_seen[n] = -1;
+    }
+    for (uint8_t i = 0; i < 4; i++) {
+        ping_sent[i] = -1;
+    }
+}
+
+void TournamentNode::send(TournamentMessage type, uint8_t node, const uint8_t* data)
+{
+    hooks.send_can(TOURNAMENT_ID | (uint32_t)type << 4 | node, data, 8);
+}
+
+uint32_t TournamentNode::alive(int64_t now) const
+{
+    uint32_t nodes = 1u << self;
+    for (uint8_t n = 0; n < TOURNAMENT_MAX_NODES; n++) {
+        if (last_seen[n] >= 0 && now - last_seen[n] <= TIME_US(TOURNAMENT_PEER_TIMEOUT_MS)) {
+            nodes |= 1u << n;
+        }
+    }
+    return nodes;
+}
+
+// The lowest live id coordinates. A node that just booted waits one peer timeout before it
+// picks one, so it has heard every node that is already there.
+void TournamentNode::elect(int64_t now)
+{
+    uint8_t lowest = lowest_node(alive(now));
+    if (now - started_us < TIME_US(TOURNAMENT_PEER_TIMEOUT_MS)) {
+        lowest = TOURNAMENT_NO_NODE;
+    }
+    if (lowest == leader) {
+        return;
+    }
+    printf("tournament: node %d coordinates\n", lowest);
+    leader = lowest;
+    sample_count = 0;
+    sample_next = 0;
+    clock_offset = 0;
+    best_rtt = 0;
+    go_round = 0;   // lit times of the old coordinator are on its clock
+    if (leader != self) {
+        return;
+    }
+
+    // Take over from the broadcast state. Followers repeat READY and RESULT until answered.
+    running = heat > 0 && node_phase != TOURNAMENT_IDLE;
+    ready = 0;
+    barrier_round = 0;
+    result_deadline = 0;
+    next_start = running ? now + (heat_done ? TIME_US(TOURNAMENT_HEAT_PAUSE_MS) : 0) : 0;
+}
+
+int64_t TournamentNode::to_local(uint32_t coordinator_us, int64_t now) const
+{
+    return now + (int32_t)(coordinator_us - to_coordinator(now));
+}
+
+bool TournamentNode::handle_frame(const CanFrame& frame, int64_t rx_time_us)
+{
+    if ((frame.id & 0x80000000) || (frame.id & TOURNAMENT_ID_MASK) != TOURNAMENT_ID || frame.len != 8) {
+        return false;
+    }
+    TournamentMessage type = (TournamentMessage)((frame.id >> 4) & 7);
+    uint8_t node = frame.id & (TOURNAMENT_MAX_NODES - 1);
+    const uint8_t *data = frame.data;
+
+    if (type == TOURNAMENT_MSG_PONG) {
+        // the id names the addressee; a new coordinator answers before every node has noticed it
+        uint8_t sender = data[1] & (TOURNAMENT_MAX_NODES - 1);
+        last_seen[sender] = rx_time_us;
+        if (node == self && sender == leader && !coordinating()) {
+            on_pong(data, rx_time_us);
+        }
+        return true;
+    }
+    if (node == self) {
+        if (!collision) {
+            printf("!!! tournament: another display uses node id %d\n", self);
+            collision = true;
+        }
+        return true;
+    }
+    last_seen[node] = rx_time_us;
+
+    switch (type) {
+        case TOURNAMENT_MSG_PING:
+            if (coordinating()) {
+                uint8_t reply[8] = {0};
+                int64_t turnaround = hooks.now_us() - rx_time_us;
+                turnaround = turnaround < 0 ? 0 : turnaround > 0xffff ? 0xffff : turnaround;
+                reply[0] = data[0];
+                reply[1] = self;
+                reply[2] = turnaround >> 8;
+                reply[3] = turnaround;
+                put32(reply, to_coordinator(rx_time_us));
+                send(TOURNAMENT_MSG_PONG, node, reply);
+            }
+            break;
+
+        case TOURNAMENT_MSG_GO:
+            on_go(data[0], data[1], get32(data), rx_time_us);
+            break;
+
+        case TOURNAMENT_MSG_READY:
+            if (coordinating() && running && data[0] == heat) {
+                on_ready(node, data[1], rx_time_us);
+            }
+            break;
+
+        case TOURNAMENT_MSG_RESULT:
+            if (data[0] == heat) {
+                uint32_t total = get32(data);
+                on_result(node, total == 0xffffffff ? TOURNAMENT_DNF : total, data[1], rx_time_us);
+            }
+            break;
+
+        case TOURNAMENT_MSG_START:
+            on_start(data[0], data[1], get32(data));
+            break;
+
+        case TOURNAMENT_MSG_STANDING:
+            on_standing(data[0], data[1], get32(data));
+            break;
+
+        case TOURNAMENT_MSG_HELLO:
+        case TOURNAMENT_MSG_PONG:
+            break;
+    }
+    return true;
+}
+
+// NTP-style two-way exchange: offset = ((t2 - t1) + (t3 - t4)) / 2, with t1/t4 the local send and
+// receive times and t2/t3 the coordinator's. The sample with the shortest round trip has the
+// least queueing in it and sets the offset.
+void TournamentNode::on_pong(const uint8_t* data, int64_t now)
+{
+    uint8_t seq = data[0];
+    int64_t t1 = ping_sent[seq % 4];
+    if (t1 < 0 || (uint8_t)(ping_seq - seq) >= 4) {
+        return;
+    }
+    ping_sent[seq % 4] = -1;
+    uint32_t t2 = get32(data);
+    uint32_t turnaround = (uint32_t)data[2] << 8 | data[3];
+    int64_t rtt = now - t1 - turnaround;
+    samples[sample_next] = t2 + turnaround / 2 - (uint32_t)((t1 + now) / 2);
+    rtts[sample_next] = rtt > 0 ? rtt : 0;
+    sample_next = (sample_next + 1) % TOURNAMENT_PING_SAMPLES;
+    if (sample_count < TOURNAMENT_PING_SAMPLES) {
+        sample_count++;
+    }
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < sample_count; i++) {
+        if (rtts[i] < rtts[best]) {
+            best = i;
+        }
+    }
+    clock_offset = samples[best];
+    best_rtt = rtts[best];
+}
+
+bool TournamentNode::start(uint8_t variant, int64_t now)
+{
+    uint32_t nodes = alive(now);
+    if (!coordinating() || running || node_count(nodes) < 2) {
+        return false;
+    }
+    running = true;
+    on_start(1, variant != GAME_MODE_RACE && variant < GAME_MODE_COUNT ? variant : 1, nodes);
+    send_start();
+    next_start = now + TIME_US(TOURNAMENT_HELLO_MS);
+    update_deadline();
+    return true;
+}
+
+void TournamentNode::on_start(uint8_t new_heat, uint8_t new_variant, uint32_t new_entrants)
+{
+    if (new_heat == 0 || (new_heat == heat && node_phase != TOURNAMENT_IDLE && !heat_done)) {
+        return;     // a repeat of the heat that runs
+    }
+    heat = new_heat;
+    variant = new_variant;
+    entrants = new_entrants;
+    standings.start_heat(heat, entrants);
+    heat_done = false;
+    held_round = 0;
+    released_round = 0;
+    result_pending = false;
+    go_round = 0;
+    ready = 0;
+    barrier_round = 0;
+    result_deadline = 0;
+    // every node, so one that takes over the heat keeps the mode's distribution
+    go_delay.begin(game_mode(variant), hooks.random_range(0, 0x7fffffff));
+    if ((entrants >> self) & 1) {
+        node_phase = TOURNAMENT_PLAYING;
+        printf("tournament: heat %d, %s, %d walls\n", heat, game_mode(variant).name, node_count(entrants));
+        hooks.start_heat(heat, variant);
+    } else {
+        node_phase = TOURNAMENT_OUT;
+        hooks.show_standing(standings, self, false);
+    }
+}
+
+void TournamentNode::round_ready(uint8_t round, int64_t now)
+{
+    if (node_phase != TOURNAMENT_PLAYING || round == held_round || round == released_round) {
+        return;
+    }
+    held_round = round;
+    if (go_round == round) {
+        // the barrier timed out before this wall was ready
+        on_go(heat, go_round, go_lit, now);
+    } else if (coordinating()) {
+        on_ready(self, round, now);
+    } else if (synced()) {
+        uint8_t data[8] = {heat, round};
+        send(TOURNAMENT_MSG_READY, self, data);
+        next_repeat = now + TIME_US(TOURNAMENT_HELLO_MS);
+    }
+    update_deadline();
+}
+
+// Coordinator: count a wall held at the barrier.
+void TournamentNode::on_ready(uint8_t node, uint8_t round, int64_t now)
+{
+    if (round == go_round) {
+        send_go();  // the GO was lost
+    } else if (round == barrier_round) {
+        ready |= 1u << node;
+    } else if (round > barrier_round) {
+        barrier_round = round;
+        ready = 1u << node;
+        barrier_deadline = now + TIME_US(TOURNAMENT_BARRIER_TIMEOUT_MS);
+    }
+    coordinate(now);
+}
+
+void TournamentNode::on_go(uint8_t go_heat, uint8_t round, uint32_t lit, int64_t now)
+{
+    if (go_heat != heat || node_phase != TOURNAMENT_PLAYING) {
+        return;
+    }
+    go_round = round;
+    go_lit = lit;
+    if (held_round == round && released_round != round) {
+        released_round = round;
+        held_round = 0;
+        hooks.release_round(round, to_local(lit, now));
+    }
+}
+
+void TournamentNode::game_finished(int64_t total_us, uint8_t penalties, int64_t now)
+{
+    if (node_phase != TOURNAMENT_PLAYING) {
+        return;
+    }
+    node_phase = TOURNAMENT_WAITING;
+    held_round = 0;
+    result_total = total_us;
+    result_penalties = penalties;
+    result_pending = !coordinating();
+    send_result();
+    next_repeat = now + TIME_US(TOURNAMENT_HELLO_MS);
+    on_result(self, total_us, penalties, now);
+    update_deadline();
+}
+
+void TournamentNode::on_result(uint8_t node, int64_t total_us, uint8_t penalties, int64_t now)
+{
+    standings.record(node, total_us, penalties);
+    if (!coordinating() || !running) {
+        return;
+    }
+    if (heat_done) {
+        send_standing();    // the sender missed it
+        return;
+    }
+    if (result_deadline == 0) {
+        result_deadline = now + TIME_US(TOURNAMENT_RESULT_TIMEOUT_MS);
+    }
+    coordinate(now);
+}
+
+void TournamentNode::on_standing(uint8_t standing_heat, uint8_t winner, uint32_t survivors)
+{
+    if (standing_heat != heat || heat == 0) {
+        return;
+    }
+    result_pending = false;
+    if (heat_done) {
+        return;
+    }
+    heat_done = true;
+    standings.set_survivors(survivors);
+    bool final = winner != TOURNAMENT_NO_NODE || survivors == 0;
+    if (final) {
+        node_phase = TOURNAMENT_IDLE;
+        running = false;
+        printf("tournament: node %d wins after %d heats\n", winner, heat);
+    } else {
+        node_phase = (survivors >> self) & 1 ? TOURNAMENT_WAITING : TOURNAMENT_OUT;
+    }
+    hooks.show_standing(standings, self, final);
+}
+
+// Coordinator: open the barrier, close the heat and start the next one.
+void TournamentNode::coordinate(int64_t now)
+{
+    uint32_t present = entrants & alive(now);
+
+    if (barrier_round > go_round && ((ready & present) == present || now >= barrier_deadline)) {
+        uint32_t delay_ms = TOURNAMENT_GO_LEAD_MS + go_delay.next_ms();
+        go_round = barrier_round;
+        go_lit = to_coordinator(now + TIME_US(delay_ms));
+        send_go();
+        uint8_t round = go_round;
+        on_go(heat, round, go_lit, now);
+    }
+
+    if (!heat_done && result_deadline != 0 &&
+        (((standings.reported() & present) == present) || now >= result_deadline)) {
+        uint32_t survivors = standings.fastest_half();
+        if (heat >= TOURNAMENT_MAX_HEATS && node_count(survivors) > 1) {
+            uint8_t nodes[TOURNAMENT_MAX_NODES];
+            standings.ranking(nodes);
+            survivors = 1u << nodes[0];     // out of heats: the fastest wins
+        }
+        bool final = node_count(survivors) <= 1;
+        standings.set_survivors(survivors);
+        send_standing();
+        on_standing(heat, final ? lowest_node(survivors) : TOURNAMENT_NO_NODE, survivors);
+        next_start = final ? 0 : now + TIME_US(TOURNAMENT_HEAT_PAUSE_MS);
+    }
+
+    if (next_start != 0 && now >= next_start) {
+        if (heat_done) {
+            uint32_t survivors = standings.survivors() & alive(now);
+            on_start(heat + 1, variant, survivors);
+        }
+        if (go_round == 0) {
+            send_start();   // repeated until the first round starts, for walls that missed it
+            next_start = now + TIME_US(TOURNAMENT_HELLO_MS);
+        } else {
+            next_start = 0;
+        }
+    }
+}
+
+void TournamentNode::send_start()
+{
+    uint8_t data[8] = {heat, variant};
+    put32(data, entrants);
+    send(TOURNAMENT_MSG_START, self, data);
+}
+
+void TournamentNode::send_go()
+{
+    uint8_t data[8] = {heat, go_round};
+    put32(data, go_lit);
+    send(TOURNAMENT_MSG_GO, self, data);
+}
+
+void TournamentNode::send_result()
+{
+    uint8_t data[8] = {heat, result_penalties};
+    put32(data, result_total < 0 ? 0xffffffff : result_total < 0xfffffffe ? (uint32_t)result_total : 0xfffffffe);
+    send(TOURNAMENT_MSG_RESULT, self, data);
+}
+
+void TournamentNode::send_standing()
+{
+    uint32_t survivors = standings.survivors();
+    bool final = node_count(survivors) <= 1;
+    uint8_t data[8] = {heat, final ? lowest_node(survivors) : (uint8_t)TOURNAMENT_NO_NODE};
+    put32(data, survivors);
+    send(TOURNAMENT_MSG_STANDING, self, data);
+}
+
+void TournamentNode::tick(int64_t now)
+{
+    if (started_us < 0) {
+        started_us = now;
+    }
+    elect(now);
+
+    if (now >= next_hello) {
+        uint8_t data[8] = {heat, node_phase};
+        send(TOURNAMENT_MSG_HELLO, self, data);
+        next_hello = now + TIME_US(TOURNAMENT_HELLO_MS);
+    }
+
+    if (leader != TOURNAMENT_NO_NODE && !coordinating() && now >= next_ping) {
+        ping_seq++;
+        ping_sent[ping_seq % 4] = now;
+        uint8_t data[8] = {ping_seq};
+        send(TOURNAMENT_MSG_PING, self, data);
+        next_ping = now + TIME_US(TOURNAMENT_PING_MS);
+    }
+
+    if (!coordinating() && now >= next_repeat) {
+        if (held_round != 0 && synced()) {
+            uint8_t data[8] = {heat, held_round};
+            send(TOURNAMENT_MSG_READY, self, data);
+        }
+        if (result_pending) {
+            send_result();
+        }
+        next_repeat = now + TIME_US(TOURNAMENT_HELLO_MS);
+    }
+
+    if (coordinating() && running) {
+        coordinate(now);
+    }
+    update_deadline();
+}
+
+void TournamentNode::update_deadline()
+{
+    int64_t deadline = next_hello;
+    auto consider = [&](int64_t candidate) {
+        if (candidate < deadline) {
+            deadline = candidate;
+        }
+    };
+
+    if (leader == TOURNAMENT_NO_NODE) {
+        consider(started_us + TIME_US(TOURNAMENT_PEER_TIMEOUT_MS));
+    } else if (!coordinating()) {
+        consider(next_ping);
+        if (held_round != 0 || result_pending) {
+            consider(next_repeat);
+        }
+    } else if (running) {
+        if (barrier_round > go_round) {
+            consider(barrier_deadline);
+        }
+        if (!heat_done && result_deadline != 0) {
+            consider(result_deadline);
+        }
+        if (next_start != 0) {
+            consider(next_start);
+        }
+    }
+    next_deadline_us = deadline;
+}
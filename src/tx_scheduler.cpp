@@ -0,0 +1,77 @@
+#include "tx_scheduler.h"
+#include <string.h>
+
+TxScheduler::TxScheduler() : count(0), seq(0)
+{
+    memset(&stats, 0, sizeof(stats));
+}
+
+bool TxScheduler::enqueue(uint32_t id, const uint8_t* data, uint8_t len, TxPriority priority)
+{
+    if (len > 8) {
+        len = 8;
+    }
+
+    // An "all off" makes every pending "light on" obsolete.
+    if (id == TX_ID_ALL_OFF) {
+        for (uint8_t i = 0; i < count;) {
+            if ((frames[i].id & ~0xffu) == TX_ID_LIGHT_ON) {
+                remove(i);
+                stats.coalesced++;
+            } else {
+                i++;
+            }
+        }
+    }
+
+    TxFrame *frame = nullptr;
+    for (uint8_t i = 0; i < count; i++) {
+        if (frames[i].id == id) {
+            frame = &frames[i];
+            stats.coalesced++;
+            if (priority > frame->priority) {
+                frame->priority = priority;
+            }
+            break;
+        }
+    }
+
+    if (frame == nullptr) {
+        if (count >= TX_SCHEDULER_CAPACITY) {
+            stats.dropped++;
+            return false;
+        }
+        frame = &frames[count++];
+        frame->id = id;
+        frame->priority = priority;
+        frame->seq = seq++;
+        stats.queued++;
+    }
+
+    frame->len = len;
+    memset(frame->data, 0, sizeof(frame->data));
+    memcpy(frame->data, data, len);
+    return true;
+}
+
+bool TxScheduler::next(TxFrame& frame)
+{
+    if (count == 0) {
+        return false;
+    }
+    uint8_t best = 0;
+    for (uint8_t i = 1; i < count; i++) {
+        if (frames[i].priority > frames[best].priority ||
+            (frames[i].priority == frames[best].priority && (int32_t)(frames[i].seq - frames[best].seq) < 0)) {
+            best = i;
+        }
+    }
+    frame = frames[best];
+    remove(best);
+    return true;
+}
+
+void TxScheduler::remove(uint8_t i)
+{
+    frames[i] = frames[--count];
+}
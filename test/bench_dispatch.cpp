@@ -0,0 +1,77 @@
+// Frame dispatch throughput: GameEngine::handle_frame() for heartbeat traffic from walls of 8,
+// 32 and 128 buzzers, against the linear scan of a std::vector that the registry replaced.
+// Dispatch must not get slower with more buzzers.
+#include "test_hooks.h"
+#include "check.h"
+#include <chrono>
+
+#define BENCH_FRAMES    (2000000)
+
+// The lookup of the old handle_rx_message(): scan for the id, per frame.
+static uint32_t linear_scan(uint16_t buzzers)
+{
+    std::vector<BuzzerButton> table;
+    for (uint16_t id = 1; id <= buzzers; id++) {
+        table.push_back(BuzzerButton(id, true));
+    }
+    uint32_t found = 0;
+    for (uint32_t n = 0; n < BENCH_FRAMES; n++) {
+        uint16_t id = 1 + n % buzzers;
+        for (size_t i = 0; i < table.size(); i++) {
+            if (table[i].buzzer_id == id) {
+                table[i].last_seen = n;
+                found++;
+                break;
+            }
+        }
+    }
+    return found;
+}
+
+static double per_frame_ns(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / BENCH_FRAMES;
+}
+
+static double dispatch(uint16_t buzzers)
+{
+    TestHooks hooks;
+    hooks.keep_sent = false;
+    GameEngine *engine = new GameEngine(hooks);    // too big for the stack
+    for (uint16_t id = 1; id <= buzzers; id++) {
+        CHECK(engine->add_buzzer(id, true) != BUZZER_NO_SLOT);
+    }
+
+    BuzzerFrame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.kind = BUZZER_FRAME_STATUS;
+    uint32_t handled = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (uint32_t n = 0; n < BENCH_FRAMES; n++) {
+        frame.buzzer_id = 1 + n % buzzers;
+        frame.rx_time_us = n;
+        handled += engine->handle_frame(frame);
+    }
+    double ns = per_frame_ns(start);
+    CHECK_EQ(handled, BENCH_FRAMES);
+    CHECK_EQ(engine->buttons().size(), buzzers);
+    delete engine;
+    return ns;
+}
+
+int main()
+{
+    double engine_ns[3];
+    const uint16_t walls[3] = {8, 32, 128};
+    for (int w = 0; w < 3; w++) {
+        auto start = std::chrono::steady_clock::now();
+        CHECK_EQ(linear_scan(walls[w]), BENCH_FRAMES);
+        double scan_ns = per_frame_ns(start);
+        engine_ns[w] = dispatch(walls[w]);
+        printf("%3u buzzers: handle_frame %6.1f ns/frame (%5.1f M frames/s), linear scan lookup alone %6.1f ns/frame\n",
+               walls[w], engine_ns[w], 1e3 / engine_ns[w], scan_ns);
+    }
+    // constant time: 128 buzzers cost about what 8 do, with room for cache effects and noise
+    CHECK(engine_ns[2] < engine_ns[0] * 3);
+    return check_result("bench_dispatch");
+}
@@ -0,0 +1,113 @@
+#pragma once
+#include "test_hooks.h"
+#include "sim_bus.h"
+#include "buzzer_frame.h"
+#include <functional>
+
+// A display in a host test: GameEngine on a SimBus wall, driven like loop() and twai_rx_task
+// drive it on the target, on the mock clock of time_service.h. Waiting for frames advances the
+// mock clock, so a whole game runs in milliseconds and the same seeds give the same game.
+
+static inline void sim_driver_sleep(uint32_t ms)
+{
+    time_mock_advance(TIME_US(ms));
+}
+
+class SimDriver {
+public:
+    SimDriver(const SimConfig& config, uint32_t seed) :
+        hooks(seed), bus(config, time_us, sim_driver_sleep), engine(new GameEngine(hooks)), log(nullptr)
+    {
+        hooks.bus = &bus;
+        hooks.keep_sent = false;
+    }
+    ~SimDriver() { delete engine; }
+
+    // Record every engine input from now on, as the firmware does.
+    void record(SessionRecorder* recorder) {
+        log = recorder;
+        hooks.log = recorder;
+    }
+
+    void command(GameCommand command, uint8_t arg = 0) {
+        GameEvent event = {};
+        event.type = GAME_EVENT_COMMAND;
+        event.command = command;
+        event.arg = arg;
+        dispatch(event);
+    }
+
+    // One pass of the game loop: wait for frames or the next deadline, then handle them.
+    void step() {
+        int64_t now = time_us();
+        int64_t wait_us = engine->next_deadline() - now;
+        uint32_t timeout_ms = wait_us <= 0 ? 0 : wait_us > TIME_US(100) ? 100 : (uint32_t)((wait_us + 999) / 1000);
+        CanFrame frames[64];
+        size_t n = bus.receive(frames, 64, timeout_ms);
+        for (size_t i = 0; i < n; i++) {
+            BuzzerFrame events[BUZZER_FRAME_MAX_EVENTS];
+            uint8_t count = buzzer_frame_decode(frames[i].id, frames[i].data, frames[i].len, frames[i].rx_time_us, events);
+            for (uint8_t e = 0; e < count; e++) {
+                if (log) {
+                    log->frame(events[e]);
+                }
+                engine->handle_frame(events[e]);
+            }
+        }
+        GameEvent event = {};
+        event.type = n ? GAME_EVENT_RX : GAME_EVENT_TIMER;
+        dispatch(event);
+    }
+
+    // Step until `done` returns true or `limit_ms` of mock time have passed. Returns done().
+    bool run(std::function<bool()> done, uint32_t limit_ms) {
+        int64_t limit = time_us() + TIME_US(limit_ms);
+        while (!done() && time_us() < limit) {
+            step();
+        }
+        return done();
+    }
+
+    void run_for(uint32_t ms) {
+        run([] { return false; }, ms);
+    }
+
+    // Start a game with `command` and run it to GAME_END; the wall presses every lit buzzer.
+    // False if the game did not start or did not end within `limit_ms`.
+    bool play(GameCommand command, uint8_t arg, uint32_t limit_ms = 120000) {
+        bus.reset_outcome();
+        this->command(command, arg);
+        return run([this] { return engine->state() == GAME_END || engine->state() == GAME_IDLE; }, limit_ms) &&
+               engine->state() == GAME_END;
+    }
+
+    TestHooks hooks;
+    SimBus bus;
+    GameEngine *engine;     // heap: the engine is too big for the test's stack
+    SessionRecorder *log;
+
+private:
+    void dispatch(const GameEvent& event) {
+        int64_t now = time_us();
+        if (log) {
+            log->event(event, now);
+        }
+        engine->handle(event, now);
+    }
+};
+
+// A wall of `buzzers` well-behaved buzzers: no loss, no wrong presses, no bus-off.
+static inline SimConfig sim_driver_config(uint16_t buzzers, uint32_t seed)
+{
+    SimConfig config;
+    memset(&config, 0, sizeof(config));
+    config.buzzers = buzzers;
+    config.scored_buzzers = buzzers;
+    config.heartbeat_ms = 100;
+    config.press_distribution = SIM_PRESS_UNIFORM;
+    config.reaction_min_ms = 150;
+    config.reaction_max_ms = 900;
+    config.payload_version = BUZZER_PAYLOAD_VERSION;
+    config.seed = seed;
+    return config;
+}
@@ -0,0 +1,247 @@
+// 7-segment display formatting, on a host build of LVGL with the firmware's lv_conf.h.
+// lv_7seg_bcd() against division for 0..9,999,999 and the edges of uint32_t; the game's time
+// display, every millisecond from 0 to 9,999,999 and every tenth of a millisecond below 10 s,
+// against the five hand-coded layouts it replaced; blanking, auto-ranging and overflow on other
+// widths. Prints the cost of lv_7seg_bcd() against a division loop and of a set_value() call.
+#include "lv_7seg.h"
+#include "check.h"
+#include <string.h>
+#include <chrono>
+
+#define SCREEN_W        (800)
+#define SCREEN_H        (480)
+#define TIME_DIGITS     (5)
+#define TIME_MAX_MS     (9999999)   // GameScreen's DISPLAY_TIME_MAX_MS
+
+static const uint8_t DIGIT_SEGMENTS[10] = {0x3f, 0x06, 0x5b, 0x4f, 0x66, 0x6d, 0x7d, 0x07, 0x7f, 0x6f};
+static const uint8_t DASH = 0x40;
+
+static lv_color_t draw_buf_pixels[SCREEN_W * 10];
+
+static void flush(lv_disp_drv_t* drv, const lv_area_t*, lv_color_t*)
+{
+    lv_disp_flush_ready(drv);
+}
+
+static void display_init()
+{
+    lv_init();
+    static lv_disp_draw_buf_t draw_buf;
+    lv_disp_draw_buf_init(&draw_buf, draw_buf_pixels, NULL, SCREEN_W * 10);
+    static lv_disp_drv_t drv;
+    lv_disp_drv_init(&drv);
+    drv.hor_res = SCREEN_W;
+    drv.ver_res = SCREEN_H;
+    drv.flush_cb = flush;
+    drv.draw_buf = &draw_buf;
+    lv_disp_drv_register(&drv);
+}
+
+static uint8_t digit(uint32_t value, bool dot)
+{
+    return DIGIT_SEGMENTS[value % 10] | (dot ? LV_7SEG_DOT : 0);
+}
+
+// GameScreen::display_time() before the display widget, per digit with division.
+static void reference_time(uint32_t time_ms, uint32_t tenths, bool display_tenths, uint8_t* s)
+{
+    uint32_t upper = time_ms / 10000;
+    if (upper == 0 && display_tenths) {
+        s[0] = digit(tenths / 10000, true);
+        s[1] = digit(tenths / 1000, false);
+        s[2] = digit(tenths / 100, false);
+        s[3] = digit(tenths / 10, false);
+        s[4] = digit(tenths, false);
+    } else if (upper == 0) {
+        s[0] = 0;
+        s[1] = digit(time_ms / 1000, true);
+        s[2] = digit(time_ms / 100, false);
+        s[3] = digit(time_ms / 10, false);
+        s[4] = digit(time_ms, false);
+    } else if (upper < 10) {
+        s[0] = digit(upper, false);
+        s[1] = digit(time_ms / 1000, true);
+        s[2] = digit(time_ms / 100, false);
+        s[3] = digit(time_ms / 10, false);
+        s[4] = digit(time_ms, false);
+    } else if (upper < 100) {
+        s[0] = digit(time_ms / 100000, false);
+        s[1] = digit(time_ms / 10000, false);
+        s[2] = digit(time_ms / 1000, true);
+        s[3] = digit(time_ms / 100, false);
+        s[4] = digit(time_ms / 10, false);
+    } else {
+        s[0] = digit(time_ms / 1000000, false);
+        s[1] = digit(time_ms / 100000, false);
+        s[2] = digit(time_ms / 10000, false);
+        s[3] = digit(time_ms / 1000, true);
+        s[4] = digit(time_ms / 100, false);
+    }
+}
+
+static bool bcd_matches(uint32_t value)
+{
+    uint8_t digits[LV_7SEG_BCD_DIGITS];
+    uint8_t significant = lv_7seg_bcd(value, digits);
+    uint8_t expected_significant = 1;
+    uint32_t rest = value;
+    for (uint8_t i = 0; i < LV_7SEG_BCD_DIGITS; i++) {
+        if (digits[i] != rest % 10) {
+            return false;
+        }
+        rest /= 10;
+        if (rest) {
+            expected_significant = i + 2;
+        }
+    }
+    return significant == expected_significant;
+}
+
+static void check_bcd()
+{
+    uint32_t wrong = 0;
+    for (uint32_t value = 0; value <= TIME_MAX_MS; value++) {
+        wrong += !bcd_matches(value);
+    }
+    // every power of ten and its neighbours, and the top of the range
+    for (uint64_t power = 10; power <= 1000000000; power *= 10) {
+        for (uint32_t delta = 0; delta < 3; delta++) {
+            wrong += !bcd_matches((uint32_t)(power - 1 - delta)) + !bcd_matches((uint32_t)(power + delta));
+        }
+    }
+    for (uint32_t value = 0xffffffffu; value > 0xffffffffu - 100000; value--) {
+        wrong += !bcd_matches(value);
+    }
+    uint32_t value = 1;
+    for (uint32_t i = 0; i < 10000000; i++) {
+        value = value * 1664525u + 1013904223u;
+        wrong += !bcd_matches(value);
+    }
+    CHECK_EQ(wrong, 0);
+}
+
+static void check_time(lv_obj_t* seven)
+{
+    const lv_7seg_display_t *display = (const lv_7seg_display_t *)seven;
+    uint8_t expected[TIME_DIGITS];
+    uint32_t wrong = 0;
+    for (uint32_t time_ms = 0; time_ms <= TIME_MAX_MS; time_ms++) {
+        lv_7seg_display_set_value(seven, time_ms, 3, LV_7SEG_BLANK_ZEROS | LV_7SEG_AUTO_RANGE);
+        reference_time(time_ms, 0, false, expected);
+        wrong += memcmp(display->segments, expected, TIME_DIGITS) != 0;
+    }
+    for (uint32_t tenths = 0; tenths < 100000; tenths++) {
+        lv_7seg_display_set_value(seven, tenths, 4, LV_7SEG_BLANK_ZEROS | LV_7SEG_AUTO_RANGE);
+        reference_time(tenths / 10, tenths, true, expected);
+        wrong += memcmp(display->segments, expected, TIME_DIGITS) != 0;
+    }
+    CHECK_EQ(wrong, 0);
+}
+
+// Expected segments as text: digits, ' ' dark, '-' dash, '.' adds the dot to the digit before.
+static bool shows(lv_obj_t* obj, const char* text)
+{
+    const lv_7seg_display_t *display = (const lv_7seg_display_t *)obj;
+    uint8_t i = 0;
+    for (const char *c = text; *c; c++) {
+        if (*c == '.') {
+            if (i == 0 || !(display->segments[i - 1] & LV_7SEG_DOT)) {
+                return false;
+            }
+            continue;
+        }
+        uint8_t mask = *c == ' ' ? 0 : *c == '-' ? DASH : DIGIT_SEGMENTS[*c - '0'];
+        if (i >= display->digits || (display->segments[i] & ~LV_7SEG_DOT) != mask ||
+            ((display->segments[i] & LV_7SEG_DOT) != 0) != (c[1] == '.')) {
+            return false;
+        }
+        i++;
+    }
+    return i == display->digits;
+}
+
+static void check_formats()
+{
+    lv_obj_t *four = lv_7seg_display_create(lv_scr_act(), 4, 40, 80, 45);
+    lv_7seg_display_set_value(four, 7, 0, 0);
+    CHECK(shows(four, "0007"));
+    lv_7seg_display_set_value(four, 7, 0, LV_7SEG_BLANK_ZEROS);
+    CHECK(shows(four, "   7"));
+    lv_7seg_display_set_value(four, 0, 0, LV_7SEG_BLANK_ZEROS);
+    CHECK(shows(four, "   0"));
+    lv_7seg_display_set_value(four, 5, 2, LV_7SEG_BLANK_ZEROS);
+    CHECK(shows(four, " 0.05"));
+    lv_7seg_display_set_value(four, 9999, 0, 0);
+    CHECK(shows(four, "9999"));
+    lv_7seg_display_set_value(four, 10000, 0, LV_7SEG_AUTO_RANGE);
+    CHECK(shows(four, "----"));
+    lv_7seg_display_set_value(four, 123456, 3, 0);
+    CHECK(shows(four, "----"));
+    lv_7seg_display_set_value(four, 123456, 3, LV_7SEG_AUTO_RANGE);
+    CHECK(shows(four, "123.4"));
+    lv_7seg_display_set_value(four, 1234567, 3, LV_7SEG_AUTO_RANGE);
+    CHECK(shows(four, "1234"));     // whole seconds, no dot
+    lv_7seg_display_set_value(four, 12345678, 3, LV_7SEG_AUTO_RANGE);
+    CHECK(shows(four, "----"));
+
+    lv_obj_t *eight = lv_7seg_display_create(lv_scr_act(), LV_7SEG_DISPLAY_MAX_DIGITS, 40, 80, 45);
+    lv_7seg_display_set_value(eight, 0xffffffffu, 0, LV_7SEG_AUTO_RANGE);
+    CHECK(shows(eight, "--------"));
+    lv_7seg_display_set_value(eight, 99999999, 2, LV_7SEG_BLANK_ZEROS);
+    CHECK(shows(eight, "999999.99"));
+    lv_7seg_display_set_value(eight, 42, 9, LV_7SEG_BLANK_ZEROS | LV_7SEG_AUTO_RANGE);
+    CHECK(shows(eight, "0.0000000"));
+    lv_obj_del(four);
+    lv_obj_del(eight);
+}
+
+volatile uint32_t sink;
+
+static void bench(lv_obj_t* seven)
+{
+    auto start = std::chrono::steady_clock::now();
+    uint32_t sum = 0;
+    for (uint32_t value = 0; value <= TIME_MAX_MS; value++) {
+        uint8_t digits[LV_7SEG_BCD_DIGITS];
+        sum += lv_7seg_bcd(value, digits) + digits[0] + digits[6];
+    }
+    sink = sum;
+    double bcd_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (TIME_MAX_MS + 1);
+
+    start = std::chrono::steady_clock::now();
+    sum = 0;
+    for (uint32_t value = 0; value <= TIME_MAX_MS; value++) {
+        uint8_t digits[LV_7SEG_BCD_DIGITS];
+        uint32_t rest = *(volatile uint32_t *)&value;
+        uint8_t significant = 1;
+        for (uint8_t i = 0; i < LV_7SEG_BCD_DIGITS; i++) {
+            digits[i] = rest % 10;
+            rest /= 10;
+            significant += rest != 0;
+        }
+        sum += significant + digits[0] + digits[6];
+    }
+    sink = sum;
+    double division_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (TIME_MAX_MS + 1);
+
+    // the running time: 1 ms steps, most calls change the last digit or two
+    start = std::chrono::steady_clock::now();
+    for (uint32_t time_ms = 0; time_ms <= TIME_MAX_MS; time_ms++) {
+        lv_7seg_display_set_value(seven, time_ms, 3, LV_7SEG_BLANK_ZEROS | LV_7SEG_AUTO_RANGE);
+    }
+    double set_ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count() / (TIME_MAX_MS + 1);
+
+    printf("lv_7seg_bcd %.1f ns, division loop %.1f ns, lv_7seg_display_set_value %.1f ns per call (host)\n",
+           bcd_ns, division_ns, set_ns);
+}
+
+int main()
+{
+    display_init();
+    lv_obj_t *seven = lv_7seg_display_create(lv_scr_act(), TIME_DIGITS, 170, 320, 150);
+    check_bcd();
+    check_time(seven);
+    check_formats();
+    bench(seven);
+    return check_result("test_7seg");
+}
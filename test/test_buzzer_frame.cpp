@@ -0,0 +1,167 @@
+// Buzzer frame decoder: known frames of every format decode to the right events, and random or
+// mutated frames never produce events beyond the table, out-of-range kinds or writes past the
+// event count. Built with AddressSanitizer and UBSan, so reads past `len` fail the test too.
+#include "buzzer_frame.h"
+#include "clock_sync.h"
+#include "latency_table.h"
+#include "check.h"
+#include <random>
+#include <string.h>
+
+#define FUZZ_FRAMES     (2000000)
+
+static void known_frames()
+{
+    BuzzerFrame out[BUZZER_FRAME_MAX_EVENTS];
+
+    // v0 status: press_id and ms since lit
+    const uint8_t status[8] = {7, 0, 0, 0, 0x00, 0x01, 0x02, 0x03};
+    CHECK_EQ(buzzer_frame_decode(0x005, status, 8, 1234, out), 1);
+    CHECK_EQ(out[0].buzzer_id, 5);
+    CHECK_EQ(out[0].kind, BUZZER_FRAME_STATUS);
+    CHECK_EQ(out[0].press_id, 7);
+    CHECK_EQ(out[0].press_millis, 0x010203);
+    CHECK_EQ(out[0].rx_time_us, 1234);
+
+    // a short v0 frame reads the missing bytes as zero
+    CHECK_EQ(buzzer_frame_decode(0x005, status, 6, 0, out), 1);
+    CHECK_EQ(out[0].press_millis, 0x010000);
+
+    CHECK_EQ(buzzer_frame_decode(TIME_SYNC_REPLY_ID | 9, status, 8, 0, out), 1);
+    CHECK_EQ(out[0].kind, BUZZER_FRAME_SYNC_REPLY);
+    CHECK_EQ(buzzer_frame_decode(TIME_SYNC_PRESS_ID | 9, status, 8, 0, out), 1);
+    CHECK_EQ(out[0].kind, BUZZER_FRAME_TIMED_PRESS);
+    CHECK_EQ(buzzer_frame_decode(LATENCY_ECHO_ID | 9, status, 1, 0, out), 1);
+    CHECK_EQ(out[0].kind, BUZZER_FRAME_ECHO);
+
+    // v1: press 3 ms after a first event at 500 ms, then a battery report
+    const uint8_t events[8] = {1 << 6 | 2 << 3, 0x00, 0x01, 0xf4,
+                               BUZZER_EVENT_PRESS << 5 | 3, 12, BUZZER_EVENT_BATTERY << 5, 190};
+    CHECK_EQ(buzzer_frame_decode(BUZZER_EVENT_ID | 0x42, events, 8, 99, out), 2);
+    CHECK_EQ(out[0].buzzer_id, 0x42);
+    CHECK_EQ(out[0].kind, BUZZER_FRAME_STATUS);
+    CHECK_EQ(out[0].press_id, 12);
+    CHECK_EQ(out[0].press_millis, 503);
+    CHECK_EQ(out[1].kind, BUZZER_FRAME_BATTERY);
+    CHECK_EQ(out[1].press_millis, 3800);
+    CHECK_EQ(out[1].rx_time_us, 99);
+
+    // reserved header bits, unknown versions, counts that do not fit
+    uint8_t bad[8];
+    for (uint8_t reserved = 1; reserved < 8; reserved++) {
+        memcpy(bad, events, 8);
+        bad[0] |= reserved;
+        CHECK_EQ(buzzer_frame_decode(BUZZER_EVENT_ID | 1, bad, 8, 0, out), 0);
+    }
+    for (uint8_t version = 0; version < 4; version++) {
+        memcpy(bad, events, 8);
+        bad[0] = version << 6 | 2 << 3;
+        CHECK_EQ(buzzer_frame_decode(BUZZER_EVENT_ID | 1, bad, 8, 0, out), version == 1 ? 2 : 0);
+    }
+    memcpy(bad, events, 8);
+    bad[0] = 1 << 6 | 3 << 3;
+    CHECK_EQ(buzzer_frame_decode(BUZZER_EVENT_ID | 1, bad, 8, 0, out), 0);
+    CHECK_EQ(buzzer_frame_decode(BUZZER_EVENT_ID | 1, events, 7, 0, out), 0);
+    memcpy(bad, events, 8);
+    bad[4] = 7 << 5;    // unknown event type
+    CHECK_EQ(buzzer_frame_decode(BUZZER_EVENT_ID | 1, bad, 8, 0, out), 0);
+
+    // lengths outside 1..8 and ids outside the buzzer ranges
+    CHECK_EQ(buzzer_frame_decode(0x005, status, 0, 0, out), 0);
+    CHECK_EQ(buzzer_frame_decode(0x005, status, 9, 0, out), 0);
+    CHECK_EQ(buzzer_frame_decode(0x100 | 5, status, 8, 0, out), 0);
+    CHECK_EQ(buzzer_frame_decode(0x7ff, status, 8, 0, out), 0);
+}
+
+// Decode into a buffer with a guard on both sides, from a copy of exactly `len` bytes on the
+// heap, so ASan sees any read past the frame.
+static uint8_t decode_guarded(uint32_t id, const uint8_t* data, uint8_t len, uint32_t& bad_events)
+{
+    BuzzerFrame out[BUZZER_FRAME_MAX_EVENTS + 2];
+    memset(out, 0xa5, sizeof(out));
+    uint8_t *copy = new uint8_t[len ? len : 1];
+    memcpy(copy, data, len);
+    uint8_t count = buzzer_frame_decode(id, copy, len, 1, out + 1);
+    delete[] copy;
+
+    BuzzerFrame guard;
+    memset(&guard, 0xa5, sizeof(guard));
+    if (count > BUZZER_FRAME_MAX_EVENTS || memcmp(&out[0], &guard, sizeof(guard)) != 0 ||
+        memcmp(&out[BUZZER_FRAME_MAX_EVENTS + 1], &guard, sizeof(guard)) != 0) {
+        bad_events++;
+        return count;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        const BuzzerFrame &event = out[1 + i];
+        if (event.buzzer_id != (id & 0xff) || event.kind > BUZZER_FRAME_ECHO || event.rx_time_us != 1) {
+            bad_events++;
+        }
+    }
+    return count;
+}
+
+static void fuzz()
+{
+    std::mt19937 rng(2024);
+    uint32_t bad_events = 0;
+    uint32_t decoded = 0;
+    uint8_t data[8];
+
+    // random ids, lengths and payloads
+    for (uint32_t n = 0; n < FUZZ_FRAMES; n++) {
+        uint32_t id = rng() & 0x7ff;
+        uint8_t len = rng() % 10;
+        for (uint8_t i = 0; i < 8; i++) {
+            data[i] = rng();
+        }
+        decoded += decode_guarded(id, data, len < 9 ? len : 8, bad_events) > 0;
+    }
+
+    // v1 frames with a valid header and mutated bytes, where the interesting cases are
+    uint32_t v1_decoded = 0;
+    for (uint32_t n = 0; n < FUZZ_FRAMES; n++) {
+        uint8_t len = 4 + rng() % 5;
+        for (uint8_t i = 0; i < 8; i++) {
+            data[i] = rng();
+        }
+        data[0] = 1 << 6 | (1 + rng() % 4) << 3;
+        for (uint8_t i = 4; i < len; i += 2) {
+            data[i] = (rng() % 5) << 5 | (data[i] & 0x1f);
+        }
+        if (rng() % 8 == 0) {
+            data[0] |= 1 + rng() % 7;   // reserved bits
+        }
+        uint8_t count = decode_guarded(BUZZER_EVENT_ID | (rng() & 0xff), data, len, bad_events);
+        if (count && (data[0] & 7)) {
+            bad_events++;
+        }
+        v1_decoded += count > 0;
+    }
+
+    // every header byte with every length
+    for (uint32_t header = 0; header < 256; header++) {
+        for (uint8_t len = 1; len <= 8; len++) {
+            memset(data, BUZZER_EVENT_HEARTBEAT << 5, sizeof(data));
+            data[0] = header;
+            uint8_t count = decode_guarded(BUZZER_EVENT_ID | 1, data, len, bad_events);
+            uint8_t expected = 0;
+            uint8_t events = (header >> 3) & 7;
+            if (header >> 6 == 1 && (header & 7) == 0 && events >= 1 && events <= 4 && 4 + 2 * events <= len) {
+                expected = events;
+            }
+            CHECK_EQ(count, expected);
+        }
+    }
+
+    CHECK_EQ(bad_events, 0);
+    CHECK(v1_decoded > 0);
+    printf("fuzz: %u random frames decoded of %u, %u mutated v1 frames decoded of %u\n",
+           decoded, FUZZ_FRAMES, v1_decoded, FUZZ_FRAMES);
+}
+
+int main()
+{
+    known_frames();
+    fuzz();
+    return check_result("test_buzzer_frame");
+}
@@ -0,0 +1,130 @@
+// Acceptance filter of a display: the static cover of add_display() for a full wall and for walls
+// sharing a bus. Every wanted identifier passes the hardware filter, other displays' commands to
+// their buzzers do not for walls below id 128, and the software check leaves nothing foreign.
+// Prints how many identifiers and how much of a shared bus's buzzer traffic pass the hardware filter.
+#include "can_filter.h"
+#include "sim_bus.h"
+#include "tournament.h"
+#include "game_engine.h"
+#include "check.h"
+#include <string.h>
+
+static void sleep_mock(uint32_t ms)
+{
+    time_mock_advance(TIME_US(ms));
+}
+
+static CanFilter check_cover(uint8_t first, uint8_t last, CanAcceptance& acceptance)
+{
+    acceptance.add_display(first, last);
+    CanFilter filter = can_filter_compute(acceptance);
+    CHECK_EQ(filter.wanted, acceptance.size());
+    CHECK(filter.accepted >= filter.wanted);
+
+    uint16_t passing = 0;
+    for (uint16_t id = 0; id < BUZZER_ID_SPACE; id++) {
+        bool passes = can_filter_matches(filter, id);
+        passing += passes;
+        if (acceptance.accepts(id)) {
+            CHECK(passes);
+        }
+    }
+    CHECK_EQ(passing, filter.accepted);
+    // light-on commands of this and other displays; the tournament ids share the low half of
+    // the low byte, so a wall there splits cleanly on id bit 8
+    uint16_t light_on = 0;
+    for (uint16_t id = TX_ID_LIGHT_ON; id < TX_ID_LIGHT_ON + 0x100; id++) {
+        light_on += can_filter_matches(filter, id);
+    }
+    if (last < 0x80 || (first == WALL_FIRST_ID && last == WALL_LAST_ID)) {
+        CHECK_EQ(light_on, 0);
+    }
+    printf("wall %3d-%3d: %s filter, %4u identifiers pass for %4u wanted, %3u light-on\n", first, last,
+           filter.dual ? "dual" : "single", filter.accepted, filter.wanted, light_on);
+    return filter;
+}
+
+// Four walls of 16 on one bus, in aligned blocks (id 0 is no buzzer), the display of `wall`
+// listens: its own buzzer frames all arrive, the hardware filter drops most of the others and
+// the software check the rest.
+static void check_shared_bus(uint8_t wall)
+{
+    const uint8_t size = 16;
+    uint8_t first = wall == 0 ? 1 : wall * size;
+    uint8_t last = wall * size + size - 1;
+    CanAcceptance acceptance;
+    CanFilter filter = check_cover(first, last, acceptance);
+
+    time_mock_set(TIME_US(1000));
+    SimConfig config;
+    memset(&config, 0, sizeof(config));
+    config.buzzers = 4 * size;
+    config.scored_buzzers = config.buzzers;
+    config.heartbeat_ms = 100;
+    config.reaction_min_ms = 150;
+    config.reaction_max_ms = 900;
+    config.payload_version = BUZZER_PAYLOAD_VERSION;
+    config.seed = 5 + wall;
+    SimBus bus(config, time_us, sleep_mock);
+    bus.set_filter(filter);
+
+    // a time sync to every wall, so the buzzers answer with replies as well as status frames
+    CanFrame sync;
+    memset(&sync, 0, sizeof(sync));
+    sync.id = TIME_SYNC_ID;
+    sync.len = 8;
+    uint32_t own = 0, foreign_passed = 0, foreign_kept = 0;
+    int64_t until = time_us() + TIME_US(3000);
+    int64_t next_sync = 0;
+    while (time_us() < until) {
+        if (time_us() >= next_sync) {
+            sync.data[0]++;
+            bus.transmit(sync, 0);
+            next_sync = time_us() + TIME_US(TIME_SYNC_PERIOD_MS);
+        }
+        CanFrame frames[64];
+        size_t n = bus.receive(frames, 64, 100);
+        for (size_t i = 0; i < n; i++) {
+            uint8_t buzzer = frames[i].id & 0xff;
+            if (buzzer >= first && buzzer <= last) {
+                own++;
+                CHECK(acceptance.accepts(frames[i].id));
+                continue;
+            }
+            foreign_passed++;
+            foreign_kept += acceptance.accepts(frames[i].id);
+        }
+    }
+    SimStats stats = bus.counters();
+    uint32_t foreign = foreign_passed + stats.filtered;
+    // every own buzzer: a heartbeat per period and a reply per sync
+    CHECK(own >= (uint32_t)(last - first + 1) * (3000 / 100 + 3000 / TIME_SYNC_PERIOD_MS) * 9 / 10);
+    CHECK_EQ(foreign_kept, 0);
+    printf("wall %d on a shared bus: %u own frames, %u of %u foreign frames pass the hardware filter (%u%%)\n",
+           wall, own, foreign_passed, foreign, foreign ? foreign_passed * 100 / foreign : 0);
+}
+
+int main()
+{
+    CanAcceptance all;
+    CanFilter filter = check_cover(WALL_FIRST_ID, WALL_LAST_ID, all);
+    // every tournament frame
+    for (uint16_t id = TOURNAMENT_ID; id < TOURNAMENT_ID + TOURNAMENT_IDS; id++) {
+        CHECK(can_filter_matches(filter, id));
+    }
+    CHECK(!all.accepts(TX_ID_ALL_OFF));
+    CHECK(!all.accepts(TIME_SYNC_ID));
+    CHECK(!all.accepts(DISCOVERY_ID));
+    // the tight split on id bit 8: 0x0/0x2/0x4/0x6 and 0x3/0x7
+    CHECK(filter.dual);
+    CHECK(filter.accepted <= filter.wanted + 0x100);
+
+    for (uint8_t first = 1; first < 250; first += 50) {
+        CanAcceptance wall;
+        check_cover(first, first + 15, wall);
+    }
+    for (uint8_t wall = 0; wall < 4; wall++) {
+        check_shared_bus(wall);
+    }
+    return check_result("test_can_filter");
+}
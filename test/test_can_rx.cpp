@@ -0,0 +1,66 @@
+// Reception timestamps: frames that reach the display in one receive() batch keep their own
+// reception times, so a frame that waited behind others is not dated by the batch.
+#include "sim_bus.h"
+#include "time_service.h"
+#include "check.h"
+#include <string.h>
+
+static void sleep_mock(uint32_t ms)
+{
+    time_mock_advance(TIME_US(ms));
+}
+
+int main()
+{
+    time_mock_set(TIME_US(1000));
+    SimConfig config;
+    memset(&config, 0, sizeof(config));
+    config.buzzers = 64;
+    config.scored_buzzers = 64;
+    config.heartbeat_ms = 100;
+    config.reaction_min_ms = 200;
+    config.reaction_max_ms = 400;
+    config.seed = 7;
+    SimBus bus(config, time_us, sleep_mock);
+
+    // A late reader gets a whole heartbeat period of frames in one batch.
+    time_mock_advance(TIME_US(100));
+    CanFrame frames[128];
+    size_t n = bus.receive(frames, 128, 0);
+    CHECK(n >= 60);
+    int64_t first = frames[0].rx_time_us;
+    int64_t last = first;
+    size_t distinct = 1;
+    for (size_t i = 1; i < n; i++) {
+        CHECK(frames[i].rx_time_us <= time_us());
+        CHECK(frames[i].rx_time_us >= last);     // the wall sends in id order
+        distinct += frames[i].rx_time_us != last;
+        last = frames[i].rx_time_us;
+    }
+    CHECK_EQ(distinct, n);
+    CHECK(last - first > TIME_US(90));
+    printf("%zu frames in one batch, stamped %lld us apart at the ends\n", n, (long long)(last - first));
+
+    // A light-on press is stamped when the buzzer sent it, not when receive() was called.
+    CanFrame light;
+    memset(&light, 0, sizeof(light));
+    light.id = 0x100 | 5;
+    light.len = 1;
+    light.data[0] = 1;
+    CHECK(bus.transmit(light, 0));
+    int64_t lit_us = time_us();
+    time_mock_advance(TIME_US(1000));
+    n = bus.receive(frames, 128, 0);
+    bool found = false;
+    for (size_t i = 0; i < n; i++) {
+        if (frames[i].id == 5 && frames[i].data[0] == 1) {
+            uint32_t ms = (uint32_t)frames[i].data[4] << 24 | frames[i].data[5] << 16 | frames[i].data[6] << 8 | frames[i].data[7];
+            CHECK(frames[i].rx_time_us < time_us());
+            CHECK_EQ((frames[i].rx_time_us - lit_us) / 1000, ms);
+            found = true;
+            break;
+        }
+    }
+    CHECK(found);
+    return check_result("test_can_rx");
+}
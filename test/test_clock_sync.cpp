@@ -0,0 +1,130 @@
+// Clock sync simulation: buzzers with random clock offsets and up to +/-100 ppm drift answer
+// TIME_SYNC broadcasts that reach them after a jittered bus delay. Pairs of buzzers are then
+// pressed a few hundred microseconds apart, and the presses are ranked on the display timebase
+// through ClockSync. Reports the time error and how often a pair comes out in the wrong order,
+// next to the millisecond press_millis ranking of v0 frames.
+#include "clock_sync.h"
+#include "check.h"
+#include <math.h>
+#include <random>
+
+#define SIM_BUZZERS         (32)
+#define SIM_SYNC_US         (TIME_SYNC_PERIOD_MS * 1000)
+#define SIM_LATENCY_US      (150)   // fixed part of the sync delay, the same for every buzzer
+#define SIM_TRIALS          (20000)
+
+struct SimClock {
+    uint32_t offset;
+    double rate;            // buzzer us per display us
+    ClockSync sync;
+
+    uint32_t read(double display_us) const {
+        return offset + (uint32_t)(int64_t)(display_us * rate);
+    }
+};
+
+struct Result {
+    double mean_abs_us;
+    double max_abs_us;
+    double misordered;          // fraction of all pairs
+    double misordered_100us;    // fraction of the pairs at least 100 us apart
+    double ms_misordered;       // same pairs ranked by whole milliseconds, ties count half
+};
+
+// `jitter_us`: sync delay spread, `stamp_jitter_us`: buzzer-side press/reply timestamp noise.
+static Result simulate(uint32_t jitter_us, uint32_t stamp_jitter_us, uint16_t drift_ppm, uint32_t seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_int_distribution<uint32_t> any;
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    static SimClock clocks[SIM_BUZZERS];
+    for (int b = 0; b < SIM_BUZZERS; b++) {
+        clocks[b].offset = any(rng);
+        clocks[b].rate = 1.0 + (unit(rng) * 2 - 1) * drift_ppm * 1e-6;
+        clocks[b].sync.reset();
+    }
+    // one buzzer wraps its 32-bit clock during the run
+    clocks[0].offset = 0xffffffffu - 30000000u;
+
+    Result result = {};
+    double abs_sum = 0;
+    uint32_t near_pairs = 0;
+    uint32_t errors = 0;
+    uint32_t near_errors = 0;
+    double ms_errors = 0;
+    double t = 1e6;
+    for (uint32_t trial = 0; trial < SIM_TRIALS; trial++) {
+        // one sync round between trials, about every 500 ms of simulated time
+        for (int b = 0; b < SIM_BUZZERS; b++) {
+            double arrival = t + SIM_LATENCY_US + unit(rng) * jitter_us;
+            double stamp = arrival + (unit(rng) * 2 - 1) * stamp_jitter_us;
+            clocks[b].sync.add_pair(clocks[b].read(stamp), (int64_t)t);
+        }
+        t += SIM_SYNC_US / 2;
+        if (trial < CLOCK_SYNC_PAIRS) {
+            t += SIM_SYNC_US / 2;
+            continue;
+        }
+
+        int a = rng() % SIM_BUZZERS;
+        int b = (a + 1 + rng() % (SIM_BUZZERS - 1)) % SIM_BUZZERS;
+        double lit = t;
+        double press_a = lit + 200000 + unit(rng) * 300000;
+        double press_b = press_a + unit(rng) * 1000;    // b is always later
+        int64_t est_a = clocks[a].sync.to_display_us(clocks[a].read(press_a + (unit(rng) * 2 - 1) * stamp_jitter_us));
+        int64_t est_b = clocks[b].sync.to_display_us(clocks[b].read(press_b + (unit(rng) * 2 - 1) * stamp_jitter_us));
+
+        // the fixed latency shifts every buzzer alike, so compare against the press minus it
+        double err = fabs((double)est_a - (press_a - SIM_LATENCY_US - jitter_us / 2.0));
+        abs_sum += err;
+        if (err > result.max_abs_us) {
+            result.max_abs_us = err;
+        }
+        bool wrong = est_b < est_a;
+        errors += wrong;
+        if (press_b - press_a >= 100) {
+            near_pairs++;
+            near_errors += wrong;
+        }
+        uint32_t ms_a = (uint32_t)((press_a - lit) / 1000);
+        uint32_t ms_b = (uint32_t)((press_b - lit) / 1000);
+        ms_errors += ms_b == ms_a ? 0.5 : ms_b < ms_a;
+        t += SIM_SYNC_US / 2;
+    }
+    uint32_t trials = SIM_TRIALS - CLOCK_SYNC_PAIRS;
+    result.mean_abs_us = abs_sum / trials;
+    result.misordered = (double)errors / trials;
+    result.misordered_100us = near_pairs ? (double)near_errors / near_pairs : 0;
+    result.ms_misordered = ms_errors / trials;
+    return result;
+}
+
+int main()
+{
+    struct Case {
+        uint32_t jitter_us;
+        uint32_t stamp_jitter_us;
+        uint16_t drift_ppm;
+    };
+    const Case cases[] = {
+        {0, 0, 0},
+        {20, 2, 100},
+        {100, 5, 100},
+        {500, 10, 100},
+        {2000, 10, 100},
+    };
+    printf("sync jitter  stamp jitter  drift  | mean err  max err | misordered  >=100us apart | ms ranking\n");
+    for (const Case &c : cases) {
+        Result r = simulate(c.jitter_us, c.stamp_jitter_us, c.drift_ppm, 12345 + c.jitter_us);
+        printf("%8u us  %9u us  %3u ppm | %6.1f us %6.1f us | %8.3f %%  %10.3f %%  | %8.2f %%\n",
+               c.jitter_us, c.stamp_jitter_us, c.drift_ppm, r.mean_abs_us, r.max_abs_us,
+               r.misordered * 100, r.misordered_100us * 100, r.ms_misordered * 100);
+        if (c.jitter_us <= 100) {
+            // CAN-level jitter: presses 100 us apart always rank right
+            CHECK(r.max_abs_us < 100);
+            CHECK_EQ(r.misordered_100us, 0);
+            CHECK(r.misordered < r.ms_misordered / 5);
+        }
+    }
+    return check_result("test_clock_sync");
+}
@@ -0,0 +1,109 @@
+// Discovery and the configured used set: every buzzer on the wall registers through discovery or
+// hot-plug within a second of being powered, positions configured as unused register as unused
+// and never light up. A wall of 128 buzzers with ids up to 255 answers one enumeration within
+// its 255 reply slots, before the enumeration is repeated.
+#include "sim_driver.h"
+#include "check.h"
+
+#define HOTPLUG_MS      (3000)
+#define REGISTER_MS     (1000)
+
+// A full registry whose replies take the last 128 of the 255 slots. Heartbeats are too rare to
+// register anything meanwhile, so every buzzer is registered by its reply.
+static void check_enumeration()
+{
+    const int64_t slot_us = DISCOVERY_SLOT_100US * 100;
+    const int64_t window_us = 255 * slot_us;
+    CHECK(window_us < TIME_US(DISCOVERY_REPEAT_MS));
+
+    time_mock_set(TIME_US(1000));
+    SimConfig config = sim_driver_config(255, 12);
+    config.heartbeat_ms = 60000;
+    SimDriver display(config, 6);
+    GameEngine &engine = *display.engine;
+    engine.set_wall(256 - BUZZER_REGISTRY_CAPACITY, 255);
+    int64_t sent_us = time_us();
+    display.run([&] { return engine.buttons().size() == BUZZER_REGISTRY_CAPACITY; }, DISCOVERY_REPEAT_MS);
+    CHECK_EQ(engine.buttons().size(), BUZZER_REGISTRY_CAPACITY);
+
+    int64_t last_us = 0;
+    for (const BuzzerButton &buzzer : engine.buttons()) {
+        CHECK(buzzer.last_seen - sent_us <= buzzer.buzzer_id * slot_us);
+        last_us = buzzer.last_seen > last_us ? buzzer.last_seen : last_us;
+    }
+    CHECK(last_us - sent_us <= window_us);
+    printf("enumeration of %d buzzers: last reply after %lld us, window %lld us, repeat after %d ms\n",
+           BUZZER_REGISTRY_CAPACITY, (long long)(last_us - sent_us), (long long)window_us, DISCOVERY_REPEAT_MS);
+}
+
+int main()
+{
+    check_enumeration();
+
+    time_mock_set(TIME_US(1000));
+    SimConfig config = sim_driver_config(8, 11);
+    config.initial_buzzers = 6;
+    config.hotplug_ms = HOTPLUG_MS;
+    SimDriver display(config, 5);
+    GameEngine &engine = *display.engine;
+    engine.set_used(3, false);
+    engine.set_used(8, false);      // plugged in later
+    CHECK(!engine.used(3));
+    CHECK(engine.used(4));
+
+    // when each buzzer was powered, and when it registered
+    int64_t boot_us = time_us();
+    int64_t powered_us[9];
+    int64_t registered_us[9] = {};
+    for (uint16_t id = 1; id <= 8; id++) {
+        powered_us[id] = boot_us + (id <= 6 ? 0 : TIME_US(HOTPLUG_MS) * (id - 6));
+    }
+    auto registered = [&] {
+        for (const BuzzerButton &buzzer : engine.buttons()) {
+            if (registered_us[buzzer.buzzer_id] == 0) {
+                registered_us[buzzer.buzzer_id] = time_us();
+            }
+        }
+        return false;
+    };
+
+    // boot discovery registers the six powered buzzers within a second
+    display.run(registered, REGISTER_MS);
+    CHECK_EQ(engine.buttons().size(), 6);
+    for (const BuzzerButton &buzzer : engine.buttons()) {
+        CHECK_EQ(buzzer.used_in_game, buzzer.buzzer_id != 3);
+    }
+
+    // the hot-plugged ones are usable within a second of being plugged in
+    display.run(registered, HOTPLUG_MS * 2 + REGISTER_MS);
+    CHECK_EQ(engine.buttons().size(), 8);
+    for (uint16_t id = 1; id <= 8; id++) {
+        CHECK(registered_us[id] != 0);
+        CHECK(registered_us[id] - powered_us[id] <= TIME_US(REGISTER_MS));
+        printf("buzzer %d: powered at %lld ms, registered %lld ms later\n", id,
+               (long long)(powered_us[id] - boot_us) / 1000, (long long)(registered_us[id] - powered_us[id]) / 1000);
+    }
+    CHECK(engine.buttons()[engine.buttons().slot_of(7)].used_in_game);
+    CHECK(!engine.buttons()[engine.buttons().slot_of(8)].used_in_game);
+
+    // a game lights only the used positions
+    display.hooks.keep_sent = true;
+    display.hooks.sent.clear();
+    CHECK(display.play(GAME_CMD_START, 2));
+    uint32_t lit = 0;
+    for (const CanFrame &frame : display.hooks.sent) {
+        if ((frame.id & ~0xffu) == TX_ID_LIGHT_ON && frame.data[0]) {
+            CHECK((frame.id & 0xff) != 3 && (frame.id & 0xff) != 8);
+            lit++;
+        }
+    }
+    CHECK(lit >= game_mode(2).rounds);
+
+    // changing the setting of a registered buzzer takes effect right away
+    uint8_t slot = engine.buttons().slot_of(3);
+    engine.set_used(3, true);
+    CHECK(engine.buttons()[slot].used_in_game);
+    engine.set_used(4, false);
+    CHECK(!engine.buttons()[engine.buttons().slot_of(4)].used_in_game);
+    return check_result("test_discovery");
+}
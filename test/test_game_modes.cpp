@@ -0,0 +1,182 @@
+// Every row of GAME_MODES played against a simulated wall: the round count, the start delay
+// window and distribution, the buzzer selection rule, and the total against the reactions and
+// wrong presses the wall generated. Race mode is played with two and four players.
+#include "sim_driver.h"
+#include "check.h"
+#include <set>
+#include <vector>
+
+#define WALL_BUZZERS    (10)
+#define GAMES_PER_MODE  (6)
+
+struct Round {
+    uint16_t lit_id;
+    int64_t delay_us;   // GAME_WAIT_FOR_BUZZER1 to the light
+};
+
+// The rounds of the last game, from the state changes and the light-on frames between all-offs.
+static std::vector<Round> rounds_of(const TestHooks& hooks)
+{
+    std::vector<Round> rounds;
+    int64_t waiting_since = -1;
+    for (size_t i = 0; i < hooks.states.size(); i++) {
+        if (hooks.states[i] == GAME_WAIT_FOR_BUZZER1) {
+            waiting_since = hooks.state_times[i];
+        } else if (hooks.states[i] == GAME_WAIT_FOR_BUZZER2 && waiting_since >= 0) {
+            rounds.push_back({0, hooks.state_times[i] - waiting_since});
+        }
+    }
+    size_t round = 0;
+    bool lit = false;
+    for (const CanFrame &frame : hooks.sent) {
+        if (frame.id == TX_ID_ALL_OFF) {
+            lit = false;
+        } else if ((frame.id & ~0xffu) == TX_ID_LIGHT_ON && frame.data[0] && !lit && round < rounds.size()) {
+            rounds[round++].lit_id = frame.id & 0xff;
+            lit = true;
+        }
+    }
+    return rounds;
+}
+
+static void play_mode(uint8_t variant)
+{
+    const GameMode &mode = game_mode(variant);
+    time_mock_set(TIME_US(1000));
+    SimConfig config = sim_driver_config(WALL_BUZZERS, 100 + variant);
+    config.wrong_press_permille = 300;
+    config.payload_version = variant == 2 ? 0 : 1;     // both payload versions
+    SimDriver display(config, variant);
+    display.run_for(1500);
+    CHECK_EQ(display.engine->buttons().size(), WALL_BUZZERS);
+
+    uint32_t quarters[4] = {0};
+    int64_t delay_sum = 0;
+    uint32_t delays = 0;
+    for (int game = 0; game < GAMES_PER_MODE; game++) {
+        display.hooks.clear();
+        display.hooks.keep_sent = true;
+        CHECK(display.play(GAME_CMD_START, variant));
+        SimStats stats = display.bus.counters();
+        std::vector<Round> rounds = rounds_of(display.hooks);
+
+        CHECK_EQ(rounds.size(), mode.rounds);
+        CHECK_EQ(stats.rounds, mode.rounds);
+        CHECK_EQ(display.engine->round(), mode.rounds + 1);
+        CHECK(display.engine->complete());
+        // the wall presses on whole milliseconds, at most one wrong buzzer per round
+        int64_t expected = TIME_US(stats.expected_total_ms) + (int64_t)stats.penalties * TIME_US(game_mode_penalty(mode, 1));
+        CHECK_EQ(display.engine->total(), expected);
+        CHECK_EQ(display.engine->penalties(), mode.penalty == GAME_PENALTY_NONE ? 0 : stats.penalties);
+
+        std::set<uint16_t> deck;
+        for (size_t r = 0; r < rounds.size(); r++) {
+            const Round &round = rounds[r];
+            CHECK(round.lit_id >= 1 && round.lit_id <= WALL_BUZZERS);
+            // one loop pass of slack after the deadline
+            CHECK(round.delay_us >= TIME_US(mode.delay_min_ms));
+            CHECK(round.delay_us <= TIME_US(mode.delay_max_ms) + TIME_US(1));
+            delay_sum += round.delay_us;
+            delays++;
+            uint32_t quarter = (uint32_t)((round.delay_us - TIME_US(mode.delay_min_ms)) * 4 / (TIME_US(mode.delay_max_ms - mode.delay_min_ms) + 1));
+            quarters[quarter < 4 ? quarter : 3]++;
+
+            switch (mode.selection) {
+                case GAME_SELECT_NO_REPEAT:
+                    CHECK(r == 0 || round.lit_id != rounds[r - 1].lit_id);
+                    break;
+                case GAME_SELECT_DECK:
+                    // every buzzer once before any repeats
+                    if (deck.size() == WALL_BUZZERS) {
+                        deck.clear();
+                    }
+                    CHECK(deck.insert(round.lit_id).second);
+                    break;
+                case GAME_SELECT_RANDOM:
+                    break;
+            }
+            if (mode.delay == GAME_DELAY_BALANCED && r % 4 == 3) {
+                // each quarter of the window once per block of four rounds
+                std::set<uint32_t> block;
+                for (size_t k = r - 3; k <= r; k++) {
+                    block.insert((uint32_t)((rounds[k].delay_us - TIME_US(mode.delay_min_ms)) * 4 / (TIME_US(mode.delay_max_ms - mode.delay_min_ms) + 1)));
+                }
+                CHECK_EQ(block.size(), 4);
+            }
+        }
+        display.command(GAME_CMD_OK);
+        CHECK_EQ(display.engine->state(), GAME_IDLE);
+    }
+    double mean_ms = delay_sum / 1000.0 / delays;
+    if (mode.delay == GAME_DELAY_EXPONENTIAL) {
+        // front-loaded: most delays in the first half of the window
+        CHECK(quarters[0] + quarters[1] > quarters[2] + quarters[3]);
+    }
+    printf("%-7s %2u rounds x %d games: delay mean %.0f ms, quarters %u/%u/%u/%u\n", mode.name, mode.rounds,
+           GAMES_PER_MODE, mean_ms, quarters[0], quarters[1], quarters[2], quarters[3]);
+}
+
+static void play_race(uint8_t players, bool shared)
+{
+    const GameMode &mode = game_mode(GAME_MODE_RACE);
+    time_mock_set(TIME_US(1000));
+    SimConfig config = sim_driver_config(12, 7 + players);
+    SimDriver display(config, players);
+    display.run_for(1500);
+    CHECK(display.play(shared ? GAME_CMD_START_RACE_SHARED : GAME_CMD_START_RACE, players));
+    SimStats stats = display.bus.counters();
+    const RaceBoard &board = display.engine->race();
+    CHECK_EQ(board.player_count(), players);
+    CHECK_EQ(stats.rounds, (uint32_t)mode.rounds * players);
+
+    int64_t sum = 0;
+    for (uint8_t p = 0; p < players; p++) {
+        const RacePlayer &player = board.player(p);
+        sum += player.total_us;
+        for (uint8_t r = 0; r < mode.rounds; r++) {
+            CHECK(player.placements[r] >= 1 && player.placements[r] <= players);
+        }
+        CHECK(board.finished_all(p));
+    }
+    CHECK_EQ(sum, TIME_US(stats.expected_total_ms));
+    // the leaderboard is sorted
+    for (uint8_t pos = 1; pos < players; pos++) {
+        CHECK(board.player(board.leader(pos - 1)).total_us <= board.player(board.leader(pos)).total_us);
+    }
+    printf("%s race, %u players: leader %lld us\n", shared ? "shared" : "own", players,
+           (long long)board.player(board.leader(0)).total_us);
+}
+
+// Without a buzzer in the game it ends at once, with no result (DNF).
+static void play_without_buzzers(GameCommand command, uint8_t arg)
+{
+    time_mock_set(TIME_US(1000));
+    SimConfig config = sim_driver_config(4, 3);
+    SimDriver display(config, 3);
+    display.run_for(1500);
+    for (const BuzzerButton &buzzer : display.engine->buttons()) {
+        display.engine->set_used(buzzer.buzzer_id, false);
+    }
+    CHECK(display.play(command, arg));
+    CHECK_EQ(display.engine->state(), GAME_END);
+    CHECK(!display.engine->complete());
+    CHECK_EQ(display.engine->total(), 0);
+    if (display.engine->racing()) {
+        for (uint8_t p = 0; p < display.engine->race().player_count(); p++) {
+            CHECK(!display.engine->race().finished_all(p));
+        }
+    }
+}
+
+int main()
+{
+    for (uint8_t variant = 1; variant < GAME_MODE_COUNT; variant++) {
+        play_mode(variant);
+    }
+    play_race(2, false);
+    play_race(4, false);
+    play_race(3, true);
+    play_without_buzzers(GAME_CMD_START, 1);
+    play_without_buzzers(GAME_CMD_START_RACE, 2);
+    return check_result("test_game_modes");
+}
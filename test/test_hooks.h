@@ -0,0 +1,98 @@
+#pragma once
+#include "game_engine.h"
+#include "can_bus.h"
+#include "session_log.h"
+#include <string.h>
+#include <string>
+#include <vector>
+
+// GameHooks for host tests: keeps what the engine shows and sends, and forwards CAN frames to
+// a bus (usually a SimBus) if one is attached. Random numbers come from a seeded xorshift, so
+// a run is reproducible. With a SessionRecorder attached, the values the engine pulls are
+// recorded the way the firmware's DisplayHooks records them.
+class TestHooks : public GameHooks {
+public:
+    explicit TestHooks(uint32_t seed = 1) : bus(nullptr), log(nullptr), rng(seed ? seed : 1) { clear(); }
+
+    void clear() {
+        sent.clear();
+        states.clear();
+        totals.clear();
+        state_times.clear();
+        message.clear();
+        finished_us = -1;
+        snapshots = 0;
+        buzzer_changes = 0;
+        set_changes = 0;
+        calibrations = 0;
+    }
+
+    void send_can(uint32_t id, const uint8_t* data, uint8_t len, TxPriority priority) override {
+        CanFrame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.id = id;
+        frame.len = len;
+        memcpy(frame.data, data, len);
+        if (keep_sent) {
+            sent.push_back(frame);
+        }
+        if (bus) {
+            bus->transmit(frame, 0);
+        }
+        (void)priority;
+    }
+    uint32_t random_range(uint32_t lo, uint32_t hi) override {
+        rng ^= rng << 13;
+        rng ^= rng >> 17;
+        rng ^= rng << 5;
+        uint32_t value = hi > lo ? lo + rng % (hi - lo) : lo;
+        if (log) {
+            log->random(value);
+        }
+        return value;
+    }
+    int64_t now_us() override {
+        int64_t value = time_us();
+        if (log) {
+            log->now_us(value);
+        }
+        return value;
+    }
+    void show_start_screen(const char* text) override { message = text; }
+    void show_game_screen() override {}
+    void show_message(const char* text) override { message = text; }
+    void show_countdown(char digit) override { (void)digit; }
+    void show_time(int64_t time_us, uint32_t color) override { (void)time_us; (void)color; }
+    void show_running(int64_t time_us, int64_t now_us) override { (void)time_us; (void)now_us; }
+    void show_round(uint8_t round) override { (void)round; }
+    void show_finished(int64_t total_us) override { finished_us = total_us; }
+    void buzzer_changed(uint16_t index) override { (void)index; buzzer_changes++; }
+    void buzzer_set_changed(uint16_t count) override { (void)count; set_changes++; }
+    void show_race(const RaceBoard& board, bool finished) override { (void)board; (void)finished; }
+    void state_changed(GameState state, int64_t total_us) override {
+        if (log) {
+            log->state(state, total_us);
+        }
+        states.push_back(state);
+        totals.push_back(total_us);
+        state_times.push_back(time_us());
+    }
+    void save_snapshot(const GameSnapshot& snapshot) override { last_snapshot = snapshot; snapshots++; }
+    void latency_calibrated(const LatencyTable& table) override { (void)table; calibrations++; }
+
+    CanBus *bus;
+    SessionRecorder *log;
+    bool keep_sent = true;
+    uint32_t rng;
+    std::vector<CanFrame> sent;
+    std::vector<GameState> states;
+    std::vector<int64_t> totals;    // total_us of each state change
+    std::vector<int64_t> state_times;   // time_us() of each state change
+    std::string message;
+    int64_t finished_us;
+    GameSnapshot last_snapshot;
+    uint32_t snapshots;
+    uint32_t buzzer_changes;
+    uint32_t set_changes;
+    uint32_t calibrations;
+};
@@ -0,0 +1,136 @@
+// Latency calibration on a simulated wall whose buzzers echo a ping after their own delay: the
+// compensation is half of each buzzer's extra round trip over the fastest one, a buzzer that does
+// not answer and a stale entry from the table on flash take no part, and a session that plays
+// with the loaded compensation, calibrates and plays again replays to the same totals.
+#include "sim_driver.h"
+#include "check.h"
+#include <vector>
+
+#define BUZZERS         (8)
+#define SILENT          (5)     // does not echo
+#define RETIRED         (20)    // in the table on flash, no longer on the wall
+#define LOG_CAPACITY    (1 << 16)
+
+static SessionRecord storage[LOG_CAPACITY];
+
+// Buzzer 1 is the fastest; 250 us more per id, e.g. a longer cable run and a slower main loop.
+static uint16_t echo_delay_us(uint16_t id)
+{
+    return (id - 1) * 250;
+}
+
+static SimConfig wall_config(uint32_t seed)
+{
+    SimConfig config = sim_driver_config(BUZZERS, seed);
+    for (uint16_t id = 1; id <= BUZZERS; id++) {
+        config.echo_delay_us[id] = id == SILENT ? SIM_NO_ECHO : echo_delay_us(id);
+    }
+    return config;
+}
+
+// What an earlier calibration left on flash: the silent buzzer and a retired one both answered
+// faster than any buzzer on the wall does now.
+static LatencyTable stale_table()
+{
+    LatencyTable table;
+    for (uint16_t id = 1; id <= BUZZERS; id++) {
+        table.set_measured(id, SIM_FRAME_US + 3000 - echo_delay_us(id), 50);
+    }
+    table.set_measured(SILENT, 100, 10);
+    table.set_measured(RETIRED, 50, 10);
+    table.normalize();
+    return table;
+}
+
+static bool calibrate(SimDriver& display)
+{
+    uint32_t calibrations = display.hooks.calibrations;
+    display.command(GAME_CMD_CALIBRATE);
+    return display.run([&] { return display.hooks.calibrations > calibrations; }, 10000);
+}
+
+static void check_calibration()
+{
+    time_mock_set(TIME_US(1000));
+    SimDriver display(wall_config(31), 31);
+    display.engine->set_latency(stale_table());
+    display.run_for(2000);
+    CHECK_EQ(display.engine->buttons().size(), BUZZERS);
+    CHECK(calibrate(display));
+
+    const LatencyTable &table = display.engine->latency();
+    CHECK_EQ(table.calibrated(), BUZZERS - 1);
+    for (uint16_t id = 1; id <= BUZZERS; id++) {
+        if (id == SILENT) {
+            continue;
+        }
+        CHECK_EQ(table[id].rtt_us, SIM_FRAME_US + echo_delay_us(id));
+        CHECK_EQ(table[id].jitter_us, 0);
+        CHECK_EQ(table.compensation_us(id), echo_delay_us(id) / 2);
+    }
+    CHECK_EQ(table[SILENT].rtt_us, 0);
+    CHECK_EQ(table.compensation_us(SILENT), 0);
+    CHECK_EQ(table[RETIRED].rtt_us, 0);
+    CHECK_EQ(table.compensation_us(RETIRED), 0);
+    printf("calibrated %u buzzers, compensation of buzzer %d: %lld us\n", table.calibrated(), BUZZERS,
+           (long long)table.compensation_us(BUZZERS));
+}
+
+// A game with the compensation from flash, logged the way latency_init() logs it, a calibration
+// and a game with the new compensation.
+static void check_replay()
+{
+    time_mock_set(TIME_US(1000));
+    SimDriver display(wall_config(32), 32);
+    SessionRecorder log;
+    log.begin(storage, LOG_CAPACITY);
+    display.record(&log);
+    display.hooks.keep_sent = true;
+    LatencyTable stale = stale_table();
+    display.engine->set_latency(stale);
+    for (uint16_t id = 0; id < LATENCY_IDS; id++) {
+        if (stale.compensation_us(id)) {
+            log.latency(id, stale.compensation_us(id));
+        }
+    }
+    display.run_for(2000);
+    CHECK(display.play(GAME_CMD_START, 1));
+    int64_t stale_total = display.engine->total();
+    display.command(GAME_CMD_OK);
+    CHECK(calibrate(display));
+    CHECK(display.play(GAME_CMD_START, 1));
+    CHECK_EQ(log.drops(), 0);
+
+    std::vector<SessionRecord> records;
+    SessionRecord batch[256];
+    size_t n;
+    while ((n = log.read(batch, 256)) > 0) {
+        records.insert(records.end(), batch, batch + n);
+    }
+    TestHooks ui;
+    int64_t total = -1;
+    CHECK(session_replay(records.data(), records.size(), ui, &total));
+    CHECK_EQ(total, display.engine->total());
+    CHECK(ui.totals == display.hooks.totals);
+    CHECK_EQ(ui.sent.size(), display.hooks.sent.size());
+
+    // without the compensation from flash the first game scores differently
+    std::vector<SessionRecord> without;
+    for (const SessionRecord &record : records) {
+        if (record.type != SESSION_REC_LATENCY) {
+            without.push_back(record);
+        }
+    }
+    TestHooks uncompensated;
+    session_replay(without.data(), without.size(), uncompensated, nullptr);
+    CHECK(uncompensated.totals != display.hooks.totals);
+    printf("replayed %zu records: totals %lld us with the stored compensation, %lld us after calibrating\n",
+           records.size(), (long long)stale_total, (long long)total);
+}
+
+int main()
+{
+    check_calibration();
+    check_replay();
+    return check_result("test_latency");
+}
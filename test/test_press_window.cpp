@@ -0,0 +1,143 @@
+// PressWindow: wraparound of the 8-bit press_id, reordering, duplicates, stale ids and gap
+// accounting, against a model on unwrapped sequence numbers.
+#include "press_window.h"
+#include "check.h"
+#include <algorithm>
+#include <random>
+#include <set>
+#include <vector>
+
+static void wraparound()
+{
+    PressWindow window;
+    window.reset(250);
+    for (int n = 251; n < 251 + 20; n++) {
+        CHECK_EQ(window.accept((uint8_t)n), PRESS_NEW);
+    }
+    CHECK_EQ(window.newest(), (uint8_t)270);
+    CHECK_EQ(window.gaps(), 0);
+    // every id of the last 20, on both sides of the wrap, is a duplicate now
+    for (int n = 251; n < 251 + 20; n++) {
+        CHECK_EQ(window.classify((uint8_t)n), PRESS_DUPLICATE);
+    }
+    CHECK_EQ(window.accept(254), PRESS_DUPLICATE);
+    CHECK_EQ(window.accept(3), PRESS_DUPLICATE);
+    CHECK_EQ(window.duplicate_count(), 2);
+
+    // a gap across the wrap is counted, and a late id across the wrap fills it
+    window.reset(253);
+    CHECK_EQ(window.accept(2), PRESS_NEW);     // 254, 255, 0, 1 missing
+    CHECK_EQ(window.gaps(), 4);
+    CHECK_EQ(window.accept(255), PRESS_LATE);
+    CHECK_EQ(window.accept(0), PRESS_LATE);
+    CHECK_EQ(window.gaps(), 2);
+    CHECK_EQ(window.accept(0), PRESS_DUPLICATE);
+    CHECK_EQ(window.late_count(), 2);
+}
+
+static void reorder()
+{
+    PressWindow window;
+    CHECK_EQ(window.classify(0), PRESS_DUPLICATE);     // 0 is "no press yet"
+    CHECK_EQ(window.accept(1), PRESS_NEW);
+    CHECK_EQ(window.accept(3), PRESS_NEW);
+    CHECK_EQ(window.gaps(), 1);
+    CHECK_EQ(window.accept(2), PRESS_LATE);
+    CHECK_EQ(window.gaps(), 0);
+    CHECK_EQ(window.accept(2), PRESS_DUPLICATE);
+    CHECK_EQ(window.accept(3), PRESS_DUPLICATE);
+    CHECK_EQ(window.newest(), 3);
+
+    // ids at the edge of the window
+    window.reset(100);
+    CHECK_EQ(window.classify(100 - (PRESS_WINDOW_SIZE - 1)), PRESS_LATE);
+    CHECK_EQ(window.classify(100 - PRESS_WINDOW_SIZE), PRESS_STALE);
+    // a jump of more than half the id space reads as old
+    CHECK_EQ(window.classify(100 + 128), PRESS_STALE);
+    CHECK_EQ(window.classify(100 + 127), PRESS_NEW);
+
+    // a jump past the window forgets the old bitmap
+    CHECK_EQ(window.accept(100 + 40), PRESS_NEW);
+    CHECK_EQ(window.classify(100), PRESS_STALE);
+    CHECK_EQ(window.classify(100 + 39), PRESS_LATE);
+}
+
+// Presses 1, 2, 3, ... sent with retransmissions, reordered by up to `spread` positions and
+// with some lost; every frame is classified as a model with unwrapped ids would.
+static void model(uint32_t seed, uint32_t spread)
+{
+    std::mt19937 rng(seed);
+    std::vector<uint32_t> frames;
+    std::set<uint32_t> lost;
+    for (uint32_t seq = 1; seq <= 5000; seq++) {
+        if (rng() % 20 == 0) {
+            lost.insert(seq);
+            continue;
+        }
+        frames.push_back(seq);
+        while (rng() % 4 == 0) {
+            frames.push_back(seq);  // retransmission
+        }
+    }
+    // bounded reordering: every frame moves by at most `spread` places
+    std::vector<std::pair<uint32_t, uint32_t>> keyed;
+    for (size_t i = 0; i < frames.size(); i++) {
+        keyed.push_back({(uint32_t)i + rng() % (spread + 1), frames[i]});
+    }
+    std::stable_sort(keyed.begin(), keyed.end(),
+                     [](const std::pair<uint32_t, uint32_t>& a, const std::pair<uint32_t, uint32_t>& b) { return a.first < b.first; });
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i] = keyed[i].second;
+    }
+
+    PressWindow window;
+    std::set<uint32_t> seen = {0};
+    uint32_t newest = 0;
+    uint32_t mismatches = 0;
+    uint32_t presses = 0;
+    uint32_t skipped = 0;
+    uint32_t filled = 0;
+    for (uint32_t seq : frames) {
+        PressOrder expected;
+        if (seq > newest) {
+            expected = PRESS_NEW;
+        } else if (newest - seq >= PRESS_WINDOW_SIZE) {
+            expected = PRESS_STALE;
+        } else {
+            expected = seen.count(seq) ? PRESS_DUPLICATE : PRESS_LATE;
+        }
+        PressOrder order = window.accept((uint8_t)seq);
+        mismatches += order != expected;
+        if (order == PRESS_NEW) {
+            skipped += seq - newest - 1;
+            newest = seq;
+        }
+        if (order == PRESS_LATE) {
+            filled++;
+        }
+        if (order == PRESS_NEW || order == PRESS_LATE) {
+            presses++;
+            seen.insert(seq);
+        }
+    }
+    CHECK_EQ(mismatches, 0);
+    CHECK_EQ(window.gaps(), skipped - filled);
+    // with reordering inside the window every press counts exactly once
+    if (spread < PRESS_WINDOW_SIZE / 2) {
+        CHECK_EQ(presses, 5000 - lost.size());
+        CHECK_EQ(window.gaps(), lost.size() - (newest < 5000 ? 5000 - newest : 0));
+    }
+    printf("spread %2u: %zu frames, %u presses, %u late, %u duplicates, %u gaps (%zu lost)\n", spread,
+           frames.size(), presses, window.late_count(), window.duplicate_count(), window.gaps(), lost.size());
+}
+
+int main()
+{
+    wraparound();
+    reorder();
+    model(1, 0);
+    model(2, 3);
+    model(3, 12);
+    model(4, 60);
+    return check_result("test_press_window");
+}
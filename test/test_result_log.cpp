@@ -0,0 +1,254 @@
+// Results log on a flash emulator: the checkpointed index matches a ResultStore fed the whole
+// history, a reboot reads a bounded log, the log of earlier firmware is taken over, and a power
+// loss at every single flash operation loses at most the record being written and never counts
+// one twice. Prints the boot time for 100000 games, checkpointed and as one plain log.
+#include "result_log.h"
+#include "check.h"
+#include <string.h>
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+
+// LittleFS semantics: every operation is atomic. After `budget` write operations the power is
+// gone, every later write is lost; reads count their bytes.
+class FlashEmulator : public ResultFiles {
+public:
+    FlashEmulator() : budget(-1), bytes_read(0) {}
+
+    size_t read(const char* name, size_t offset, void* data, size_t len) override {
+        auto file = files.find(name);
+        if (file == files.end() || offset >= file->second.size()) {
+            return 0;
+        }
+        size_t n = file->second.size() - offset < len ? file->second.size() - offset : len;
+        memcpy(data, file->second.data() + offset, n);
+        bytes_read += n;
+        return n;
+    }
+    bool append(const char* name, const void* data, size_t len) override {
+        if (!powered()) {
+            return false;
+        }
+        std::vector<uint8_t> &file = files[name];
+        file.insert(file.end(), (const uint8_t *)data, (const uint8_t *)data + len);
+        return true;
+    }
+    bool replace(const char* name, const void* data, size_t len) override {
+        if (!powered()) {
+            return false;
+        }
+        files[name].assign((const uint8_t *)data, (const uint8_t *)data + len);
+        return true;
+    }
+    void remove(const char* name) override {
+        if (powered()) {
+            files.erase(name);
+        }
+    }
+
+    size_t stored() const {
+        size_t bytes = 0;
+        for (const auto &file : files) {
+            bytes += file.second.size();
+        }
+        return bytes;
+    }
+
+    std::map<std::string, std::vector<uint8_t>> files;
+    int64_t budget;     // write operations until the power fails, -1: never
+    size_t bytes_read;
+
+private:
+    bool powered() {
+        if (budget == 0) {
+            return false;
+        }
+        if (budget > 0) {
+            budget--;
+        }
+        return true;
+    }
+};
+
+static uint32_t rng = 1;
+
+static uint32_t next_random()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+// Game `i` of a history that spans many days, some without a set clock.
+static ResultRecord game(uint32_t i)
+{
+    ResultRecord record = {};
+    record.mode = 1 + next_random() % (GAME_MODE_COUNT - 1);
+    record.total_us = 2000000 + next_random() % 8000000;
+    record.best_us = 150000 + next_random() % 100000;
+    record.day = i % 97 == 5 ? RESULT_NO_DAY : 19000 + i / 300;
+    record.penalties = next_random() % 3;
+    result_seal(record);
+    return record;
+}
+
+static bool same_top(const ResultTop* a, const ResultTop* b)
+{
+    if (a == nullptr || b == nullptr) {
+        return a == b;
+    }
+    if (a->size() != b->size()) {
+        return false;
+    }
+    for (uint8_t r = 0; r < a->size(); r++) {
+        if (memcmp(&(*a)[r], &(*b)[r], sizeof(ResultRecord)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool same_index(const ResultStore& a, const ResultStore& b, uint16_t last_day)
+{
+    if (a.records() != b.records() || a.corrupt() != b.corrupt()) {
+        return false;
+    }
+    for (uint8_t mode = 0; mode < GAME_MODE_COUNT; mode++) {
+        if (!same_top(&a.all_time(mode), &b.all_time(mode))) {
+            return false;
+        }
+        for (uint16_t day = 19000; day <= last_day; day++) {
+            if (!same_top(a.of_day(mode, day), b.of_day(mode, day))) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void check_history()
+{
+    FlashEmulator flash;
+    ResultLog log(flash);
+    CHECK_EQ(log.load(), 0);
+    ResultStore reference;
+    const uint32_t games = 3 * RESULT_CHECKPOINT_RECORDS + 17;
+    for (uint32_t i = 0; i < games; i++) {
+        ResultRecord record = game(i);
+        CHECK(log.append(record));
+        reference.add(record);
+        CHECK(log.log_records() < RESULT_CHECKPOINT_RECORDS);
+    }
+    CHECK_EQ(log.checkpoints(), 3);
+    CHECK(same_index(log.index(), reference, 19000 + games / 300));
+
+    // a reboot reads the checkpoint and 17 records, one log and the checkpoint are on flash
+    ResultLog reboot(flash);
+    CHECK_EQ(reboot.load(), 17);
+    CHECK_EQ(reboot.generation(), 3);
+    CHECK(same_index(reboot.index(), reference, 19000 + games / 300));
+    CHECK_EQ(flash.files.size(), 2);
+    CHECK_EQ(flash.stored(), sizeof(ResultCheckpoint) + 17 * sizeof(ResultRecord));
+}
+
+// A log of earlier firmware has no checkpoint: it is read once and checkpointed.
+static void check_legacy_log()
+{
+    FlashEmulator flash;
+    ResultStore reference;
+    for (uint32_t i = 0; i < 1000; i++) {
+        ResultRecord record = game(i);
+        if (i == 500) {
+            record.crc ^= 1;    // corrupt records are skipped and counted, as before
+        }
+        flash.append(RESULT_LOG_FILE, &record, sizeof(record));
+        reference.load(&record, 1);
+    }
+    ResultLog log(flash);
+    CHECK_EQ(log.load(), 1000);
+    CHECK_EQ(log.checkpoints(), 1);
+    CHECK(same_index(log.index(), reference, 19010));
+    CHECK_EQ(log.index().corrupt(), 1);
+
+    ResultLog reboot(flash);
+    CHECK_EQ(reboot.load(), 0);
+    CHECK(same_index(reboot.index(), reference, 19010));
+}
+
+// Cut the power before each write operation of a history with two checkpoints, then reboot.
+static void check_power_loss()
+{
+    const uint32_t games = 2 * RESULT_CHECKPOINT_RECORDS + 40;
+    // appends plus three operations per checkpoint
+    const int64_t operations = games + 2 * 3 + 1;
+    for (int64_t cut = 0; cut <= operations; cut++) {
+        rng = 1;
+        FlashEmulator flash;
+        ResultLog log(flash);
+        log.load();
+        flash.budget = cut;
+        ResultStore reference;
+        for (uint32_t i = 0; i < games; i++) {
+            ResultRecord record = game(i);
+            if (log.append(record)) {
+                reference.add(record);
+            }
+        }
+        flash.budget = -1;
+        ResultLog reboot(flash);
+        reboot.load();
+        bool same = same_index(reboot.index(), reference, 19000 + games / 300);
+        CHECK(same);
+        if (!same) {
+            printf("power loss after %lld operations: %u records on reboot, %u written\n", (long long)cut,
+                   reboot.index().records(), reference.records());
+        }
+    }
+    printf("power loss before each of %lld write operations checked\n", (long long)operations + 1);
+}
+
+// Boot with 100000 games on flash: the checkpointed log against the whole history as one log.
+static void bench_boot()
+{
+    const uint32_t games = 100000;
+    FlashEmulator flash;
+    std::vector<ResultRecord> history;
+    ResultLog log(flash);
+    log.load();
+    for (uint32_t i = 0; i < games; i++) {
+        history.push_back(game(i));
+        log.append(history.back());
+    }
+
+    flash.bytes_read = 0;
+    ResultLog reboot(flash);
+    auto start = std::chrono::steady_clock::now();
+    uint32_t read = reboot.load();
+    double checkpointed_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    CHECK_EQ(reboot.index().records(), games);
+    CHECK(read < RESULT_CHECKPOINT_RECORDS);
+
+    ResultStore whole;
+    start = std::chrono::steady_clock::now();
+    for (uint32_t i = 0; i < games; i += RESULT_LOAD_CHUNK) {
+        whole.load(&history[i], games - i < RESULT_LOAD_CHUNK ? games - i : RESULT_LOAD_CHUNK);
+    }
+    double whole_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+    CHECK(same_index(reboot.index(), whole, 19000 + games / 300));
+    CHECK(checkpointed_us < 100000);
+
+    printf("%u games: checkpointed boot reads %zu bytes (%u log records) in %.0f us, the whole log "
+           "(%zu bytes) indexes in %.0f us, %zu bytes on flash\n", games, flash.bytes_read, read, checkpointed_us,
+           games * sizeof(ResultRecord), whole_us, flash.stored());
+}
+
+int main()
+{
+    check_history();
+    check_legacy_log();
+    check_power_loss();
+    bench_boot();
+    return check_result("test_result_log");
+}
@@ -0,0 +1,160 @@
+// Session log replay: games recorded from an engine on a simulated wall are fed back through
+// session_replay(), which must reproduce every state transition, the final total and every
+// CAN frame the recorded engine sent. Covers plain and race games, a game resumed from a
+// snapshot after a reset, and held rounds released the way a tournament releases them.
+#include "sim_driver.h"
+#include "check.h"
+#include <vector>
+
+#define LOG_CAPACITY    (1 << 17)
+
+static SessionRecord storage[LOG_CAPACITY];
+
+struct Recording {
+    std::vector<SessionRecord> records;
+    std::vector<GameState> states;
+    std::vector<int64_t> totals;
+    std::vector<CanFrame> sent;
+    int64_t total;
+};
+
+static void finish(SimDriver& display, SessionRecorder& log, Recording& out)
+{
+    CHECK_EQ(log.drops(), 0);
+    SessionRecord batch[256];
+    size_t n;
+    while ((n = log.read(batch, 256)) > 0) {
+        out.records.insert(out.records.end(), batch, batch + n);
+    }
+    out.states = display.hooks.states;
+    out.totals = display.hooks.totals;
+    out.sent = display.hooks.sent;
+    out.total = display.engine->total();
+}
+
+// A display that boots and records into a fresh `log`, the way each boot starts a new log file.
+static SimDriver* start(SessionRecorder& log, uint32_t seed)
+{
+    time_mock_set(TIME_US(1000));
+    SimConfig config = sim_driver_config(12, seed);
+    config.loss_permille = 5;
+    config.duplicate_permille = 30;
+    config.wrong_press_permille = 200;
+    SimDriver *display = new SimDriver(config, seed);
+    log.begin(storage, LOG_CAPACITY);
+    display->record(&log);
+    display->hooks.keep_sent = true;
+    display->engine->set_used(4, false);
+    log.buzzer(4, false);
+    return display;
+}
+
+// Replays `recording` and compares every output with the recorded run.
+static void check_replay(const Recording& recording, const char* name)
+{
+    TestHooks ui;
+    ui.keep_sent = true;
+    int64_t total = -1;
+    bool same = session_replay(recording.records.data(), recording.records.size(), ui, &total);
+    CHECK(same);
+    CHECK_EQ(total, recording.total);
+    CHECK_EQ(ui.states.size(), recording.states.size());
+    CHECK(ui.states == recording.states);
+    CHECK(ui.totals == recording.totals);
+    CHECK_EQ(ui.sent.size(), recording.sent.size());
+    bool frames_match = ui.sent.size() == recording.sent.size();
+    for (size_t i = 0; frames_match && i < ui.sent.size(); i++) {
+        frames_match = ui.sent[i].id == recording.sent[i].id && ui.sent[i].len == recording.sent[i].len &&
+                       memcmp(ui.sent[i].data, recording.sent[i].data, ui.sent[i].len) == 0;
+    }
+    CHECK(frames_match);
+    printf("%s: %zu records, %zu transitions, %zu frames sent, total %lld us: %s\n", name, recording.records.size(),
+           recording.states.size(), recording.sent.size(), (long long)recording.total, same && frames_match ? "replayed" : "DIVERGED");
+}
+
+static void plain_and_race()
+{
+    SessionRecorder log;
+    SimDriver *display = start(log, 3);
+    display->run_for(2000);
+    CHECK(display->play(GAME_CMD_START, 3));
+    display->command(GAME_CMD_OK);
+    CHECK(display->play(GAME_CMD_START_RACE, 3));
+    Recording recording;
+    finish(*display, log, recording);
+    delete display;
+    check_replay(recording, "plain and race");
+
+    // a changed record is noticed
+    for (SessionRecord &record : recording.records) {
+        if (record.type == SESSION_REC_FRAME && record.a == BUZZER_FRAME_STATUS && record.value > 100) {
+            record.value += 50;
+        }
+    }
+    TestHooks ui;
+    CHECK(!session_replay(recording.records.data(), recording.records.size(), ui, nullptr));
+}
+
+static void resumed()
+{
+    // the first run resets in the middle of round 4 and leaves its snapshot behind
+    SessionRecorder log;
+    SimDriver *display = start(log, 9);
+    display->run_for(2000);
+    display->command(GAME_CMD_START, 2);
+    CHECK(display->run([display] { return display->engine->round() == 4 && display->engine->state() == GAME_WAIT_FOR_BUZZER2; }, 60000));
+    GameSnapshot snapshot = display->hooks.last_snapshot;
+    delete display;
+
+    // the second run boots, logs the snapshot and resumes
+    SessionRecorder rebooted;
+    display = start(rebooted, 10);
+    CHECK(display->engine->load_snapshot(snapshot));
+    rebooted.snapshot(snapshot);
+    display->run_for(1500);
+    display->command(GAME_CMD_RESUME);
+    CHECK(display->run([display] { return display->engine->state() == GAME_END; }, 60000));
+    CHECK_EQ(display->engine->round(), game_mode(2).rounds + 1);
+    Recording recording;
+    finish(*display, rebooted, recording);
+    delete display;
+    check_replay(recording, "resumed");
+}
+
+static void held_rounds()
+{
+    SessionRecorder log;
+    SimDriver *display = start(log, 21);
+    display->run_for(2000);
+    log.hold(true);
+    display->engine->hold_rounds(true);
+    display->command(GAME_CMD_START, 1);
+    uint32_t released = 0;
+    CHECK(display->run([&] {
+        if (display->engine->held()) {
+            // the coordinator's GO arrives a little late and names a lit time just ahead
+            int64_t lit_us = time_us() + TIME_US(300) + released * 37;
+            log.release(lit_us);
+            CHECK(display->engine->release(lit_us));
+            released++;
+        }
+        return display->engine->state() == GAME_END;
+    }, 120000));
+    CHECK_EQ(released, game_mode(1).rounds);
+    log.hold(false);
+    display->engine->hold_rounds(false);
+    display->command(GAME_CMD_OK);
+    CHECK(display->play(GAME_CMD_START, 1));
+    Recording recording;
+    finish(*display, log, recording);
+    delete display;
+    check_replay(recording, "held rounds");
+}
+
+int main()
+{
+    plain_and_race();
+    resumed();
+    held_rounds();
+    return check_result("test_session_replay");
+}
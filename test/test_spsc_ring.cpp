@@ -0,0 +1,145 @@
+// Stress test of SpscRing with a real producer and consumer thread, the way twai_rx_task and
+// loop() use rx_ring: every item arrives once, in order and untorn, and drops are counted.
+#include "spsc_ring.h"
+#include "check.h"
+#include <chrono>
+#include <thread>
+
+struct Item {
+    uint32_t seq;
+    uint32_t pad[6];
+    uint32_t check;     // seq ^ every pad word, to catch torn copies
+};
+
+static Item make_item(uint32_t seq)
+{
+    Item item;
+    item.seq = seq;
+    item.check = seq;
+    for (int i = 0; i < 6; i++) {
+        item.pad[i] = seq * 2654435761u + i;
+        item.check ^= item.pad[i];
+    }
+    return item;
+}
+
+static bool intact(const Item& item)
+{
+    uint32_t check = item.seq;
+    for (int i = 0; i < 6; i++) {
+        check ^= item.pad[i];
+    }
+    return check == item.check;
+}
+
+// The producer retries a full ring, so nothing is lost and the order is exact.
+template <size_t N>
+static void lossless(uint32_t count)
+{
+    static SpscRing<Item, N> ring;
+    auto start = std::chrono::steady_clock::now();
+    std::thread producer([count] {
+        for (uint32_t seq = 0; seq < count; seq++) {
+            Item item = make_item(seq);
+            while (!ring.push(item)) {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    uint32_t expected = 0;
+    uint32_t torn = 0;
+    uint32_t out_of_order = 0;
+    Item item;
+    while (expected < count) {
+        if (!ring.pop(item)) {
+            std::this_thread::yield();
+            continue;
+        }
+        torn += !intact(item);
+        out_of_order += item.seq != expected;
+        expected = item.seq + 1;
+    }
+    producer.join();
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    CHECK_EQ(torn, 0);
+    CHECK_EQ(out_of_order, 0);
+    CHECK_EQ(ring.size(), 0);
+    CHECK(!ring.pop(item));
+    printf("ring %3zu: %u items in %.3f s (%.1f M/s), %u full-ring retries\n", N, count, seconds,
+           count / seconds / 1e6, ring.drops());
+}
+
+// The producer never waits, like the RX task: items are dropped on a full ring, the rest
+// arrive in order, and received + drops adds up to what was pushed.
+template <size_t N>
+static void lossy(uint32_t count)
+{
+    static SpscRing<Item, N> ring;
+    std::atomic<bool> done(false);
+    std::thread producer([count, &done] {
+        for (uint32_t seq = 0; seq < count; seq++) {
+            ring.push(make_item(seq));
+            if ((seq & 31) == 31) {
+                std::this_thread::yield();  // frames come in bursts
+            }
+        }
+        done.store(true, std::memory_order_release);
+    });
+
+    uint32_t received = 0;
+    uint32_t torn = 0;
+    uint32_t out_of_order = 0;
+    int64_t last = -1;
+    Item item;
+    for (;;) {
+        bool finished = done.load(std::memory_order_acquire);
+        if (!ring.pop(item)) {
+            if (finished) {
+                break;
+            }
+            std::this_thread::yield();
+            continue;
+        }
+        received++;
+        torn += !intact(item);
+        out_of_order += (int64_t)item.seq <= last;
+        last = item.seq;
+    }
+    producer.join();
+
+    CHECK_EQ(torn, 0);
+    CHECK_EQ(out_of_order, 0);
+    CHECK_EQ(received + ring.drops(), count);
+    printf("ring %3zu: %u of %u items received, %u dropped\n", N, received, count, ring.drops());
+}
+
+// Single-threaded edges: the masked index goes around, a full ring refuses and counts.
+static void full_and_empty()
+{
+    static SpscRing<uint32_t, 4> ring;
+    uint32_t value = 0;
+    CHECK(!ring.pop(value));
+    for (uint32_t i = 0; i < 10; i++) {
+        CHECK(ring.push(i));
+        CHECK(ring.pop(value));
+        CHECK_EQ(value, i);
+    }
+    for (uint32_t i = 0; i < 4; i++) {
+        CHECK(ring.push(i));
+    }
+    CHECK(!ring.push(99));
+    CHECK_EQ(ring.size(), 4);
+    CHECK_EQ(ring.drops(), 1);
+}
+
+int main()
+{
+    full_and_empty();
+    lossless<4>(1000000);
+    lossless<256>(5000000);
+    lossy<4>(1000000);
+    lossy<256>(5000000);
+    return check_result("test_spsc_ring");
+}
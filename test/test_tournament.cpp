@@ -0,0 +1,431 @@
+// A tournament of four displays whose walls share one simulated bus. Every display runs a
+// GameEngine on its own range of buzzer ids and a TournamentNode, driven like loop() drives them
+// on the target; tournament frames go from display to display, buzzer frames reach every display.
+// Each display has its own clock, offset by seconds and drifting by some ppm, and a tournament
+// frame reaches each display after its own random delay.
+// Checks that each wall registers, lights and scores only its own buzzers, that one wall's
+// "all off" leaves the others lit, that every round lights on all walls within 1 ms, that the GO
+// delays follow the mode's distribution, and that the heats end with one winner, also when the
+// coordinator dies between heats or during one. A wall that did not finish its game ranks last
+// and does not advance.
+#include "test_hooks.h"
+#include "sim_bus.h"
+#include "tournament.h"
+#include "check.h"
+#include <deque>
+#include <map>
+#include <utility>
+#include <vector>
+
+#define WALLS           (4)
+#define WALL_SIZE       (8)
+#define VARIANT         (2)     // "Mittel": balanced start delays
+#define LIT_SPREAD_US   (1000)
+
+static void sleep_mock(uint32_t ms)
+{
+    time_mock_advance(TIME_US(ms));
+}
+
+static uint32_t rng = 1;
+
+static uint32_t next_random()
+{
+    rng ^= rng << 13;
+    rng ^= rng >> 17;
+    rng ^= rng << 5;
+    return rng;
+}
+
+enum Kill {
+    KILL_NONE,
+    KILL_BETWEEN_HEATS,     // the coordinator dies as it shows the standings of heat 1
+    KILL_DURING_HEAT        // the coordinator dies after releasing round 3 of heat 1
+};
+
+class Wall;
+static std::vector<Wall *> walls;
+
+// Light-on times of each (heat, round) on the common clock, one per wall that lit it.
+static std::map<std::pair<uint8_t, uint8_t>, std::vector<int64_t>> lits;
+
+class Wall : public TournamentHooks {
+public:
+    Wall(SimBus& bus, uint8_t node) :
+        hooks(node + 1), engine(new GameEngine(hooks)), tournament(*this, node), games(0), game_sum_us(0),
+        final_shown(false), winner(TOURNAMENT_NO_NODE), standings(0), released(0), alive(true),
+        offset_us(TIME_US(1000) * (3 + 7 * node) + next_random() % 1000000),
+        drift_ppm((int32_t)(next_random() % 41) - 20), last_delivery(0), ended(false)
+    {
+        hooks.bus = &bus;
+        hooks.keep_sent = true;
+        engine->set_wall(node * WALL_SIZE + 1, (node + 1) * WALL_SIZE);
+    }
+    ~Wall() { delete engine; }
+
+    // This display's clock at a time of the common clock, and back.
+    int64_t local(int64_t global) const { return global + offset_us + global * drift_ppm / 1000000; }
+    int64_t global(int64_t local) const { return (local - offset_us) * 1000000 / (1000000 + drift_ppm); }
+
+    // TournamentHooks: a frame waits for the bus, then each display takes a while to receive it.
+    void send_can(uint32_t id, const uint8_t* data, uint8_t len) override {
+        CanFrame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.id = id;
+        frame.len = len;
+        memcpy(frame.data, data, len);
+        int64_t on_bus = time_us() + 50 + next_random() % 750;
+        for (Wall *wall : walls) {
+            if (wall != this && wall->alive) {
+                wall->deliver(on_bus + next_random() % 200, frame);
+            }
+        }
+        if (((id >> 4) & 7) == TOURNAMENT_MSG_GO && tournament.coordinating()) {
+            std::vector<uint32_t> &delays = go_delays[data[0]];
+            if (go_rounds[data[0]] != data[1]) {    // not a repeat for a late READY
+                go_rounds[data[0]] = data[1];
+                delays.push_back(((data[4] << 24) | (data[5] << 16) | (data[6] << 8) | data[7]) -
+                                 (uint32_t)local(time_us()) - TIME_US(TOURNAMENT_GO_LEAD_MS));
+            }
+        }
+    }
+    uint32_t random_range(uint32_t lo, uint32_t hi) override { return hooks.random_range(lo, hi); }
+    int64_t now_us() override { return local(time_us()); }
+    void start_heat(uint8_t, uint8_t variant) override {
+        engine->hold_rounds(true);
+        if (engine->state() == GAME_END) {
+            command(GAME_CMD_OK, 0);
+        } else if (engine->state() != GAME_IDLE) {
+            command(GAME_CMD_CANCEL, 0);
+        }
+        command(GAME_CMD_START, variant);
+        ended = false;
+    }
+    void release_round(uint8_t round, int64_t lit_us) override {
+        int64_t lit = global(lit_us);
+        lits[std::make_pair(tournament.bracket().heat(), round)].push_back(lit);
+        released++;
+        engine->release(lit);
+    }
+    void show_standing(const TournamentBracket& bracket, uint8_t, bool final) override {
+        standings++;
+        if (final) {
+            uint8_t nodes[TOURNAMENT_MAX_NODES];
+            final_shown = bracket.ranking(nodes) > 0;
+            winner = nodes[0];
+        }
+    }
+
+    void deliver(int64_t at, const CanFrame& frame) {
+        // the receive queue keeps the order of the bus
+        at = at < last_delivery ? last_delivery : at;
+        last_delivery = at;
+        inbox.push_back(std::make_pair(at, frame));
+    }
+
+    void kill() {
+        alive = false;
+        inbox.clear();
+    }
+
+    // One pass of loop(), on this display's clock.
+    void loop(int64_t now_global) {
+        if (!alive) {
+            return;
+        }
+        while (!inbox.empty() && inbox.front().first <= now_global) {
+            tournament.handle_frame(inbox.front().second, local(inbox.front().first));
+            inbox.pop_front();
+        }
+        int64_t now = local(now_global);
+        if (game_time_reached(now, tournament.next_deadline())) {
+            tournament.tick(now);
+        }
+        engine->hold_rounds(tournament.phase() == TOURNAMENT_PLAYING);
+        GameEvent event = {};
+        event.type = GAME_EVENT_TIMER;
+        engine->handle(event, now_global);
+        if (engine->held()) {
+            tournament.round_ready(engine->round(), now);
+        } else if (engine->state() == GAME_END) {
+            if (!ended) {
+                games++;
+                game_sum_us += engine->total();
+                ended = true;
+            }
+            tournament.game_finished(engine->complete() ? engine->total() : TOURNAMENT_DNF, engine->penalties(), now);
+        }
+    }
+
+    // Earliest deadline on the common clock.
+    int64_t deadline() const {
+        int64_t deadline = engine->next_deadline();
+        int64_t next = global(tournament.next_deadline());
+        deadline = next < deadline ? next : deadline;
+        if (!inbox.empty() && inbox.front().first < deadline) {
+            deadline = inbox.front().first;
+        }
+        return deadline;
+    }
+
+    TestHooks hooks;
+    GameEngine *engine;
+    TournamentNode tournament;
+    std::deque<std::pair<int64_t, CanFrame>> inbox;     // frames and when they are received
+    uint32_t games;
+    int64_t game_sum_us;    // totals of the games played
+    bool final_shown;
+    uint8_t winner;
+    uint32_t standings;     // standings shown
+    uint32_t released;      // rounds released
+    bool alive;
+    std::map<uint8_t, std::vector<uint32_t>> go_delays;     // per heat, while coordinating
+    std::map<uint8_t, uint8_t> go_rounds;
+
+private:
+    void command(GameCommand command, uint8_t arg) {
+        GameEvent event = {};
+        event.type = GAME_EVENT_COMMAND;
+        event.command = command;
+        event.arg = arg;
+        engine->handle(event, time_us());
+    }
+
+    int64_t offset_us;
+    int32_t drift_ppm;
+    int64_t last_delivery;
+    bool ended;
+};
+
+// Wait for the earliest deadline or buzzer frames, hand every frame to every live display.
+static uint32_t accepted[WALLS];
+static uint32_t frames_total;
+
+static void step(SimBus& bus)
+{
+    int64_t now = time_us();
+    int64_t deadline = now + TIME_US(100);
+    for (Wall *wall : walls) {
+        if (wall->alive && wall->deadline() < deadline) {
+            deadline = wall->deadline();
+        }
+    }
+    int64_t wait_us = deadline - now;
+    uint32_t timeout_ms = wait_us <= 0 ? 0 : wait_us > TIME_US(100) ? 100 : (uint32_t)((wait_us + 999) / 1000);
+    CanFrame frames[64];
+    size_t n = bus.receive(frames, 64, timeout_ms);
+    for (size_t i = 0; i < n; i++) {
+        BuzzerFrame events[BUZZER_FRAME_MAX_EVENTS];
+        uint8_t count = buzzer_frame_decode(frames[i].id, frames[i].data, frames[i].len, frames[i].rx_time_us, events);
+        for (uint8_t e = 0; e < count; e++) {
+            frames_total++;
+            uint32_t takers = 0;
+            for (uint8_t w = 0; w < WALLS; w++) {
+                if (walls[w]->alive && walls[w]->engine->handle_frame(events[e])) {
+                    accepted[w]++;
+                    takers++;
+                }
+            }
+            CHECK(takers <= 1);     // sync replies before discovery have none
+        }
+    }
+    now = time_us();
+    for (Wall *wall : walls) {
+        wall->loop(now);
+    }
+}
+
+// Four entrants, one DNF and one missing: the DNF and the missing node rank last, only timed
+// nodes advance, and with no time at all nobody does.
+static void check_bracket_dnf()
+{
+    TournamentBracket bracket;
+    bracket.start_heat(1, 0xf);
+    bracket.record(0, TOURNAMENT_DNF, 0);
+    bracket.record(1, TIME_US(9000), 1);
+    bracket.record(3, TIME_US(7000), 0);
+    CHECK(bracket.dnf(0));
+    CHECK(!bracket.has_result(0));
+    CHECK(!bracket.dnf(2));
+    CHECK_EQ(bracket.reported(), 0xb);
+    uint8_t nodes[TOURNAMENT_MAX_NODES];
+    CHECK_EQ(bracket.ranking(nodes), 4);
+    CHECK_EQ(nodes[0], 3);
+    CHECK_EQ(nodes[1], 1);
+    CHECK_EQ(bracket.fastest_half(), 0xa);
+
+    bracket.start_heat(2, 0x3);
+    bracket.record(0, TOURNAMENT_DNF, 0);
+    bracket.record(1, TOURNAMENT_DNF, 0);
+    CHECK_EQ(bracket.fastest_half(), 0);
+}
+
+// Every round that lit on several walls lit on all of them within LIT_SPREAD_US.
+static void check_lit_spread()
+{
+    int64_t widest = 0;
+    uint32_t shared = 0;
+    for (const auto &round : lits) {
+        if (round.second.size() < 2) {
+            continue;
+        }
+        int64_t first = round.second[0];
+        int64_t last = round.second[0];
+        for (int64_t lit : round.second) {
+            first = lit < first ? lit : first;
+            last = lit > last ? lit : last;
+        }
+        CHECK(last - first < LIT_SPREAD_US);
+        widest = last - first > widest ? last - first : widest;
+        shared++;
+    }
+    CHECK(shared > 0);
+    printf("%u rounds lit on several walls, widest spread %lld us\n", shared, (long long)widest);
+}
+
+// Balanced delays: each block of four GO delays of a heat covers every quarter of the window. A
+// GO counts from the reception of the last READY, up to a millisecond before it is sent.
+static void check_go_delays(const Wall& coordinator)
+{
+    const GameMode &mode = game_mode(VARIANT);
+    uint32_t range = mode.delay_max_ms - mode.delay_min_ms;
+    for (const auto &heat : coordinator.go_delays) {
+        const std::vector<uint32_t> &delays = heat.second;
+        CHECK_EQ(delays.size(), mode.rounds);
+        for (size_t block = 0; block < delays.size(); block += 4) {
+            uint8_t bins = 0;
+            for (size_t i = block; i < block + 4 && i < delays.size(); i++) {
+                uint32_t ms = (delays[i] + 999) / 1000;
+                CHECK(ms >= mode.delay_min_ms && ms <= mode.delay_max_ms);
+                uint32_t bin = (ms - mode.delay_min_ms) * 4 / range;
+                bins |= 1 << (bin < 4 ? bin : 3);
+            }
+            size_t count = delays.size() - block < 4 ? delays.size() - block : 4;
+            CHECK_EQ(__builtin_popcount(bins), count);
+        }
+    }
+}
+
+// Discover and elect, start the tournament on wall 0 and run it until every live wall shows the
+// final standings, killing the coordinator as `kill` says.
+static void run_tournament(Kill kill)
+{
+    rng = 1 + kill;
+    lits.clear();
+    time_mock_set(TIME_US(1000));
+    SimConfig config;
+    memset(&config, 0, sizeof(config));
+    config.buzzers = WALLS * WALL_SIZE;
+    config.scored_buzzers = WALLS * WALL_SIZE;
+    config.wall_buzzers = WALL_SIZE;
+    config.heartbeat_ms = 100;
+    config.press_distribution = SIM_PRESS_UNIFORM;
+    config.reaction_min_ms = 150;
+    config.reaction_max_ms = 900;
+    config.wrong_press_permille = 250;
+    config.payload_version = BUZZER_PAYLOAD_VERSION;
+    config.seed = 77 + kill;
+    SimBus bus(config, time_us, sleep_mock);
+    for (uint8_t node = 0; node < WALLS; node++) {
+        walls.push_back(new Wall(bus, node));
+    }
+
+    // discovery and the election
+    int64_t until = time_us() + TIME_US(2000);
+    while (time_us() < until) {
+        step(bus);
+    }
+    for (uint8_t w = 0; w < WALLS; w++) {
+        const BuzzerRegistry &buttons = walls[w]->engine->buttons();
+        CHECK_EQ(buttons.size(), WALL_SIZE);
+        for (const BuzzerButton &buzzer : buttons) {
+            CHECK(walls[w]->engine->owns(buzzer.buzzer_id));
+        }
+        CHECK_EQ(walls[w]->tournament.coordinator(), 0);
+    }
+
+    bus.reset_outcome();
+    CHECK(walls[0]->tournament.start(VARIANT, walls[0]->now_us()));
+    until = time_us() + TIME_US(600000);
+    bool done = false;
+    while (!done && time_us() < until) {
+        step(bus);
+        Wall &first = *walls[0];
+        if (first.alive && ((kill == KILL_BETWEEN_HEATS && first.standings > 0) ||
+                            (kill == KILL_DURING_HEAT && first.released >= 3))) {
+            first.kill();
+        }
+        done = true;
+        for (Wall *wall : walls) {
+            done &= wall->final_shown || !wall->alive;
+        }
+    }
+    CHECK(done);
+    check_lit_spread();
+
+    uint8_t winner = walls[WALLS - 1]->winner;
+    for (Wall *wall : walls) {
+        if (wall->alive) {
+            CHECK_EQ(wall->winner, winner);
+            CHECK_EQ(wall->tournament.coordinator(), kill == KILL_NONE ? 0 : 1);
+        }
+    }
+    if (kill != KILL_NONE) {
+        CHECK(!walls[0]->alive);
+        CHECK(winner != 0 && winner < WALLS);
+        printf("coordinator killed %s: winner wall %d\n", kill == KILL_BETWEEN_HEATS ? "between heats" : "during a heat",
+               winner);
+    } else {
+        // 4 walls in heat 1, 2 in heat 2, then one is left
+        uint32_t games = 0;
+        int64_t sum_us = 0;
+        for (Wall *wall : walls) {
+            games += wall->games;
+            sum_us += wall->game_sum_us;
+        }
+        CHECK_EQ(games, WALLS + WALLS / 2);
+        CHECK_EQ(walls[0]->tournament.bracket().heat(), 2);
+        CHECK_EQ(walls[0]->go_delays.size(), 2);
+        check_go_delays(*walls[0]);
+
+        // a foreign "all off" would have put out a lit buzzer; its keepalive relights it as a new round
+        SimStats stats = bus.counters();
+        const GameMode &mode = game_mode(VARIANT);
+        CHECK_EQ(stats.rounds, games * mode.rounds);
+        CHECK_EQ(sum_us, TIME_US(stats.expected_total_ms) + (int64_t)stats.penalties * TIME_US(game_mode_penalty(mode, 1)));
+        CHECK(stats.penalties > 0);
+
+        // the broadcasts of each display carry its range, its light-on frames stay in it
+        for (uint8_t w = 0; w < WALLS; w++) {
+            GameEngine &engine = *walls[w]->engine;
+            for (const CanFrame &frame : walls[w]->hooks.sent) {
+                if (frame.id == TX_ID_ALL_OFF || frame.id == TIME_SYNC_ID) {
+                    CHECK_EQ(frame.data[1], engine.wall_first_id());
+                    CHECK_EQ(frame.data[2], engine.wall_last_id());
+                } else if (frame.id == DISCOVERY_ID) {
+                    CHECK_EQ(frame.data[2], engine.wall_first_id());
+                    CHECK_EQ(frame.data[3], engine.wall_last_id());
+                } else if ((frame.id & ~0xffu) == TX_ID_LIGHT_ON) {
+                    CHECK(engine.owns(frame.id & 0xff));
+                }
+            }
+            printf("wall %d (buzzers %d-%d): %u games, %u of %u buzzer frames\n", w, engine.wall_first_id(),
+                   engine.wall_last_id(), walls[w]->games, accepted[w], frames_total);
+        }
+        printf("winner: wall %d, %u rounds, %u wrong presses\n", winner, stats.rounds, stats.penalties);
+    }
+
+    for (Wall *wall : walls) {
+        delete wall;
+    }
+    walls.clear();
+}
+
+int main()
+{
+    check_bracket_dnf();
+    run_tournament(KILL_NONE);
+    run_tournament(KILL_BETWEEN_HEATS);
+    run_tournament(KILL_DURING_HEAT);
+    return check_result("test_tournament");
+}